@@ -2,32 +2,82 @@
 #define LRUCACHE_H
 
 #include <memory>
+#include <string>
+#include <string_view>
 #include <map>
 #include <unordered_map>
 #include <vector>
 #include <optional>
+#include <functional>
+#include <algorithm>
+#include <limits>
 #include <cassert>
+#include <cstdint>
+
+#include "lrucache_alloc.h"
+#include "lrucache_lookup.h"
+#include "lrucache_listener.h"
+#include "lrucache_stats.h"
 
 namespace lrucache {
 
+// Spreads the bits of std::hash (identity for integers in most standard libraries) over the whole word
+inline uint64_t mixHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Implements LRUCache::saveSnapshot() and loadSnapshot(), see lrucache_snapshot.h
+template <typename Cache>
+struct SnapshotIO;
+
 // Pass to LRUCache to represent the list by iterators inside a node pointed to by unique_ptr
+// (the list nodes come from the allocator of MapClass, e.g. std::pmr::unordered_map)
 template <typename Key, typename Value, template<class, class...> class MapClass>
 class BaseUniqPtr {
 protected:
    
+    struct ListNode;
+    using ListAlloc = MapAllocFor<Key, MapClass, ListNode>;
+    using ListPtr = std::unique_ptr<ListNode, AllocDeleter<ListAlloc>>;
+
     struct ListNode {
-        typename MapClass<Key, std::unique_ptr<ListNode>>::iterator next_;
-        typename MapClass<Key, std::unique_ptr<ListNode>>::iterator prev_;
+        using Iter = typename MapClass<Key, ListPtr>::iterator;
+
+        Iter next_;
+        Iter prev_;
         Value value_;
+
+        template <typename... Args>
+        ListNode(Iter next, Iter prev, Args&&... args)
+            : next_(next)
+            , prev_(prev)
+            , value_(std::forward<Args>(args)...)
+        {
+
+        }
     };
 
-    using Map = MapClass<Key, std::unique_ptr<ListNode>>;
+    using Map = MapClass<Key, ListPtr>;
     using MapIter = typename Map::iterator;
     using Pair = std::pair<Key, Value>;
     using NodeType = typename Map::node_type;
     using TKey = Key;
     using TValue = Value;
 
+public:
+    using allocator_type = typename Map::allocator_type;
+
+    // Size of a NodePool holding a full cache
+    static size_t nodePoolBytes(size_t max_size) {
+        return 4096 + max_size * (mapNodePoolBytes<typename Map::value_type>() + (sizeof(ListNode) + 15) / 16 * 16);
+    }
+
+protected:
     Value& val(NodeType& node) { return node.mapped()->value_; }
     
     Value& val(MapIter it) { return it->second->value_; }
@@ -53,9 +103,20 @@ protected:
         return it->second->prev_ = target; 
     }
 
-    typename Map::value_type makeListNode(const Key& key, const Value& value) {
-        std::unique_ptr<ListNode> p{new ListNode{kv_.end(), kv_.end(), value}};
-        return {key, std::move(p)};
+    // Prefetches what moveToFront(it) reads besides the map node
+    void prefetchListNode(MapIter it) const {
+        prefetchAddress(it->second.get());
+    }
+
+    // Inserts a missing key with the value constructed in place from args
+    template <typename K, typename... Args>
+    MapIter emplaceListNode(K&& key, Args&&... args) {
+        ListPtr node{allocateUnique(ListAlloc(kv_.get_allocator()), kv_.end(), kv_.end(), std::forward<Args>(args)...)};
+        return kv_.try_emplace(std::forward<K>(key), std::move(node)).first;
+    }
+
+    void eraseListNode(MapIter it) {
+        kv_.erase(it);
     }
 
     void clear() {
@@ -68,23 +129,29 @@ protected:
 
     }
 
+    // Makes room for max_size elements before the capacity grows, see LRUCache::setMaxSize()
+    void reserve(size_t max_size) {
+        reserveMap(kv_, max_size);
+    }
+
     size_t max_size_{0};
     Map kv_;
     MapIter first_;
     MapIter last_;
 
-    explicit BaseUniqPtr(size_t max_size) 
+    explicit BaseUniqPtr(size_t max_size, const allocator_type& alloc = allocator_type()) 
         : max_size_(max_size)
+        , kv_(alloc)
         , first_(kv_.end())
         , last_(kv_.end()) 
     {
-
+        reserveMap(kv_, max_size);
     }
 
 };
 
 
-// Pass to LRUCache to represent the list by a vector of iterators
+// Pass to LRUCache to represent the list by a vector of iterators (allocated like the nodes of MapClass)
 template <typename Key, typename Value, template<class, class...> class MapClass>
 class BaseVal {
 protected:
@@ -92,6 +159,14 @@ protected:
     struct ListNode {
         size_t start_index_;
         Value value_;
+
+        template <typename... Args>
+        explicit ListNode(size_t start_index, Args&&... args)
+            : start_index_(start_index)
+            , value_(std::forward<Args>(args)...)
+        {
+
+        }
     };
 
     using Map = MapClass<Key, ListNode>;
@@ -100,7 +175,18 @@ protected:
     using NodeType = typename Map::node_type;
     using TKey = Key;
     using TValue = Value;
+    using IterAlloc = typename std::allocator_traits<typename Map::allocator_type>::template rebind_alloc<MapIter>;
+    using IndexAlloc = typename std::allocator_traits<typename Map::allocator_type>::template rebind_alloc<size_t>;
+
+public:
+    using allocator_type = typename Map::allocator_type;
+
+    // Size of a NodePool holding a full cache
+    static size_t nodePoolBytes(size_t max_size) {
+        return 4096 + max_size * (mapNodePoolBytes<typename Map::value_type>() + 2 * sizeof(MapIter));
+    }
 
+protected:
     Value& val(NodeType& node) { return node.mapped().value_; }
     
     Value& val(MapIter it) { return it->second.value_; }
@@ -126,42 +212,102 @@ protected:
         return iters_[it->second.start_index_] = target; 
     }
 
-    typename Map::value_type makeListNode(const Key& key, const Value& value) {
-        return {key, ListNode{iters_.size() - 2, value}};
+    // Prefetches what moveToFront(it) reads besides the map node
+    void prefetchListNode(MapIter it) const {
+        prefetchAddress(&iters_[it->second.start_index_]);
+    }
+
+    // Inserts a missing key with the value constructed in place from args
+    // (taking the pair of iters_ left by an erased element if there is one)
+    template <typename K, typename... Args>
+    MapIter emplaceListNode(K&& key, Args&&... args) {
+        size_t start_index = free_.empty() ? iters_.size() - 2 : free_.back();
+        MapIter it = kv_.try_emplace(std::forward<K>(key), start_index, std::forward<Args>(args)...).first;
+        if (!free_.empty()) {
+            free_.pop_back();
+        }
+        return it;
+    }
+
+    void eraseListNode(MapIter it) {
+        free_.push_back(it->second.start_index_);
+        kv_.erase(it);
     }
 
     void clear() {
         kv_.clear();
         iters_.clear();
+        free_.clear();
         first_ = kv_.end();
         last_ = kv_.end();
     }
 
     void preAdd() {
-        iters_.push_back(kv_.end());
-        iters_.push_back(kv_.end());
+        if (free_.empty()) {
+            iters_.push_back(kv_.end());
+            iters_.push_back(kv_.end());
+        }
+    }
+
+    // The iterators are referred to by their index in iters_, so its reallocation keeps the list valid
+    void reserve(size_t max_size) {
+        reserveMap(kv_, max_size);
+        iters_.reserve(max_size * 2);
     }
 
     size_t max_size_{0};
     Map kv_;
     MapIter first_;
     MapIter last_;
-    std::vector<MapIter> iters_;
+    std::vector<MapIter, IterAlloc> iters_;
+    // Start indexes of the pairs of iters_ released by the erased elements
+    std::vector<size_t, IndexAlloc> free_;
 
-    explicit BaseVal(size_t max_size) 
+    explicit BaseVal(size_t max_size, const allocator_type& alloc = allocator_type()) 
         : max_size_(max_size)
+        , kv_(alloc)
         , first_(kv_.end())
         , last_(kv_.end()) 
+        , iters_(IterAlloc(alloc))
+        , free_(IndexAlloc(alloc))
     {
+        reserveMap(kv_, max_size);
         iters_.reserve(max_size * 2);
     }
 
 };
 
 
-// LRU Cache parametrized class (use BaseVal or BaseUniqPtr)
-template <typename Base>
+// The same Base with the value type replaced by Value, lets a cache keep extra data along the values
+template <typename Base, typename Value>
+struct RebindBase;
+
+template <template<class, class, template<class, class...> class> class B,
+          typename Key, typename OldValue, template<class, class...> class MapClass, typename Value>
+struct RebindBase<B<Key, OldValue, MapClass>, Value> {
+    using type = B<Key, Value, MapClass>;
+};
+
+template <template<class, class, class, class> class B,
+          typename Key, typename OldValue, typename Hash, typename KeyEqual, typename Value>
+struct RebindBase<B<Key, OldValue, Hash, KeyEqual>, Value> {
+    using type = B<Key, Value, Hash, KeyEqual>;
+};
+
+template <typename Base, typename Value>
+using RebindBaseT = typename RebindBase<Base, Value>::type;
+
+
+// LRU Cache parametrized class (use BaseVal or BaseUniqPtr). Listener, if given, is called as
+// listener(Key&&, Value&&, RemovalCause) with every element leaving the cache, from inside the
+// operation which removes it (it must not call the cache), see BatchedRemovalListener for a deferred mode.
+// Stats counts the hits, misses, insertions, evictions, updates and promotions (see CacheStats, TimedCacheStats),
+// the default NoStats records nothing.
+template <typename Base, typename Listener = NoRemovalListener, typename Stats = NoStats>
 class LRUCache : public Base {
+    template <typename> friend struct SnapshotIO;
+
+protected:
     using typename Base::Map;
     using typename Base::MapIter;
     using typename Base::Pair;
@@ -174,8 +320,9 @@ class LRUCache : public Base {
     using Base::getPrev;
     using Base::setNextTo;
     using Base::setPrevTo;
-    using Base::makeListNode;
-    using Base::clear;
+    using Base::emplaceListNode;
+    using Base::eraseListNode;
+    using Base::prefetchListNode;
     using Base::preAdd;
 
     using Base::max_size_;
@@ -183,6 +330,16 @@ class LRUCache : public Base {
     using Base::first_;
     using Base::last_;
 
+    Listener listener_;
+    Stats stats_;
+
+    // Passes a copy of the key and the value of it (moved out) to the listener
+    void notifyRemoval(MapIter it, RemovalCause cause) {
+        if constexpr (hasRemovalListener<Listener>) {
+            listener_(Key(it->first), std::move(val(it)), cause);
+        }
+    }
+
     void moveToFront(MapIter it) {
         assert((getPrev(it) == kv_.end()) == (it == first_));
         if (getPrev(it) != kv_.end()) {    
@@ -200,6 +357,14 @@ class LRUCache : public Base {
         } 
     }
 
+    // moveToFront() of an accessed element, counted as a promotion if it was not the first_ already
+    void promote(MapIter it) {
+        if (it != first_) {
+            stats_.recordPromotion();
+        }
+        moveToFront(it);
+    }
+
     void addToFront(MapIter it) {
         if (first_ == kv_.end()) {
             last_ = it; 
@@ -214,66 +379,396 @@ class LRUCache : public Base {
         }        
     }
 
+    void addToBack(MapIter it) {
+        setNextTo(it, kv_.end());
+        if (last_ == kv_.end()) {
+            first_ = it;
+            setPrevTo(it, kv_.end());
+        } else {
+            setNextTo(last_, it);
+            setPrevTo(it, last_);
+        }
+        last_ = it;
+    }
+
+    // Unlinks it from the list and erases it from the map
+    void removeNode(MapIter it, RemovalCause cause = RemovalCause::Explicit) {
+        if (cause == RemovalCause::Size) {
+            stats_.recordEviction();
+        }
+        notifyRemoval(it, cause);
+        MapIter prev = getPrev(it);
+        MapIter next = getNext(it);
+        if (prev != kv_.end()) {
+            setNextTo(prev, next);
+        } else {
+            first_ = next;
+        }
+        if (next != kv_.end()) {
+            setPrevTo(next, prev);
+        } else {
+            last_ = prev;
+        }
+        eraseListNode(it);
+    }
+
+    // Evicts a few of the elements above max_size_ left by setMaxSize(), so that the shrink is spread
+    // over the following operations
+    void trimStep() {
+        if (kv_.size() > max_size_) {
+            trim(kTrimStep);
+        }
+    }
+
+    // Inserts a missing key as the first_, reusing the node of the last_ when the cache is full
+    template <typename K, typename... Args>
+    void insertFront(K&& key, Args&&... args) {
+        stats_.recordInsertion();
+        trimStep();
+        if (kv_.size() >= max_size_) {
+            stats_.recordEviction();
+
+            // extract the last_
+            typename Map::node_type extracted = kv_.extract(last_);
+            if constexpr (hasRemovalListener<Listener>) {
+                listener_(std::move(extracted.key()), std::move(val(extracted)), RemovalCause::Size);
+            }
+            assignKey(extracted.key(), std::forward<K>(key));
+            assignValue(val(extracted), std::forward<Args>(args)...);
+            kv_.insert(std::move(extracted));
+
+            // insert as the first_
+            moveToFront(last_);
+
+            return;
+        }
+
+        preAdd();
+        addToFront(emplaceListNode(toKey<Key>(std::forward<K>(key)), std::forward<Args>(args)...));
+    }
+
 public:
-    explicit LRUCache(size_t max_size) :
-        Base(max_size)
+    using typename Base::TKey;
+    using typename Base::TValue;
+
+    // Number of keys getMany() and addMany() prefetch together
+    static constexpr size_t kBatchGroup = 16;
+    // Number of elements an operation evicts at most while the cache is above a reduced maxSize()
+    static constexpr size_t kTrimStep = 4;
+
+    // The extra arguments are passed to Base, e.g. the allocator (or the std::pmr::memory_resource)
+    template <typename... Args>
+    explicit LRUCache(size_t max_size, Args&&... args) :
+        Base(max_size, std::forward<Args>(args)...)
     {
 
     }
 
-    bool add(const Key& key, const Value& value) {
+    // K is Key or any type the map compares with Key (see isHeterogeneousLookup),
+    // a Key is constructed from it (or moved) only when a new element is inserted
+    template <typename K>
+    bool add(K&& key, const Value& value) {
+        return emplace(std::forward<K>(key), value);
+    }
+
+    template <typename K>
+    bool add(K&& key, Value&& value) {
+        return emplace(std::forward<K>(key), std::move(value));
+    }
+
+    // Like add() with the value constructed from args: in place in a newly allocated node, otherwise
+    // (an existing key or a reused evicted element) assigned from args when it is a single assignable argument
+    template <typename K, typename... Args>
+    bool emplace(K&& key, Args&&... args) {
+        [[maybe_unused]] auto timing = stats_.timeAdd();
         assert((kv_.size() > 0) == (first_ != kv_.end()));
         assert((last_ == kv_.end()) == (first_ == kv_.end()));
-                                                
-        auto it = kv_.find(key);
-       
+
+        auto it = findKey(kv_, key);
         if (it == kv_.end()) {
-            if (kv_.size() == max_size_) {
-
-                // extract the last_
-                typename Map::node_type extracted = kv_.extract(last_);
-                extracted.key() = key;
-                val(extracted) = value; 
-                kv_.insert(std::move(extracted));
-                // insert as the first_
-                
-                moveToFront(last_);
-                               
-                return false;
-            }
+            insertFront(std::forward<K>(key), std::forward<Args>(args)...);
+            return false;
+        }
 
-            preAdd();
-            typename Map::value_type v{makeListNode(key, value)};
-            auto [it, is_inserted] = kv_.insert(std::move(v));
-                           
-            addToFront(it);
+        stats_.recordUpdate();
+        notifyRemoval(it, RemovalCause::Replaced);
+        assignValue(val(it), std::forward<Args>(args)...);
+        promote(it);
 
-            return false;
+        return true;
+    }
 
-        } 
+    // Inserts the value constructed from args only if the key is missing, an existing element is just promoted
+    // and args are left untouched (nothing is moved from them). Returns true if the element was inserted.
+    template <typename K, typename... Args>
+    bool tryEmplace(K&& key, Args&&... args) {
+        assert((kv_.size() > 0) == (first_ != kv_.end()));
+        assert((last_ == kv_.end()) == (first_ == kv_.end()));
 
-        val(it) = value; 
-        moveToFront(it);
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            insertFront(std::forward<K>(key), std::forward<Args>(args)...);
+            return true;
+        }
 
-        return true;
+        promote(it);
+
+        return false;
     }
 
-    std::optional<Value> get(const Key& key) {
+    template <typename K>
+    std::optional<Value> get(const K& key) {
+        [[maybe_unused]] auto timing = stats_.timeGet();
         assert((kv_.size() > 0) == (first_ != kv_.end()));
         assert((last_ == kv_.end()) == (first_ == kv_.end()));        
 
-        auto it = kv_.find(key);
+        trimStep();
+        stats_.recordAccess(key);
+        auto it = findKey(kv_, key);
         if (it == kv_.end()) {
+            stats_.recordMiss();
             return {};
         }
-        moveToFront(it);
+        stats_.recordHit();
+        promote(it);
 
        return val(it); 
     }
 
+    // Does not change the LRU order
+    template <typename K>
+    bool contains(const K& key) const {
+        return findKey(kv_, key) != kv_.end();
+    }
+
+    // Like get() but does not change the LRU order
+    template <typename K>
+    std::optional<Value> peek(const K& key) const {
+        // find() does not modify the map, the non-const overload gives the MapIter val() takes
+        auto it = findKey(const_cast<Map&>(kv_), key);
+        if (it == kv_.end()) {
+            return {};
+        }
+        return val(it);
+    }
+
+    // Promotes the element like get() and returns a pointer to the stored value (nullptr if missing).
+    // The pointer stays valid until the element is evicted (an add() of a new key into a full cache reuses
+    // the storage of the least recently used element for the new one) or clear() is called.
+    // add() of the same key assigns the value in place, so the pointer then refers to the new value.
+    template <typename K>
+    Value* getPtr(const K& key) {
+        trimStep();
+        stats_.recordAccess(key);
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            stats_.recordMiss();
+            return nullptr;
+        }
+        stats_.recordHit();
+        promote(it);
+        return &val(it);
+    }
+
+    // Reference version of getPtr(), the same invalidation rules apply
+    template <typename K>
+    std::optional<std::reference_wrapper<Value>> getRef(const K& key) {
+        Value* value = getPtr(key);
+        if (!value) {
+            return {};
+        }
+        return std::ref(*value);
+    }
+
+    // Promotes the element like get() and calls fn(value) on the stored value in place, without copying it.
+    // Returns false if the key is missing. fn must not modify the cache.
+    template <typename K, typename F>
+    bool visit(const K& key, F&& fn) {
+        Value* value = getPtr(key);
+        if (!value) {
+            return false;
+        }
+        std::forward<F>(fn)(*value);
+        return true;
+    }
+
+    // Batch get(): looks keys[0..count) up into values[0..count) (empty for a miss), returns the number of hits.
+    // The keys are processed in groups of kBatchGroup so that their cache misses overlap: the buckets of
+    // the group are prefetched (FlatMap, SwissMap), then the keys are found and their list nodes prefetched,
+    // then the hits are promoted in the order of keys, as by get() in a loop.
+    template <typename K>
+    size_t getMany(const K* keys, size_t count, std::optional<Value>* values) {
+        MapIter its[kBatchGroup];
+        size_t hits = 0;
+        for (size_t start = 0; start < count; start += kBatchGroup) {
+            size_t n = std::min(kBatchGroup, count - start);
+            for (size_t i = 0; i < n; ++i) {
+                prefetchKey(kv_, keys[start + i]);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                stats_.recordAccess(keys[start + i]);
+                its[i] = findKey(kv_, keys[start + i]);
+                if (its[i] != kv_.end()) {
+                    prefetchListNode(its[i]);
+                }
+            }
+            for (size_t i = 0; i < n; ++i) {
+                if (its[i] == kv_.end()) {
+                    stats_.recordMiss();
+                    values[start + i].reset();
+                    continue;
+                }
+                stats_.recordHit();
+                promote(its[i]);
+                values[start + i] = val(its[i]);
+                ++hits;
+            }
+        }
+        return hits;
+    }
+
+    // Batch add() of keys[i], values[i] for i in 0..count, returns the number of keys which existed.
+    // The lookups are prefetched by groups like getMany(), the elements are then added one by one
+    // (an insertion may evict any element found before it, so the iterators can't be kept).
+    template <typename K>
+    size_t addMany(const K* keys, size_t count, const Value* values) {
+        size_t existed = 0;
+        for (size_t start = 0; start < count; start += kBatchGroup) {
+            size_t n = std::min(kBatchGroup, count - start);
+            for (size_t i = 0; i < n; ++i) {
+                prefetchKey(kv_, keys[start + i]);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                auto it = findKey(kv_, keys[start + i]);
+                if (it != kv_.end()) {
+                    prefetchListNode(it);
+                }
+            }
+            for (size_t i = 0; i < n; ++i) {
+                existed += emplace(keys[start + i], values[start + i]) ? 1 : 0;
+            }
+        }
+        return existed;
+    }
+
+    // Removes the element (RemovalCause::Explicit for the listener), returns false if the key is missing
+    template <typename K>
+    bool erase(const K& key) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return false;
+        }
+        removeNode(it, RemovalCause::Explicit);
+        return true;
+    }
+
+    // Removes every element for which pred(key, value) is true (RemovalCause::Explicit) in one pass over the list,
+    // e.g. all the keys of a tenant. Returns the number removed. pred must not modify the cache.
+    template <typename Pred>
+    size_t invalidateIf(Pred&& pred) {
+        size_t removed = 0;
+        for (auto it = first_; it != kv_.end();) {
+            MapIter next = getNext(it);
+            if (pred(static_cast<const Key&>(it->first), static_cast<const Value&>(val(it)))) {
+                removeNode(it, RemovalCause::Explicit);
+                ++removed;
+            }
+            it = next;
+        }
+        return removed;
+    }
+
+    // Ordered maps only (std::map, std::pmr::map): removes up to max_steps elements with the keys in [from, to),
+    // in key order, without visiting the others. Returns the number removed. A call resumes where the previous
+    // one stopped (the removed keys are gone), so a large range can be invalidated a slice at a time.
+    template <typename K1, typename K2>
+    size_t eraseRange(const K1& from, const K2& to, size_t max_steps = std::numeric_limits<size_t>::max()) {
+        static_assert(IsOrderedMap<Map>::value, "eraseRange() needs an ordered map, e.g. std::map");
+        auto it = lowerBoundKey(kv_, from);
+        auto end = lowerBoundKey(kv_, to);
+        // nothing at or after from, or from after to (then end comes before it)
+        if (it == kv_.end() || (end != kv_.end() && kv_.key_comp()(end->first, it->first))) {
+            return 0;
+        }
+        size_t removed = 0;
+        while (it != end && removed < max_steps) {
+            removeNode(it++, RemovalCause::Explicit);
+            ++removed;
+        }
+        return removed;
+    }
+
+    // eraseRange() of the string keys starting with prefix (a Key, std::basic_string_view or character pointer)
+    template <typename K>
+    size_t erasePrefix(const K& prefix, size_t max_steps = std::numeric_limits<size_t>::max()) {
+        static_assert(IsOrderedMap<Map>::value, "erasePrefix() needs an ordered map, e.g. std::map");
+        std::basic_string_view<typename Key::value_type, typename Key::traits_type> p(prefix);
+        size_t removed = 0;
+        auto it = lowerBoundKey(kv_, prefix);
+        while (it != kv_.end() && removed < max_steps && it->first.compare(0, p.size(), p) == 0) {
+            removeNode(it++, RemovalCause::Explicit);
+            ++removed;
+        }
+        return removed;
+    }
+
+    // The listener sees every element removed, with RemovalCause::Explicit
+    void clear() {
+        if constexpr (hasRemovalListener<Listener>) {
+            for (auto it = first_; it != kv_.end(); it = getNext(it)) {
+                notifyRemoval(it, RemovalCause::Explicit);
+            }
+        }
+        Base::clear();
+    }
+
+    Listener& removalListener() { return listener_; }
+
+    // Requires a Stats policy other than NoStats
+    StatsSnapshot stats() const { return stats_.snapshot(); }
+    void resetStats() { stats_.reset(); }
+    // Gives access to the extra queries of a policy (MissRatioCurveStats) or to replace it, e.g. to configure it
+    Stats& statsPolicy() { return stats_; }
+    const Stats& statsPolicy() const { return stats_; }
+
     size_t size() const { return kv_.size(); }
     size_t maxSize() const { return max_size_; }
 
+    // Changes the capacity (at least 1) keeping the elements. Growing reserves the map (and the list storage)
+    // once, the iterators and the pointers returned by getPtr() stay valid except with BaseFlat, whose slot
+    // array is moved. Shrinking evicts nothing at once: while size() is above maxSize(), add(), get() and
+    // getPtr() evict up to kTrimStep of the least recently used elements each (RemovalCause::Size), and an
+    // insertion reuses the last one, so size() never grows; trim() evicts the excess at once.
+    void setMaxSize(size_t max_size) {
+        max_size = std::max<size_t>(max_size, 1);
+        if (max_size > max_size_) {
+            Base::reserve(max_size);
+        }
+        max_size_ = max_size;
+    }
+
+    // Evicts up to max_steps least recently used elements above maxSize(), returns the number evicted
+    size_t trim(size_t max_steps = std::numeric_limits<size_t>::max()) {
+        size_t evicted = 0;
+        while (kv_.size() > max_size_ && evicted < max_steps) {
+            removeNode(last_, RemovalCause::Size);
+            ++evicted;
+        }
+        return evicted;
+    }
+
+    // Writes the elements in MRU order into a versioned, checksummed binary file (include lrucache_snapshot.h,
+    // the Key and Value need a SnapshotSerializer). Returns false if the file could not be written.
+    bool saveSnapshot(const std::string& path) const {
+        return SnapshotIO<LRUCache>::save(*this, path);
+    }
+
+    // Replaces the elements by the first maxSize() ones of a snapshot, in the same order, without touching
+    // the statistics. Returns false, leaving the cache empty, if the file is missing, corrupted or of another version.
+    bool loadSnapshot(const std::string& path) {
+        return SnapshotIO<LRUCache>::load(*this, path);
+    }
+
     std::vector<Key> getMRUKeys(size_t n) const {
         std::vector<Key> v;
         v.reserve(std::min(n, kv_.size()));
@@ -0,0 +1,135 @@
+#ifndef LRUCACHE_2Q_H
+#define LRUCACHE_2Q_H
+
+#include <vector>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+#include "lrucache.h"
+#include "lrucache_segment.h"
+
+namespace lrucache {
+
+// 2Q cache (use BaseVal, BaseUniqPtr or BaseFlat): new keys enter the A1in FIFO, which isn't reordered by the hits.
+// The keys evicted from A1in are remembered in the A1out GhostList (half the capacity, hashes only) and a key found
+// there is inserted into the Am LRU, which keeps the keys used again after a while. A1in is evicted first while it
+// holds more than a quarter of the capacity.
+template <typename Base, typename Hash = std::hash<typename LRUCache<Base>::TKey>>
+class TwoQCache {
+public:
+    using TKey = typename LRUCache<Base>::TKey;
+    using TValue = typename LRUCache<Base>::TValue;
+
+private:
+    using Key = TKey;
+    using Value = TValue;
+    using Pair = std::pair<Key, Value>;
+    using Segment = LRUSegment<Base>;
+
+    size_t max_size_;
+    size_t in_size_;
+    Segment a1in_;
+    Segment am_;
+    GhostList<Key, Hash> a1out_;
+
+    void reclaim() {
+        if (a1in_.size() > in_size_ || am_.empty()) {
+            a1out_.add(a1in_.popLru().first);
+        } else {
+            am_.popLru();
+        }
+    }
+
+    template <typename K, typename V>
+    bool put(K&& key, V&& value) {
+        if (am_.contains(key)) {
+            return am_.add(std::forward<K>(key), std::forward<V>(value));
+        }
+        if (a1in_.assign(key, std::forward<V>(value))) {
+            return true;
+        }
+        bool ghost = a1out_.remove(key);
+        if (size() >= max_size_) {
+            reclaim();
+        }
+        if (ghost) {
+            am_.add(std::forward<K>(key), std::forward<V>(value));
+        } else {
+            a1in_.add(std::forward<K>(key), std::forward<V>(value));
+        }
+        return false;
+    }
+
+public:
+    explicit TwoQCache(size_t max_size)
+        : max_size_(max_size)
+        , in_size_(std::max<size_t>(max_size / 4, 1))
+        , a1in_(max_size)
+        , am_(max_size)
+        , a1out_(std::max<size_t>(max_size / 2, 1))
+    {
+
+    }
+
+    bool add(const Key& key, const Value& value) {
+        return put(key, value);
+    }
+
+    bool add(Key&& key, Value&& value) {
+        return put(std::move(key), std::move(value));
+    }
+
+    // A hit in A1in doesn't move the element
+    std::optional<Value> get(const Key& key) {
+        if (auto value = am_.get(key)) {
+            return value;
+        }
+        return a1in_.peek(key);
+    }
+
+    bool contains(const Key& key) const {
+        return am_.contains(key) || a1in_.contains(key);
+    }
+
+    std::optional<Value> peek(const Key& key) const {
+        if (auto value = am_.peek(key)) {
+            return value;
+        }
+        return a1in_.peek(key);
+    }
+
+    // Also forgets the ghost keys
+    void clear() {
+        a1in_.clear();
+        am_.clear();
+        a1out_.clear();
+    }
+
+    size_t size() const { return a1in_.size() + am_.size(); }
+    size_t maxSize() const { return max_size_; }
+
+    // Approximate order: the Am elements precede the A1in ones
+    std::vector<Key> getMRUKeys(size_t n) const {
+        std::vector<Key> v = am_.getMRUKeys(n);
+        for (auto& key : a1in_.getMRUKeys(n - v.size())) {
+            v.push_back(std::move(key));
+        }
+        return v;
+    }
+
+    // Approximate order: the Am elements precede the A1in ones
+    std::vector<Pair> getMRU(size_t n) const {
+        std::vector<Pair> v = am_.getMRU(n);
+        for (auto& pair : a1in_.getMRU(n - v.size())) {
+            v.push_back(std::move(pair));
+        }
+        return v;
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
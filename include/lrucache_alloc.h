@@ -0,0 +1,170 @@
+#ifndef LRUCACHE_ALLOC_H
+#define LRUCACHE_ALLOC_H
+
+#include <memory>
+#include <memory_resource>
+#include <functional>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace lrucache {
+
+// The allocator of MapClass (std::allocator unless a pmr or custom allocator map template is passed) rebound to T
+template <typename Key, template<class, class...> class MapClass, typename T>
+using MapAllocFor = typename std::allocator_traits<
+    typename MapClass<Key, void*>::allocator_type>::template rebind_alloc<T>;
+
+// unique_ptr deleter returning the object to the allocator it came from, empty for stateless allocators
+template <typename Alloc>
+struct AllocDeleter : private Alloc {
+    using pointer = typename std::allocator_traits<Alloc>::pointer;
+
+    AllocDeleter() = default;
+    explicit AllocDeleter(const Alloc& alloc) : Alloc(alloc) {}
+
+    void operator()(pointer p) {
+        Alloc& alloc = *this;
+        std::allocator_traits<Alloc>::destroy(alloc, p);
+        std::allocator_traits<Alloc>::deallocate(alloc, p, 1);
+    }
+};
+
+// Allocates an object with alloc and constructs it in place from args
+template <typename Alloc, typename... Args>
+std::unique_ptr<typename std::allocator_traits<Alloc>::value_type, AllocDeleter<Alloc>> allocateUnique(Alloc alloc, Args&&... args) {
+    using Traits = std::allocator_traits<Alloc>;
+    using T = typename Traits::value_type;
+    T* p = Traits::allocate(alloc, 1);
+    try {
+        Traits::construct(alloc, p, std::forward<Args>(args)...);
+    } catch (...) {
+        Traits::deallocate(alloc, p, 1);
+        throw;
+    }
+    return std::unique_ptr<T, AllocDeleter<Alloc>>(p, AllocDeleter<Alloc>(alloc));
+}
+
+// Reserves the buckets of the hash maps up front, no-op for the tree based maps
+template <typename Map>
+auto reserveMap(Map& map, size_t n) -> decltype(map.reserve(n), void()) {
+    map.reserve(n);
+}
+
+template <typename Map>
+void reserveMap(Map&, ...) {
+
+}
+
+// Upper estimate of the pool memory for one node of a node based map holding ValueType
+// (a tree node has three pointers and a color, a hash node a pointer and the cached hash) and its bucket share
+template <typename ValueType>
+constexpr size_t mapNodePoolBytes() {
+    return (sizeof(ValueType) + 4 * sizeof(void*) + 15) / 16 * 16 + 2 * (sizeof(void*) + 1);
+}
+
+// Fixed capacity memory resource for the map nodes, list nodes, buckets and iters_ of a cache.
+// The whole arena is taken from the upstream resource by the constructor, the freed blocks are kept
+// in free lists by size, so a cache refilled after clear() reuses them without any upstream allocation.
+// Allocations which don't fit in the arena fall back to the upstream resource. Not thread safe.
+class NodePool : public std::pmr::memory_resource {
+public:
+    explicit NodePool(size_t bytes, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : upstream_(upstream)
+        , capacity_(roundUp(bytes))
+        , arena_(static_cast<std::byte*>(upstream->allocate(capacity_, kAlign)))
+    {
+
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    ~NodePool() override {
+        upstream_->deallocate(arena_, capacity_, kAlign);
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // Bytes of the arena handed out so far (including the blocks sitting in the free lists)
+    size_t used() const { return offset_; }
+
+    // Number of allocations which did not fit in the arena
+    size_t upstreamAllocations() const { return upstream_allocations_; }
+
+private:
+    static constexpr size_t kAlign = alignof(std::max_align_t);
+    static constexpr size_t kSmallClasses = 32;
+
+    struct FreeBlock {
+        FreeBlock* next_;
+        size_t size_;
+    };
+
+    static_assert(sizeof(FreeBlock) <= kAlign, "free block header must fit in the smallest block");
+
+    std::pmr::memory_resource* upstream_;
+    size_t capacity_;
+    std::byte* arena_;
+    size_t offset_{0};
+    size_t upstream_allocations_{0};
+    FreeBlock* small_[kSmallClasses]{};
+    FreeBlock* large_{nullptr};
+
+    static size_t roundUp(size_t bytes) {
+        return bytes == 0 ? kAlign : (bytes + kAlign - 1) / kAlign * kAlign;
+    }
+
+    // std::less gives a total order over the pointers to different objects, the raw operators don't
+    bool inArena(void* p) const {
+        std::less<const void*> less;
+        return !less(p, arena_) && less(p, arena_ + capacity_);
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        size_t size = roundUp(bytes);
+        if (alignment <= kAlign) {
+            if (size <= kSmallClasses * kAlign) {
+                FreeBlock*& head = small_[size / kAlign - 1];
+                if (head) {
+                    return std::exchange(head, head->next_);
+                }
+            } else {
+                for (FreeBlock** block = &large_; *block; block = &(*block)->next_) {
+                    if ((*block)->size_ == size) {
+                        return std::exchange(*block, (*block)->next_);
+                    }
+                }
+            }
+            if (capacity_ - offset_ >= size) {
+                return arena_ + std::exchange(offset_, offset_ + size);
+            }
+        }
+        ++upstream_allocations_;
+        return upstream_->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (!inArena(p)) {
+            upstream_->deallocate(p, bytes, alignment);
+            return;
+        }
+        size_t size = roundUp(bytes);
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->size_ = size;
+        if (size <= kSmallClasses * kAlign) {
+            block->next_ = std::exchange(small_[size / kAlign - 1], block);
+        } else {
+            block->next_ = std::exchange(large_, block);
+        }
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
@@ -6,21 +6,54 @@
 #include <unordered_map>
 #include <vector>
 #include <optional>
+#include <functional>
 #include <cassert>
 
+#include "lrucache_alloc.h"
+#include "lrucache_lookup.h"
+#include "lrucache_stats.h"
+
 namespace lrucache {
 
+template <typename Key, typename Value, template<class, class...> class MapClass>
+struct ListNodeNP;
+
+// The list nodes come from the allocator of MapClass, e.g. std::pmr::unordered_map
+template <typename Key, typename Value, template<class, class...> class MapClass>
+using ListNodeNPPtr = std::unique_ptr<
+    ListNodeNP<Key, Value, MapClass>, 
+    AllocDeleter<MapAllocFor<Key, MapClass, ListNodeNP<Key, Value, MapClass>>>>;
+
 template <typename Key, typename Value, template<class, class...> class MapClass>
 struct ListNodeNP {
-    typename MapClass<Key, std::unique_ptr<ListNodeNP>>::iterator next_;
-    typename MapClass<Key, std::unique_ptr<ListNodeNP>>::iterator prev_;
+    using Iter = typename MapClass<Key, ListNodeNPPtr<Key, Value, MapClass>>::iterator;
+
+    Iter next_;
+    Iter prev_;
     Value value_;
+
+    template <typename... Args>
+    ListNodeNP(Iter next, Iter prev, Args&&... args)
+        : next_(next)
+        , prev_(prev)
+        , value_(std::forward<Args>(args)...)
+    {
+
+    }
 };
 
 template <typename Value>
 struct ListNodeI {
     size_t start_index_;
     Value value_;
+
+    template <typename... Args>
+    explicit ListNodeI(size_t start_index, Args&&... args)
+        : start_index_(start_index)
+        , value_(std::forward<Args>(args)...)
+    {
+
+    }
 };
 
 template <
@@ -29,7 +62,8 @@ template <
     template<class, class...> class MapClass, 
     typename ListNode, 
     typename MapStruct, 
-    typename Impl>
+    typename Impl,
+    typename Stats = NoStats>
 class BaseLRUCache {
 protected:
     using Map = MapStruct;
@@ -37,7 +71,12 @@ protected:
     using Pair = std::pair<Key, Value>;
     using NodeType = typename Map::node_type;
 
-    explicit BaseLRUCache(size_t max_size) : max_size_(max_size) {}
+    explicit BaseLRUCache(size_t max_size, const typename Map::allocator_type& alloc) 
+        : max_size_(max_size)
+        , kv_(alloc) 
+    {
+        reserveMap(kv_, max_size);
+    }
 
     Impl* impl() { return static_cast<Impl*>(this); }
     const Impl* impl() const { return static_cast<const Impl*>(this); }
@@ -52,7 +91,19 @@ protected:
     MapIter getPrev(MapIter it) const { return impl()->getPrev(it); }
     MapIter setNextTo(MapIter it, MapIter target) { return impl()->setNextTo(it, target); }
     MapIter setPrevTo(MapIter it, MapIter target) { return impl()->setPrevTo(it, target); }
-    typename Map::value_type makeListNode(const Key& key, const Value& value) { return impl()->makeListNode(key, value); };
+    void prefetchListNode(MapIter it) const { impl()->prefetchListNode(it); }
+    template <typename K, typename... Args>
+    MapIter emplaceListNode(K&& key, Args&&... args) {
+        return impl()->emplaceListNode(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    // See LRUCache::promote()
+    void promote(MapIter it) {
+        if (it != first_) {
+            stats_.recordPromotion();
+        }
+        moveToFront(it);
+    }
 
     void addToFront(MapIter it) {
         if (first_ == kv_.end()) {
@@ -68,6 +119,29 @@ protected:
         }        
     }
 
+    // Inserts a missing key as the first_, reusing the node of the last_ when the cache is full
+    template <typename K, typename... Args>
+    void insertFront(K&& key, Args&&... args) {
+        stats_.recordInsertion();
+        if (kv_.size() == max_size_) {
+            stats_.recordEviction();
+
+            // extract the last_
+            typename Map::node_type extracted = kv_.extract(last_);
+            assignKey(extracted.key(), std::forward<K>(key));
+            assignValue(val(extracted), std::forward<Args>(args)...);
+            kv_.insert(std::move(extracted));
+
+            // insert as the first_
+            moveToFront(last_);
+
+            return;
+        }
+
+        preAdd();
+        addToFront(emplaceListNode(toKey<Key>(std::forward<K>(key)), std::forward<Args>(args)...));
+    }
+
     void moveToFront(MapIter it) {
         assert((getPrev(it) == kv_.end()) == (it == first_));
         if (getPrev(it) != kv_.end()) {    
@@ -85,57 +159,197 @@ protected:
         } 
     }
 
-    bool add(const Key& key, const Value& value) {
+    // K is Key or any type the map compares with Key (see isHeterogeneousLookup),
+    // a Key is constructed from it (or moved) only when a new element is inserted
+    template <typename K>
+    bool add(K&& key, const Value& value) {
+        return emplace(std::forward<K>(key), value);
+    }
+
+    template <typename K>
+    bool add(K&& key, Value&& value) {
+        return emplace(std::forward<K>(key), std::move(value));
+    }
+
+    // Like add() with the value constructed from args: in place in a newly allocated node, otherwise
+    // (an existing key or a reused evicted element) assigned from args when it is a single assignable argument
+    template <typename K, typename... Args>
+    bool emplace(K&& key, Args&&... args) {
+        [[maybe_unused]] auto timing = stats_.timeAdd();
         assert((kv_.size() > 0) == (first_ != kv_.end()));
         assert((last_ == kv_.end()) == (first_ == kv_.end()));
-                                                
-        auto it = kv_.find(key);
-       
-        if (it == kv_.end()) {
-            if (kv_.size() == max_size_) {
-
-                // extract the last_
-                typename Map::node_type extracted = kv_.extract(last_);
-                extracted.key() = key;
-                val(extracted) = value; 
-                kv_.insert(std::move(extracted));
-
-                // insert as the first_
-                moveToFront(last_);
-                               
-                return false;
-            }
-
-            preAdd();
-            typename Map::value_type v{makeListNode(key, value)};
-            auto [it, is_inserted] = kv_.insert(std::move(v));
-            addToFront(it);
 
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            insertFront(std::forward<K>(key), std::forward<Args>(args)...);
             return false;
-        } 
+        }
 
-        val(it) = value; 
-        moveToFront(it);
+        stats_.recordUpdate();
+        assignValue(val(it), std::forward<Args>(args)...);
+        promote(it);
 
         return true;
     }
 
-    std::optional<Value> get(const Key& key) {
+    // Inserts the value constructed from args only if the key is missing, an existing element is just promoted
+    // and args are left untouched (nothing is moved from them). Returns true if the element was inserted.
+    template <typename K, typename... Args>
+    bool tryEmplace(K&& key, Args&&... args) {
+        assert((kv_.size() > 0) == (first_ != kv_.end()));
+        assert((last_ == kv_.end()) == (first_ == kv_.end()));
+
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            insertFront(std::forward<K>(key), std::forward<Args>(args)...);
+            return true;
+        }
+
+        promote(it);
+
+        return false;
+    }
+
+    template <typename K>
+    std::optional<Value> get(const K& key) {
+        [[maybe_unused]] auto timing = stats_.timeGet();
         assert((kv_.size() > 0) == (first_ != kv_.end()));
         assert((last_ == kv_.end()) == (first_ == kv_.end()));        
 
-        auto it = kv_.find(key);
+        stats_.recordAccess(key);
+        auto it = findKey(kv_, key);
         if (it == kv_.end()) {
+            stats_.recordMiss();
             return {};
         }
-        moveToFront(it);
+        stats_.recordHit();
+        promote(it);
 
        return val(it); 
     }
 
+    // Does not change the LRU order
+    template <typename K>
+    bool contains(const K& key) const {
+        return findKey(kv_, key) != kv_.end();
+    }
+
+    // Like get() but does not change the LRU order
+    template <typename K>
+    std::optional<Value> peek(const K& key) const {
+        // find() does not modify the map, the non-const overload gives the MapIter val() takes
+        auto it = findKey(const_cast<Map&>(kv_), key);
+        if (it == kv_.end()) {
+            return {};
+        }
+        return val(it);
+    }
+
+    // Promotes the element like get() and returns a pointer to the stored value (nullptr if missing).
+    // The pointer stays valid until the element is evicted (an add() of a new key into a full cache reuses
+    // the storage of the least recently used element for the new one) or clear() is called.
+    // add() of the same key assigns the value in place, so the pointer then refers to the new value.
+    template <typename K>
+    Value* getPtr(const K& key) {
+        stats_.recordAccess(key);
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            stats_.recordMiss();
+            return nullptr;
+        }
+        stats_.recordHit();
+        promote(it);
+        return &val(it);
+    }
+
+    // Reference version of getPtr(), the same invalidation rules apply
+    template <typename K>
+    std::optional<std::reference_wrapper<Value>> getRef(const K& key) {
+        Value* value = getPtr(key);
+        if (!value) {
+            return {};
+        }
+        return std::ref(*value);
+    }
+
+    // Promotes the element like get() and calls fn(value) on the stored value in place, without copying it.
+    // Returns false if the key is missing. fn must not modify the cache.
+    template <typename K, typename F>
+    bool visit(const K& key, F&& fn) {
+        Value* value = getPtr(key);
+        if (!value) {
+            return false;
+        }
+        std::forward<F>(fn)(*value);
+        return true;
+    }
+
+    static constexpr size_t kBatchGroup = 16;
+
+    // See LRUCache::getMany()
+    template <typename K>
+    size_t getMany(const K* keys, size_t count, std::optional<Value>* values) {
+        MapIter its[kBatchGroup];
+        size_t hits = 0;
+        for (size_t start = 0; start < count; start += kBatchGroup) {
+            size_t n = std::min(kBatchGroup, count - start);
+            for (size_t i = 0; i < n; ++i) {
+                prefetchKey(kv_, keys[start + i]);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                stats_.recordAccess(keys[start + i]);
+                its[i] = findKey(kv_, keys[start + i]);
+                if (its[i] != kv_.end()) {
+                    prefetchListNode(its[i]);
+                }
+            }
+            for (size_t i = 0; i < n; ++i) {
+                if (its[i] == kv_.end()) {
+                    stats_.recordMiss();
+                    values[start + i].reset();
+                    continue;
+                }
+                stats_.recordHit();
+                promote(its[i]);
+                values[start + i] = val(its[i]);
+                ++hits;
+            }
+        }
+        return hits;
+    }
+
+    // See LRUCache::addMany()
+    template <typename K>
+    size_t addMany(const K* keys, size_t count, const Value* values) {
+        size_t existed = 0;
+        for (size_t start = 0; start < count; start += kBatchGroup) {
+            size_t n = std::min(kBatchGroup, count - start);
+            for (size_t i = 0; i < n; ++i) {
+                prefetchKey(kv_, keys[start + i]);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                auto it = findKey(kv_, keys[start + i]);
+                if (it != kv_.end()) {
+                    prefetchListNode(it);
+                }
+            }
+            for (size_t i = 0; i < n; ++i) {
+                existed += emplace(keys[start + i], values[start + i]) ? 1 : 0;
+            }
+        }
+        return existed;
+    }
+
     size_t size() const { return kv_.size(); }
     size_t maxSize() const { return max_size_; }
 
+    // See LRUCache::stats()
+    StatsSnapshot stats() const { return stats_.snapshot(); }
+    void resetStats() { stats_.reset(); }
+    // Gives access to the extra queries of a policy (MissRatioCurveStats) or to replace it, e.g. to configure it
+    Stats& statsPolicy() { return stats_; }
+    const Stats& statsPolicy() const { return stats_; }
+
     std::vector<Key> getMRUKeys(size_t n) const {
         std::vector<Key> v;
         v.reserve(std::min(n, kv_.size()));
@@ -175,29 +389,29 @@ protected:
     Map kv_;
     MapIter first_{kv_.end()};
     MapIter last_{kv_.end()};
-
+    Stats stats_;
 
 };
 
 // LRU Cache using uniq_ptr to nodes containing iterators to represent a list
-template <typename Key, typename Value, template<class, class...> class MapClass>
+template <typename Key, typename Value, template<class, class...> class MapClass, typename Stats = NoStats>
 class LRUCacheUniqPtr : public BaseLRUCache<
     Key, 
     Value, 
     MapClass, 
     ListNodeNP<Key, Value, MapClass>, 
-    MapClass<Key, std::unique_ptr<ListNodeNP<Key, Value, MapClass>>>,
-    LRUCacheUniqPtr<Key, Value, MapClass>> {
+    MapClass<Key, ListNodeNPPtr<Key, Value, MapClass>>,
+    LRUCacheUniqPtr<Key, Value, MapClass, Stats>, Stats> {
 
     using ListNode = ListNodeNP<Key, Value, MapClass>;
     using Base = BaseLRUCache<
         Key, Value, MapClass, ListNode, 
-        MapClass<Key, std::unique_ptr<ListNodeNP<Key, Value, MapClass>>>, 
-        LRUCacheUniqPtr<Key, Value, MapClass>>;
+        MapClass<Key, ListNodeNPPtr<Key, Value, MapClass>>, 
+        LRUCacheUniqPtr<Key, Value, MapClass, Stats>, Stats>;
     friend class BaseLRUCache<
         Key, Value, MapClass, ListNode, 
-        MapClass<Key, std::unique_ptr<ListNodeNP<Key, Value, MapClass>>>, 
-        LRUCacheUniqPtr<Key, Value, MapClass>>;
+        MapClass<Key, ListNodeNPPtr<Key, Value, MapClass>>, 
+        LRUCacheUniqPtr<Key, Value, MapClass, Stats>, Stats>;
     
     using typename Base::Map;
     using typename Base::MapIter;
@@ -231,9 +445,16 @@ class LRUCacheUniqPtr : public BaseLRUCache<
         return it->second->prev_ = target; 
     }
 
-    typename Map::value_type makeListNode(const Key& key, const Value& value) {
-        std::unique_ptr<ListNode> p{new ListNode{kv_.end(), kv_.end(), value}};
-        return {key, std::move(p)};
+    void prefetchListNode(MapIter it) const {
+        prefetchAddress(it->second.get());
+    }
+
+    template <typename K, typename... Args>
+    MapIter emplaceListNode(K&& key, Args&&... args) {
+        using ListAlloc = MapAllocFor<Key, MapClass, ListNode>;
+        ListNodeNPPtr<Key, Value, MapClass> node{
+            allocateUnique(ListAlloc(kv_.get_allocator()), kv_.end(), kv_.end(), std::forward<Args>(args)...)};
+        return kv_.try_emplace(std::forward<K>(key), std::move(node)).first;
     }
 
     void preAdd() {
@@ -245,40 +466,61 @@ class LRUCacheUniqPtr : public BaseLRUCache<
     }
  
 public:
+    using TKey = Key;
+    using TValue = Value;
 
     using Base::clear;
     using Base::add;
+    using Base::emplace;
+    using Base::tryEmplace;
     using Base::size;
     using Base::maxSize;
     using Base::get;
+    using Base::contains;
+    using Base::peek;
+    using Base::getPtr;
+    using Base::getRef;
+    using Base::visit;
+    using Base::getMany;
+    using Base::addMany;
+    using Base::stats;
+    using Base::resetStats;
+    using Base::statsPolicy;
     using Base::getMRUKeys;
     using Base::getMRU;
 
-    explicit LRUCacheUniqPtr(size_t max_size) 
-        : Base(max_size)
+    using allocator_type = typename Map::allocator_type;
+
+    explicit LRUCacheUniqPtr(size_t max_size, const allocator_type& alloc = allocator_type()) 
+        : Base(max_size, alloc)
     {
 
     }
 
+    // Size of a NodePool holding a full cache
+    static size_t nodePoolBytes(size_t max_size) {
+        return 4096 + max_size * (mapNodePoolBytes<typename Map::value_type>() + (sizeof(ListNode) + 15) / 16 * 16);
+    }
+
 };
 
 
 // LRU Cache using a separate vector of iterators to represent the LRU list
-template <typename Key, typename Value, template<class, class...> class MapClass>
+template <typename Key, typename Value, template<class, class...> class MapClass, typename Stats = NoStats>
 class LRUCacheVal : public BaseLRUCache<
     Key, 
     Value, 
     MapClass, 
     ListNodeI<Value>, 
     MapClass<Key, ListNodeI<Value>>,
-    LRUCacheVal<Key, Value, MapClass>> {
+    LRUCacheVal<Key, Value, MapClass, Stats>, Stats> {
 
     using ListNode = ListNodeI<Value>;
     using Base = BaseLRUCache<
                     Key, Value, MapClass, ListNode, 
-                    MapClass<Key, ListNodeI<Value>>, LRUCacheVal<Key, Value, MapClass>>;
+                    MapClass<Key, ListNodeI<Value>>, LRUCacheVal<Key, Value, MapClass, Stats>, Stats>;
     friend class BaseLRUCache<Key, Value, MapClass, ListNode, 
-                    MapClass<Key, ListNodeI<Value>>, LRUCacheVal<Key, Value, MapClass>>;
+                    MapClass<Key, ListNodeI<Value>>, LRUCacheVal<Key, Value, MapClass, Stats>, Stats>;
     
     using typename Base::Map;
     using typename Base::MapIter;
@@ -312,8 +554,13 @@ class LRUCacheVal : public BaseLRUCache<
         return iters_[it->second.start_index_] = target; 
     }
 
-    typename Map::value_type makeListNode(const Key& key, const Value& value) {
-        return {key, ListNode{iters_.size() - 2, value}};
+    void prefetchListNode(MapIter it) const {
+        prefetchAddress(&iters_[it->second.start_index_]);
+    }
+
+    template <typename K, typename... Args>
+    MapIter emplaceListNode(K&& key, Args&&... args) {
+        return kv_.try_emplace(std::forward<K>(key), iters_.size() - 2, std::forward<Args>(args)...).first;
     }
 
     void clearImpl() {
@@ -325,22 +572,46 @@ class LRUCacheVal : public BaseLRUCache<
         iters_.push_back(kv_.end());
     }
  
-    std::vector<MapIter> iters_;
+    using IterAlloc = typename std::allocator_traits<typename Map::allocator_type>::template rebind_alloc<MapIter>;
+
+    std::vector<MapIter, IterAlloc> iters_;
 
 public:
+    using TKey = Key;
+    using TValue = Value;
 
     using Base::clear;
     using Base::add;
+    using Base::emplace;
+    using Base::tryEmplace;
     using Base::size;
     using Base::maxSize;
     using Base::get;
+    using Base::contains;
+    using Base::peek;
+    using Base::getPtr;
+    using Base::getRef;
+    using Base::visit;
+    using Base::getMany;
+    using Base::addMany;
+    using Base::stats;
+    using Base::resetStats;
+    using Base::statsPolicy;
     using Base::getMRUKeys;
     using Base::getMRU;
 
-    explicit LRUCacheVal(size_t max_size) 
-        : Base(max_size)
+    using allocator_type = typename Map::allocator_type;
+
+    explicit LRUCacheVal(size_t max_size, const allocator_type& alloc = allocator_type()) 
+        : Base(max_size, alloc)
+        , iters_(IterAlloc(alloc))
     {
+        iters_.reserve(max_size * 2);
+    }
 
+    // Size of a NodePool holding a full cache
+    static size_t nodePoolBytes(size_t max_size) {
+        return 4096 + max_size * (mapNodePoolBytes<typename Map::value_type>() + 2 * sizeof(MapIter));
     }
 
 };
@@ -0,0 +1,179 @@
+#ifndef LRUCACHE_ARC_H
+#define LRUCACHE_ARC_H
+
+#include <vector>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+#include "lrucache.h"
+#include "lrucache_segment.h"
+
+namespace lrucache {
+
+// Adaptive replacement cache (use BaseVal, BaseUniqPtr or BaseFlat): T1 holds the keys seen once recently, T2 the
+// keys seen at least twice. The keys evicted from them are remembered in the B1 and B2 GhostLists (hashes only,
+// at most the capacity each). A miss found in B1 grows the target size of T1, a miss found in B2 shrinks it,
+// and the victim is taken from T1 while T1 exceeds its target, otherwise from T2.
+// T1 and T2 may each hold the whole capacity, so both are allocated for it (twice the structures of an LRUCache
+// of the same size with BaseFlat or the reserved hash maps), plus the two ghost lists of hashes.
+template <typename Base, typename Hash = std::hash<typename LRUCache<Base>::TKey>>
+class ARCCache {
+public:
+    using TKey = typename LRUCache<Base>::TKey;
+    using TValue = typename LRUCache<Base>::TValue;
+
+private:
+    using Key = TKey;
+    using Value = TValue;
+    using Pair = std::pair<Key, Value>;
+    using Segment = LRUSegment<Base>;
+
+    size_t max_size_;
+    size_t target_{0};
+    Segment t1_;
+    Segment t2_;
+    GhostList<Key, Hash> b1_;
+    GhostList<Key, Hash> b2_;
+
+    // Evicts an element of a full cache into the matching ghost list
+    void replace(bool in_b2) {
+        if (size() < max_size_) {
+            return;
+        }
+        if (!t1_.empty() && (t1_.size() > target_ || (in_b2 && t1_.size() == target_) || t2_.empty())) {
+            b1_.add(t1_.popLru().first);
+        } else {
+            b2_.add(t2_.popLru().first);
+        }
+    }
+
+    // Makes room for a key found in none of the lists
+    void replaceForNew() {
+        size_t l1 = t1_.size() + b1_.size();
+        if (l1 >= max_size_) {
+            if (t1_.size() < max_size_) {
+                b1_.popLru();
+                replace(false);
+            } else {
+                t1_.popLru();
+            }
+        } else if (l1 + t2_.size() + b2_.size() >= max_size_) {
+            if (l1 + t2_.size() + b2_.size() >= 2 * max_size_ && !b2_.empty()) {
+                b2_.popLru();
+            }
+            replace(false);
+        }
+    }
+
+    template <typename K, typename V>
+    bool put(K&& key, V&& value) {
+        if (t2_.contains(key)) {
+            return t2_.add(std::forward<K>(key), std::forward<V>(value));
+        }
+        if (t1_.remove(key)) {
+            t2_.add(std::forward<K>(key), std::forward<V>(value));
+            return true;
+        }
+        if (b1_.contains(key)) {
+            target_ = std::min(max_size_, target_ + std::max<size_t>(b2_.size() / b1_.size(), 1));
+            b1_.remove(key);
+            replace(false);
+            t2_.add(std::forward<K>(key), std::forward<V>(value));
+            return false;
+        }
+        if (b2_.contains(key)) {
+            target_ -= std::min(target_, std::max<size_t>(b1_.size() / b2_.size(), 1));
+            b2_.remove(key);
+            replace(true);
+            t2_.add(std::forward<K>(key), std::forward<V>(value));
+            return false;
+        }
+        replaceForNew();
+        t1_.add(std::forward<K>(key), std::forward<V>(value));
+        return false;
+    }
+
+public:
+    explicit ARCCache(size_t max_size)
+        : max_size_(max_size)
+        , t1_(max_size)
+        , t2_(max_size)
+        , b1_(max_size)
+        , b2_(max_size)
+    {
+
+    }
+
+    bool add(const Key& key, const Value& value) {
+        return put(key, value);
+    }
+
+    bool add(Key&& key, Value&& value) {
+        return put(std::move(key), std::move(value));
+    }
+
+    // A hit moves the element to T2
+    std::optional<Value> get(const Key& key) {
+        if (auto value = t2_.get(key)) {
+            return value;
+        }
+        std::optional<Value> value = t1_.take(key);
+        if (!value) {
+            return {};
+        }
+        // the value is moved between the segments, the only copy is the one returned
+        t2_.add(key, std::move(*value));
+        return t2_.mruValue();
+    }
+
+    bool contains(const Key& key) const {
+        return t2_.contains(key) || t1_.contains(key);
+    }
+
+    std::optional<Value> peek(const Key& key) const {
+        if (auto value = t2_.peek(key)) {
+            return value;
+        }
+        return t1_.peek(key);
+    }
+
+    // Also forgets the ghost keys and the adaptation
+    void clear() {
+        t1_.clear();
+        t2_.clear();
+        b1_.clear();
+        b2_.clear();
+        target_ = 0;
+    }
+
+    size_t size() const { return t1_.size() + t2_.size(); }
+    size_t maxSize() const { return max_size_; }
+
+    // Current target size of T1 (0..maxSize())
+    size_t recencyTarget() const { return target_; }
+
+    // Approximate order: the T2 elements precede the T1 ones
+    std::vector<Key> getMRUKeys(size_t n) const {
+        std::vector<Key> v = t2_.getMRUKeys(n);
+        for (auto& key : t1_.getMRUKeys(n - v.size())) {
+            v.push_back(std::move(key));
+        }
+        return v;
+    }
+
+    // Approximate order: the T2 elements precede the T1 ones
+    std::vector<Pair> getMRU(size_t n) const {
+        std::vector<Pair> v = t2_.getMRU(n);
+        for (auto& pair : t1_.getMRU(n - v.size())) {
+            v.push_back(std::move(pair));
+        }
+        return v;
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef LRUCACHE_BUFFERED_H
+#define LRUCACHE_BUFFERED_H
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <cstdint>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// Thread safe LRU cache (use BaseVal or BaseUniqPtr) in which get() only takes a shared lock.
+// The hits are recorded into Stripes lock-free ring buffers of BufferSize iterators and the
+// promotions are replayed in batches under the exclusive lock: by every writer before it modifies
+// the cache and by the reader which fills up a buffer. Hits arriving at a full buffer are dropped,
+// so the LRU order is approximate under heavy read load. The removal listener is called under the exclusive
+// lock, except a BatchedRemovalListener: its removals are dispatched after the lock is released.
+// The readers update Stats concurrently, so it must be thread safe (NoStats, ConcurrentCacheStats,
+// TimedCacheStats<ConcurrentCacheStats<>>). The promotions are counted when they are replayed.
+template <
+    typename Base,
+    size_t Stripes = 16,
+    size_t BufferSize = 64,
+    typename Listener = NoRemovalListener,
+    typename Stats = NoStats>
+class BufferedLRUCache : protected LRUCache<Base, Listener, Stats> {
+    using Cache = LRUCache<Base, Listener, Stats>;
+    using typename Cache::MapIter;
+    using typename Cache::Pair;
+    using Key = typename Cache::TKey;
+    using Value = typename Cache::TValue;
+
+    using Cache::val;
+    using Cache::promote;
+    using Cache::kv_;
+    using Cache::listener_;
+    using Cache::stats_;
+
+    static_assert(Stripes > 0 && BufferSize > 0, "BufferedLRUCache needs a non empty read buffer");
+    static_assert(Stats::kThreadSafe, "BufferedLRUCache needs a thread safe Stats policy");
+
+    // Written concurrently by the readers holding the shared lock, drained under the exclusive lock.
+    // Every exclusive section drains before modifying the map, so the buffered iterators stay valid.
+    struct alignas(64) ReadBuffer {
+        std::atomic<uint32_t> count_{0};
+        std::array<MapIter, BufferSize> items_;
+
+        // Returns false if the buffer is full after this call (the hit may have been dropped)
+        bool record(MapIter it) {
+            if (count_.load(std::memory_order_relaxed) >= BufferSize) {
+                return false;
+            }
+            uint32_t index = count_.fetch_add(1, std::memory_order_relaxed);
+            if (index >= BufferSize) {
+                return false;
+            }
+            items_[index] = it;
+            return index + 1 < BufferSize;
+        }
+    };
+
+    mutable std::shared_mutex mutex_;
+    std::array<ReadBuffer, Stripes> buffers_;
+
+    static size_t stripeIndex() {
+        static thread_local size_t index = std::hash<std::thread::id>{}(std::this_thread::get_id()) % Stripes;
+        return index;
+    }
+
+    // Must be called with the exclusive lock held
+    void drainBuffers() {
+        for (auto& buffer : buffers_) {
+            uint32_t n = buffer.count_.load(std::memory_order_relaxed);
+            if (n == 0) {
+                continue;
+            }
+            n = std::min<uint32_t>(n, BufferSize);
+            for (uint32_t i = 0; i < n; ++i) {
+                promote(buffer.items_[i]);
+            }
+            buffer.count_.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Hands the removals queued by a batched listener over after releasing the exclusive lock
+    void unlockAndDispatch(std::unique_lock<std::shared_mutex>& lock) {
+        if constexpr (isBatchedRemovalListener<Listener>) {
+            auto batch = listener_.take();
+            lock.unlock();
+            listener_.dispatch(std::move(batch));
+        }
+    }
+
+    void tryDrainBuffers() {
+        std::unique_lock<std::shared_mutex> lock(mutex_, std::try_to_lock);
+        if (lock.owns_lock()) {
+            drainBuffers();
+        }
+    }
+
+public:
+    using typename Cache::TKey;
+    using typename Cache::TValue;
+
+    explicit BufferedLRUCache(size_t max_size)
+        : Cache(max_size)
+    {
+
+    }
+
+    bool add(const Key& key, const Value& value) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        bool existed = Cache::add(key, value);
+        unlockAndDispatch(lock);
+        return existed;
+    }
+
+    bool add(Key&& key, Value&& value) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        bool existed = Cache::add(std::move(key), std::move(value));
+        unlockAndDispatch(lock);
+        return existed;
+    }
+
+    // See LRUCache::emplace()
+    template <typename K, typename... Args>
+    bool emplace(K&& key, Args&&... args) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        bool existed = Cache::emplace(std::forward<K>(key), std::forward<Args>(args)...);
+        unlockAndDispatch(lock);
+        return existed;
+    }
+
+    // See LRUCache::tryEmplace()
+    template <typename K, typename... Args>
+    bool tryEmplace(K&& key, Args&&... args) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        bool inserted = Cache::tryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+        unlockAndDispatch(lock);
+        return inserted;
+    }
+
+    std::optional<Value> get(const Key& key) {
+        [[maybe_unused]] auto timing = stats_.timeGet();
+        std::optional<Value> result;
+        bool full = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto it = kv_.find(key);
+            if (it == kv_.end()) {
+                stats_.recordMiss();
+                return {};
+            }
+            stats_.recordHit();
+            result = val(it);
+            full = !buffers_[stripeIndex()].record(it);
+        }
+        if (full) {
+            tryDrainBuffers();
+        }
+        return result;
+    }
+
+    // Does not record a hit
+    std::optional<Value> peek(const Key& key) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return Cache::peek(key);
+    }
+
+    // Calls fn(value) on the stored value under the exclusive lock, see LRUCache::visit()
+    template <typename F>
+    bool visit(const Key& key, F&& fn) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        return Cache::visit(key, std::forward<F>(fn));
+    }
+
+    // See LRUCache::erase(), the buffers are drained first: they may hold the element
+    bool erase(const Key& key) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        bool erased = Cache::erase(key);
+        unlockAndDispatch(lock);
+        return erased;
+    }
+
+    // See LRUCache::invalidateIf(), pred is called under the exclusive lock
+    template <typename Pred>
+    size_t invalidateIf(Pred&& pred) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        size_t removed = Cache::invalidateIf(std::forward<Pred>(pred));
+        unlockAndDispatch(lock);
+        return removed;
+    }
+
+    // Applies all the pending promotions
+    void flush() {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+    }
+
+    void clear() {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (auto& buffer : buffers_) {
+            buffer.count_.store(0, std::memory_order_relaxed);
+        }
+        Cache::clear();
+        unlockAndDispatch(lock);
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return Cache::size();
+    }
+
+    size_t maxSize() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return Cache::maxSize();
+    }
+
+    // See LRUCache::setMaxSize(), the excess is evicted by the following writes (the reads are buffered)
+    void setMaxSize(size_t max_size) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        Cache::setMaxSize(max_size);
+    }
+
+    // Not synchronized, set the listener up before sharing the cache
+    using Cache::removalListener;
+
+    // The counters are read without the lock, see ConcurrentCacheStats::snapshot()
+    using Cache::stats;
+    using Cache::resetStats;
+
+    std::vector<Key> getMRUKeys(size_t n) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        return Cache::getMRUKeys(n);
+    }
+
+    std::vector<Pair> getMRU(size_t n) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        drainBuffers();
+        return Cache::getMRU(n);
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
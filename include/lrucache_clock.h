@@ -0,0 +1,231 @@
+#ifndef LRUCACHE_CLOCK_H
+#define LRUCACHE_CLOCK_H
+
+#include <vector>
+#include <initializer_list>
+#include <algorithm>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// CLOCK (second chance) cache: the elements occupy the slots of a circular array and a hit only sets the
+// reference byte of the slot, nothing is relinked. Inserting into a full cache sweeps the hand over the slots,
+// clearing the reference bytes, and replaces the first element which was not referenced since the previous sweep.
+// The hit ratio is close to LRU; getMRU() lists the referenced elements first, each group from the most recently
+// inserted slot backwards, which is an approximation of the recency order.
+template <typename Key, typename Value, template<class, class...> class MapClass>
+class ClockCache {
+public:
+    using TKey = Key;
+    using TValue = Value;
+
+private:
+    struct Node {
+        size_t slot_;
+        Value value_;
+
+        template <typename... Args>
+        explicit Node(size_t slot, Args&&... args)
+            : slot_(slot)
+            , value_(std::forward<Args>(args)...)
+        {
+
+        }
+    };
+
+    using Map = MapClass<Key, Node>;
+    using MapIter = typename Map::iterator;
+    using Pair = std::pair<Key, Value>;
+
+    size_t max_size_;
+    Map kv_;
+    std::vector<MapIter> slots_;
+    // separate from slots_ so that a sweep reads a dense array
+    std::vector<uint8_t> referenced_;
+    size_t hand_{0};
+
+    static Value& val(MapIter it) { return it->second.value_; }
+
+    void reference(MapIter it) {
+        referenced_[it->second.slot_] = 1;
+    }
+
+    // Advances the hand past the referenced slots, returns the victim slot
+    size_t sweep() {
+        while (referenced_[hand_]) {
+            referenced_[hand_] = 0;
+            hand_ = hand_ + 1 == slots_.size() ? 0 : hand_ + 1;
+        }
+        size_t victim = hand_;
+        hand_ = hand_ + 1 == slots_.size() ? 0 : hand_ + 1;
+        return victim;
+    }
+
+    // Inserts a missing key, reusing the node of the victim when the cache is full
+    template <typename K, typename... Args>
+    void insert(K&& key, Args&&... args) {
+        if (slots_.size() < max_size_) {
+            auto it = kv_.try_emplace(toKey<Key>(std::forward<K>(key)), slots_.size(), std::forward<Args>(args)...).first;
+            slots_.push_back(it);
+            referenced_.push_back(0);
+            return;
+        }
+        size_t slot = sweep();
+        typename Map::node_type extracted = kv_.extract(slots_[slot]);
+        assignKey(extracted.key(), std::forward<K>(key));
+        assignValue(extracted.mapped().value_, std::forward<Args>(args)...);
+        slots_[slot] = kv_.insert(std::move(extracted)).position;
+    }
+
+    // Calls fn(it) on up to n elements: the referenced ones, then the others, from the last inserted slot backwards
+    template <typename F>
+    void forEachMRU(size_t n, F&& fn) const {
+        size_t count = slots_.size();
+        for (uint8_t referenced : {1, 0}) {
+            for (size_t i = 0; i < count && n != 0; ++i) {
+                size_t slot = (hand_ + count - 1 - i) % count;
+                if (referenced_[slot] == referenced) {
+                    fn(slots_[slot]);
+                    --n;
+                }
+            }
+        }
+    }
+
+public:
+    explicit ClockCache(size_t max_size)
+        : max_size_(max_size)
+    {
+        reserveMap(kv_, max_size);
+        slots_.reserve(max_size);
+        referenced_.reserve(max_size);
+    }
+
+    // See LRUCache::add()
+    template <typename K>
+    bool add(K&& key, const Value& value) {
+        return emplace(std::forward<K>(key), value);
+    }
+
+    template <typename K>
+    bool add(K&& key, Value&& value) {
+        return emplace(std::forward<K>(key), std::move(value));
+    }
+
+    // See LRUCache::emplace()
+    template <typename K, typename... Args>
+    bool emplace(K&& key, Args&&... args) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            insert(std::forward<K>(key), std::forward<Args>(args)...);
+            return false;
+        }
+        assignValue(val(it), std::forward<Args>(args)...);
+        reference(it);
+        return true;
+    }
+
+    // See LRUCache::tryEmplace()
+    template <typename K, typename... Args>
+    bool tryEmplace(K&& key, Args&&... args) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            insert(std::forward<K>(key), std::forward<Args>(args)...);
+            return true;
+        }
+        reference(it);
+        return false;
+    }
+
+    template <typename K>
+    std::optional<Value> get(const K& key) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return {};
+        }
+        reference(it);
+        return val(it);
+    }
+
+    template <typename K>
+    bool contains(const K& key) const {
+        return findKey(kv_, key) != kv_.end();
+    }
+
+    // Like get() but does not set the reference byte
+    template <typename K>
+    std::optional<Value> peek(const K& key) const {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return {};
+        }
+        return it->second.value_;
+    }
+
+    // See LRUCache::getPtr(), the pointer stays valid until the element is evicted or clear() is called
+    template <typename K>
+    Value* getPtr(const K& key) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return nullptr;
+        }
+        reference(it);
+        return &val(it);
+    }
+
+    template <typename K>
+    std::optional<std::reference_wrapper<Value>> getRef(const K& key) {
+        Value* value = getPtr(key);
+        if (!value) {
+            return {};
+        }
+        return std::ref(*value);
+    }
+
+    // See LRUCache::visit()
+    template <typename K, typename F>
+    bool visit(const K& key, F&& fn) {
+        Value* value = getPtr(key);
+        if (!value) {
+            return false;
+        }
+        std::forward<F>(fn)(*value);
+        return true;
+    }
+
+    void clear() {
+        kv_.clear();
+        slots_.clear();
+        referenced_.clear();
+        hand_ = 0;
+    }
+
+    size_t size() const { return kv_.size(); }
+    size_t maxSize() const { return max_size_; }
+
+    // Approximate order, see the class comment
+    std::vector<Key> getMRUKeys(size_t n) const {
+        std::vector<Key> v;
+        v.reserve(std::min(n, kv_.size()));
+        forEachMRU(n, [&v](MapIter it) { v.push_back(it->first); });
+        return v;
+    }
+
+    // Approximate order, see the class comment
+    std::vector<Pair> getMRU(size_t n) const {
+        std::vector<Pair> v;
+        v.reserve(std::min(n, kv_.size()));
+        forEachMRU(n, [&v](MapIter it) { v.emplace_back(it->first, val(it)); });
+        return v;
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
@@ -0,0 +1,344 @@
+#ifndef LRUCACHE_CORO_H
+#define LRUCACHE_CORO_H
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "lrucache_coro.h needs C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <exception>
+#include <utility>
+#include <type_traits>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+template <typename T>
+class Task;
+
+namespace coro_detail {
+
+template <typename T>
+struct TaskPromise;
+
+template <typename Promise>
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    // Symmetric transfer to the awaiter, no stack growth along a chain of tasks
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+        auto continuation = h.promise().continuation_;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+};
+
+template <typename T>
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr error_;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter<TaskPromise<T>> final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { error_ = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase<T> {
+    std::optional<T> value_;
+
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& value) { value_.emplace(std::forward<U>(value)); }
+
+    T result() {
+        if (this->error_) {
+            std::rethrow_exception(this->error_);
+        }
+        return std::move(*value_);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase<void> {
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+};
+
+// Started at once and destroyed when it finishes, see syncWait()
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+} // namespace coro_detail
+
+// Lazy coroutine returning T: it starts when awaited and resumes its awaiter when it finishes.
+// An exception escaping the coroutine is rethrown by co_await.
+template <typename T = void>
+class [[nodiscard]] Task {
+public:
+    using promise_type = coro_detail::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle)
+        : handle_(handle)
+    {
+
+    }
+
+    Task(Task&& other) noexcept
+        : handle_(std::exchange(other.handle_, {}))
+    {
+
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle_.promise().continuation_ = awaiter;
+        return handle_;
+    }
+
+    T await_resume() { return handle_.promise().result(); }
+
+private:
+    Handle handle_;
+};
+
+namespace coro_detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+template <typename T>
+struct SyncState {
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+    bool done_{false};
+    std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> value_;
+    std::exception_ptr error_;
+};
+
+template <typename T>
+Detached runSync(Task<T>& task, SyncState<T>& state) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await task;
+            state.value_.emplace(true);
+        } else {
+            state.value_.emplace(co_await task);
+        }
+    } catch (...) {
+        state.error_ = std::current_exception();
+    }
+    // notified under the lock: syncWait() may destroy the state as soon as it is released
+    std::lock_guard<std::mutex> lock(state.mutex_);
+    state.done_ = true;
+    state.done_cv_.notify_one();
+}
+
+} // namespace coro_detail
+
+// Runs the task and blocks the calling thread until it finishes (where the task resumes is up to what it awaits)
+template <typename T>
+T syncWait(Task<T> task) {
+    coro_detail::SyncState<T> state;
+    coro_detail::runSync(task, state);
+    std::unique_lock<std::mutex> lock(state.mutex_);
+    state.done_cv_.wait(lock, [&state]() { return state.done_; });
+    if (state.error_) {
+        std::rethrow_exception(state.error_);
+    }
+    if constexpr (!std::is_void_v<T>) {
+        return std::move(*state.value_);
+    }
+}
+
+// Coroutine front end of a cache which is not thread safe (LRUCache, LRUCacheVal, LRUCacheUniqPtr...), guarded by
+// a mutex which is never held across a suspension. asyncGet(key, loader) returns the cached value or awaits
+// loader(key) (an awaitable of the value, e.g. a Task); the coroutines missing a key being loaded are parked
+// as handles on the load and resumed together when it completes, by the resume function given to the constructor
+// (by default inline, one after the other, on the thread which completed the load). The cache must outlive the tasks.
+template <typename Cache>
+class AsyncCache {
+    using Key = typename Cache::TKey;
+    using Value = typename Cache::TValue;
+
+    struct Flight {
+        std::vector<std::coroutine_handle<>> waiters_;
+        bool done_{false};
+        std::optional<Value> value_;
+        std::exception_ptr error_;
+    };
+
+    // Parks the awaiting coroutine on the flight unless the load already completed
+    struct FlightAwaiter {
+        AsyncCache& cache_;
+        std::shared_ptr<Flight> flight_;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> lock(cache_.mutex_);
+            if (flight_->done_) {
+                return false;
+            }
+            flight_->waiters_.push_back(handle);
+            return true;
+        }
+
+        Value await_resume() {
+            if (flight_->error_) {
+                std::rethrow_exception(flight_->error_);
+            }
+            return *flight_->value_;
+        }
+    };
+
+    Cache cache_;
+    std::mutex mutex_;
+    std::unordered_map<Key, std::shared_ptr<Flight>> flights_;
+    std::function<void(std::coroutine_handle<>)> resume_;
+
+public:
+    using TKey = Key;
+    using TValue = Value;
+
+    // resume(handle) resumes a waiting coroutine, e.g. by posting it to an executor
+    explicit AsyncCache(size_t max_size, std::function<void(std::coroutine_handle<>)> resume = {})
+        : cache_(max_size)
+        , resume_(std::move(resume))
+    {
+
+    }
+
+    template <typename Loader>
+    Task<Value> asyncGet(Key key, Loader loader) {
+        std::optional<Value> hit;
+        std::shared_ptr<Flight> flight;
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            hit = cache_.get(key);
+            if (!hit) {
+                auto [it, inserted] = flights_.try_emplace(key);
+                if (inserted) {
+                    it->second = std::make_shared<Flight>();
+                }
+                flight = it->second;
+                leader = inserted;
+            }
+        }
+        if (hit) {
+            co_return std::move(*hit);
+        }
+        if (!leader) {
+            // a named awaiter: GCC 12 may destroy a temporary one while the coroutine is suspended
+            FlightAwaiter awaiter{*this, flight};
+            co_return co_await awaiter;
+        }
+
+        std::optional<Value> value;
+        std::exception_ptr error;
+        try {
+            value.emplace(co_await loader(key));
+        } catch (...) {
+            error = std::current_exception();
+        }
+        std::vector<std::coroutine_handle<>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (value) {
+                cache_.add(key, *value);
+            }
+            flight->value_ = value;
+            flight->error_ = error;
+            flight->done_ = true;
+            waiters.swap(flight->waiters_);
+            flights_.erase(key);
+        }
+        for (auto handle : waiters) {
+            if (resume_) {
+                resume_(handle);
+            } else {
+                handle.resume();
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        co_return std::move(*value);
+    }
+
+    std::optional<Value> get(const Key& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.get(key);
+    }
+
+    bool add(const Key& key, const Value& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.add(key, value);
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.size();
+    }
+
+    size_t maxSize() const { return cache_.maxSize(); }
+
+    // The keys being loaded
+    size_t loadsInFlight() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return flights_.size();
+    }
+};
+
+} // namespace lrucache
+
+#endif
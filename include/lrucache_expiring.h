@@ -0,0 +1,456 @@
+#ifndef LRUCACHE_EXPIRING_H
+#define LRUCACHE_EXPIRING_H
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// Hierarchical timing wheel: kLevels wheels of kSlots buckets, a bucket of the level i covers kSlots^i ticks.
+// A timer is linked into the bucket of the lowest level whose range reaches its deadline; when the time passes
+// a bucket, its due timers fire and the others cascade down to the finer levels. Scheduling, cancelling and
+// firing a timer are O(1), advance() is amortized O(1) per timer plus O(kSlots) per level whose bucket changed.
+// Deadlines beyond kSlots^kLevels ticks are parked in the last level and cascaded until they come in range.
+template <typename Handle>
+class TimerWheel {
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    TimerWheel() {
+        buckets_.fill(npos);
+    }
+
+    uint64_t tick() const { return tick_; }
+
+    // Returns the timer id, deadlines not after tick() fire at the next advance()
+    uint32_t schedule(Handle handle, uint64_t deadline) {
+        uint32_t id = free_;
+        if (id != npos) {
+            free_ = timers_[id].next_;
+        } else {
+            id = static_cast<uint32_t>(timers_.size());
+            timers_.emplace_back();
+        }
+        timers_[id].handle_ = handle;
+        timers_[id].deadline_ = deadline;
+        link(id);
+        return id;
+    }
+
+    void cancel(uint32_t id) {
+        unlink(id);
+        release(id);
+    }
+
+    // Moves the time to now, calls expire(handle) for every timer with the deadline not after now
+    // (the timer is already released when expire is called). Returns the number of the expired timers.
+    template <typename F>
+    size_t advance(uint64_t now, F&& expire) {
+        if (now <= tick_) {
+            return 0;
+        }
+        uint64_t prev = std::exchange(tick_, now);
+        size_t expired = 0;
+        for (unsigned level = 0; level < kLevels; ++level) {
+            uint64_t from = prev >> (kBits * level);
+            uint64_t to = now >> (kBits * level);
+            if (from == to) {
+                break;
+            }
+            uint64_t count = std::min<uint64_t>(to - from, kSlots);
+            for (uint64_t i = 1; i <= count; ++i) {
+                uint32_t& bucket = buckets_[level * kSlots + ((from + i) & kMask)];
+                uint32_t id = std::exchange(bucket, npos);
+                while (id != npos) {
+                    uint32_t next = timers_[id].next_;
+                    if (timers_[id].deadline_ <= now) {
+                        Handle handle = timers_[id].handle_;
+                        release(id);
+                        expire(handle);
+                        ++expired;
+                    } else {
+                        link(id);
+                    }
+                    id = next;
+                }
+            }
+        }
+        return expired;
+    }
+
+    // Drops all the timers, keeps the time
+    void clear() {
+        timers_.clear();
+        buckets_.fill(npos);
+        free_ = npos;
+    }
+
+private:
+    static constexpr unsigned kBits = 6;
+    static constexpr unsigned kLevels = 4;
+    static constexpr uint64_t kSlots = uint64_t(1) << kBits;
+    static constexpr uint64_t kMask = kSlots - 1;
+    static constexpr uint64_t kSpan = uint64_t(1) << (kBits * kLevels);
+
+    struct Timer {
+        Handle handle_;
+        uint64_t deadline_{0};
+        uint32_t prev_{npos};
+        // Also links the free timers
+        uint32_t next_{npos};
+        uint32_t bucket_{npos};
+    };
+
+    std::vector<Timer> timers_;
+    std::array<uint32_t, kLevels * kSlots> buckets_;
+    uint32_t free_{npos};
+    uint64_t tick_{0};
+
+    void link(uint32_t id) {
+        Timer& timer = timers_[id];
+        uint64_t deadline = std::max(timer.deadline_, tick_ + 1);
+        uint64_t delta = deadline - tick_;
+        unsigned level = 0;
+        while (level + 1 < kLevels && delta >= (uint64_t(1) << (kBits * (level + 1)))) {
+            ++level;
+        }
+        if (delta >= kSpan) {
+            deadline = tick_ + kSpan - 1;
+        }
+        timer.bucket_ = static_cast<uint32_t>(level * kSlots + ((deadline >> (kBits * level)) & kMask));
+        timer.prev_ = npos;
+        timer.next_ = buckets_[timer.bucket_];
+        if (timer.next_ != npos) {
+            timers_[timer.next_].prev_ = id;
+        }
+        buckets_[timer.bucket_] = id;
+    }
+
+    void unlink(uint32_t id) {
+        Timer& timer = timers_[id];
+        if (timer.prev_ != npos) {
+            timers_[timer.prev_].next_ = timer.next_;
+        } else {
+            buckets_[timer.bucket_] = timer.next_;
+        }
+        if (timer.next_ != npos) {
+            timers_[timer.next_].prev_ = timer.prev_;
+        }
+    }
+
+    void release(uint32_t id) {
+        timers_[id].next_ = std::exchange(free_, id);
+    }
+
+};
+
+
+// Value of an ExpiringLRUCache element: the user value, its expiration time and its timer
+template <typename Value, typename TimePoint>
+struct ExpiringValue {
+    Value value_{};
+    TimePoint expires_{TimePoint::max()};
+    uint32_t timer_{TimerWheel<int>::npos};
+
+    ExpiringValue() = default;
+
+    template <typename... Args>
+    explicit ExpiringValue(std::in_place_t, Args&&... args)
+        : value_(std::forward<Args>(args)...)
+    {
+
+    }
+};
+
+// Listener of the inner cache of ExpiringLRUCache, passes the user value on to Listener
+template <typename Key, typename Value, typename TimePoint, typename Listener>
+struct ExpiringRemovalListener {
+    Listener listener_;
+
+    void operator()(Key&& key, ExpiringValue<Value, TimePoint>&& value, RemovalCause cause) {
+        listener_(std::move(key), std::move(value.value_), cause);
+    }
+};
+
+template <typename Base, typename Clock, typename Listener>
+using ExpiringCacheFor = LRUCache<
+    RebindBaseT<Base, ExpiringValue<typename LRUCache<Base>::TValue, typename Clock::time_point>>,
+    std::conditional_t<hasRemovalListener<Listener>,
+        ExpiringRemovalListener<typename LRUCache<Base>::TKey, typename LRUCache<Base>::TValue,
+                                typename Clock::time_point, Listener>,
+        NoRemovalListener>>;
+
+// LRU cache (use BaseVal, BaseUniqPtr or BaseFlat) whose elements expire after a per element or the default TTL.
+// An expired element is never returned nor promoted: get() removes it lazily, the others are reclaimed by
+// a TimerWheel advanced by add() and by cleanUp(). Clock is an object with now() (a std::chrono clock by default),
+// a test clock can be passed to the constructor. Listener receives the removals like in LRUCache,
+// the expired elements with RemovalCause::Expired.
+template <typename Base, typename Clock = std::chrono::steady_clock, typename Listener = NoRemovalListener>
+class ExpiringLRUCache : protected ExpiringCacheFor<Base, Clock, Listener> {
+    using Cache = ExpiringCacheFor<Base, Clock, Listener>;
+    using typename Cache::Map;
+    using typename Cache::MapIter;
+    using Key = typename LRUCache<Base>::TKey;
+    using Value = typename LRUCache<Base>::TValue;
+    using Pair = std::pair<Key, Value>;
+    using TimePoint = typename Clock::time_point;
+    using Duration = typename Clock::duration;
+
+    using Cache::val;
+    using Cache::getNext;
+    using Cache::moveToFront;
+    using Cache::insertFront;
+    using Cache::removeNode;
+    using Cache::notifyRemoval;
+    using Cache::max_size_;
+    using Cache::kv_;
+    using Cache::first_;
+    using Cache::last_;
+
+    Clock clock_;
+    Duration default_ttl_;
+    Duration resolution_;
+    TimePoint epoch_;
+    TimerWheel<MapIter> wheel_;
+
+    bool expired(MapIter it, TimePoint now) const {
+        return val(it).expires_ <= now;
+    }
+
+    // The last tick started by t
+    uint64_t tickOf(TimePoint t) const {
+        return t > epoch_ ? static_cast<uint64_t>((t - epoch_) / resolution_) : 0;
+    }
+
+    // The first tick starting not before t, so that the timer doesn't fire before the element expires
+    uint64_t deadlineTickOf(TimePoint t) const {
+        uint64_t tick = tickOf(t);
+        return t > epoch_ && (t - epoch_) % resolution_ != Duration::zero() ? tick + 1 : tick;
+    }
+
+    // find() does not modify the map, the non-const overload gives the MapIter val() takes
+    template <typename K>
+    MapIter findConst(const K& key) const {
+        return findKey(const_cast<Map&>(kv_), key);
+    }
+
+    void cancelTimer(MapIter it) {
+        auto& entry = val(it);
+        if (entry.timer_ != wheel_.npos) {
+            wheel_.cancel(entry.timer_);
+            entry.timer_ = wheel_.npos;
+        }
+    }
+
+    void removeExpired(MapIter it) {
+        cancelTimer(it);
+        removeNode(it, RemovalCause::Expired);
+    }
+
+    void setTtl(MapIter it, Duration ttl, TimePoint now) {
+        cancelTimer(it);
+        auto& entry = val(it);
+        if (ttl == kNoExpiry || ttl >= TimePoint::max() - now) {
+            entry.expires_ = TimePoint::max();
+            return;
+        }
+        entry.expires_ = now + ttl;
+        entry.timer_ = wheel_.schedule(it, deadlineTickOf(entry.expires_));
+    }
+
+    // Returns true if the key existed (and had not expired)
+    template <typename K, typename... Args>
+    bool put(bool replace, Duration ttl, K&& key, Args&&... args) {
+        TimePoint now = clock_.now();
+        cleanUp(now);
+        auto it = findKey(kv_, key);
+        if (it != kv_.end() && expired(it, now)) {
+            removeExpired(it);
+            it = kv_.end();
+        }
+        if (it != kv_.end()) {
+            if (replace) {
+                notifyRemoval(it, RemovalCause::Replaced);
+                assignValue(val(it).value_, std::forward<Args>(args)...);
+                setTtl(it, ttl, now);
+            }
+            moveToFront(it);
+            return true;
+        }
+        if (kv_.size() == max_size_) {
+            // insertFront() reuses the node of the last_
+            cancelTimer(last_);
+        }
+        insertFront(std::forward<K>(key), std::in_place, std::forward<Args>(args)...);
+        setTtl(first_, ttl, now);
+        return false;
+    }
+
+    // Returns the promoted live element or kv_.end(), an expired one is removed
+    template <typename K>
+    MapIter findLive(const K& key) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return it;
+        }
+        if (expired(it, clock_.now())) {
+            removeExpired(it);
+            return kv_.end();
+        }
+        moveToFront(it);
+        return it;
+    }
+
+    template <typename T, typename F>
+    std::vector<T> collectMRU(size_t n, F&& make) const {
+        std::vector<T> v;
+        v.reserve(std::min(n, kv_.size()));
+        TimePoint now = clock_.now();
+        for (auto it = first_; it != kv_.end() && v.size() < n; it = getNext(it)) {
+            if (!expired(it, now)) {
+                v.push_back(make(it));
+            }
+        }
+        return v;
+    }
+
+public:
+    using TKey = Key;
+    using TValue = Value;
+
+    // Passed as a TTL: the element doesn't expire
+    static constexpr Duration kNoExpiry = Duration::max();
+
+    // resolution is the tick of the timer wheel, the expired elements are reclaimed up to one tick late
+    explicit ExpiringLRUCache(
+        size_t max_size,
+        Duration default_ttl = kNoExpiry,
+        Clock clock = Clock(),
+        Duration resolution = std::chrono::seconds(1))
+        : Cache(max_size)
+        , clock_(std::move(clock))
+        , default_ttl_(default_ttl)
+        , resolution_(std::max(resolution, Duration(1)))
+        , epoch_(clock_.now())
+    {
+
+    }
+
+    template <typename K>
+    bool add(K&& key, const Value& value, Duration ttl) {
+        return put(true, ttl, std::forward<K>(key), value);
+    }
+
+    template <typename K>
+    bool add(K&& key, Value&& value, Duration ttl) {
+        return put(true, ttl, std::forward<K>(key), std::move(value));
+    }
+
+    template <typename K>
+    bool add(K&& key, const Value& value) {
+        return put(true, default_ttl_, std::forward<K>(key), value);
+    }
+
+    template <typename K>
+    bool add(K&& key, Value&& value) {
+        return put(true, default_ttl_, std::forward<K>(key), std::move(value));
+    }
+
+    // With the default TTL
+    template <typename K, typename... Args>
+    bool emplace(K&& key, Args&&... args) {
+        return put(true, default_ttl_, std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    // With the default TTL, an existing live element keeps its value and expiration time
+    template <typename K, typename... Args>
+    bool tryEmplace(K&& key, Args&&... args) {
+        return !put(false, default_ttl_, std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    template <typename K>
+    std::optional<Value> get(const K& key) {
+        auto it = findLive(key);
+        if (it == kv_.end()) {
+            return {};
+        }
+        return val(it).value_;
+    }
+
+    template <typename K>
+    bool contains(const K& key) const {
+        auto it = findConst(key);
+        return it != kv_.end() && !expired(it, clock_.now());
+    }
+
+    template <typename K>
+    std::optional<Value> peek(const K& key) const {
+        auto it = findConst(key);
+        if (it == kv_.end() || expired(it, clock_.now())) {
+            return {};
+        }
+        return val(it).value_;
+    }
+
+    // See LRUCache::getPtr(), the pointer is also invalidated when the element expires and is reclaimed
+    template <typename K>
+    Value* getPtr(const K& key) {
+        auto it = findLive(key);
+        return it != kv_.end() ? &val(it).value_ : nullptr;
+    }
+
+    template <typename K, typename F>
+    bool visit(const K& key, F&& fn) {
+        Value* value = getPtr(key);
+        if (!value) {
+            return false;
+        }
+        std::forward<F>(fn)(*value);
+        return true;
+    }
+
+    // Removes the elements expired by now, returns their number
+    size_t cleanUp(TimePoint now) {
+        return wheel_.advance(tickOf(now), [this](MapIter it) { removeNode(it, RemovalCause::Expired); });
+    }
+
+    size_t cleanUp() {
+        return cleanUp(clock_.now());
+    }
+
+    void clear() {
+        Cache::clear();
+        wheel_.clear();
+    }
+
+    // Includes the expired elements which have not been reclaimed yet
+    using Cache::size;
+    using Cache::maxSize;
+
+    // The live elements only
+    std::vector<Key> getMRUKeys(size_t n) const {
+        return collectMRU<Key>(n, [](MapIter it) { return it->first; });
+    }
+
+    std::vector<Pair> getMRU(size_t n) const {
+        return collectMRU<Pair>(n, [this](MapIter it) { return Pair(it->first, val(it).value_); });
+    }
+
+    Listener& removalListener() { return Cache::removalListener().listener_; }
+
+    Duration defaultTtl() const { return default_ttl_; }
+
+};
+
+} // namespace lrucache
+
+#endif
@@ -0,0 +1,450 @@
+#ifndef LRUCACHE_FLAT_H
+#define LRUCACHE_FLAT_H
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// Fixed capacity map keeping the elements in a preallocated contiguous slot array with an open addressing
+// (linear probing) index from the key to the slot. Provides the subset of the std::unordered_map interface
+// used by LRUCache. Extracting an element keeps its slot, so inserting the node back reuses the slot in place
+// and the iterators to it stay valid. Key and T must be default constructible.
+// No allocation is done after the construction, except by reserve().
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class FlatMap {
+public:
+    struct Slot {
+        Key first;
+        T second;
+    };
+
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<Key, T>;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    class iterator {
+        Slot* slot_{nullptr};
+        friend class FlatMap;
+        explicit iterator(Slot* slot) : slot_(slot) {}
+    public:
+        iterator() = default;
+        Slot& operator*() const { return *slot_; }
+        Slot* operator->() const { return slot_; }
+        bool operator==(const iterator& other) const { return slot_ == other.slot_; }
+        bool operator!=(const iterator& other) const { return slot_ != other.slot_; }
+    };
+
+    // Owns the slot until it is inserted back or destroyed
+    class node_type {
+        FlatMap* map_{nullptr};
+        uint32_t slot_{npos};
+        friend class FlatMap;
+        node_type(FlatMap* map, uint32_t slot) : map_(map), slot_(slot) {}
+    public:
+        node_type() = default;
+        node_type(node_type&& other) noexcept
+            : map_(std::exchange(other.map_, nullptr))
+            , slot_(other.slot_)
+        {
+
+        }
+        node_type& operator=(node_type&& other) noexcept {
+            if (this != &other) {
+                reset();
+                map_ = std::exchange(other.map_, nullptr);
+                slot_ = other.slot_;
+            }
+            return *this;
+        }
+        ~node_type() { reset(); }
+
+        bool empty() const { return map_ == nullptr; }
+        explicit operator bool() const { return map_ != nullptr; }
+        Key& key() const { return map_->slots_[slot_].first; }
+        T& mapped() const { return map_->slots_[slot_].second; }
+
+    private:
+        void reset() {
+            if (map_) {
+                map_->releaseSlot(slot_);
+                map_ = nullptr;
+            }
+        }
+    };
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+    explicit FlatMap(size_t capacity)
+        : capacity_(capacity)
+        , slots_(new Slot[std::max<size_t>(capacity, 1)])
+    {
+        assert(capacity < npos);
+        size_t index_size = indexSizeFor(capacity);
+        mask_ = index_size - 1;
+        index_.reset(new uint64_t[index_size]);
+        std::memset(index_.get(), 0, index_size * sizeof(uint64_t));
+        free_.reserve(capacity);
+    }
+
+    FlatMap(const FlatMap&) = delete;
+    FlatMap& operator=(const FlatMap&) = delete;
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    iterator end() const { return iterator{}; }
+
+    iterator find(const Key& key) const {
+        return find(key, hashOf(key));
+    }
+
+    // Heterogeneous lookup, enabled when both Hash and KeyEqual are transparent
+    template <typename K, typename H = Hash, typename E = KeyEqual,
+              typename = typename H::is_transparent, typename = typename E::is_transparent>
+    iterator find(const K& key) const {
+        return find(key, hashOf(key));
+    }
+
+    // Prefetches the first index bucket find(key) reads
+    template <typename K>
+    void prefetch(const K& key) const {
+        prefetchAddress(&index_[hashOf(key) & mask_]);
+    }
+
+    std::pair<iterator, bool> insert(value_type&& v) {
+        return try_emplace(std::move(v.first), std::move(v.second));
+    }
+
+    // The mapped value is assigned into the slot from a T constructed from args
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        return emplaceKey(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        return emplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+
+    insert_return_type insert(node_type&& node) {
+        if (node.empty()) {
+            return {end(), false, {}};
+        }
+        assert(node.map_ == this);
+        uint32_t h = hashOf(node.key());
+        iterator it = find(node.key(), h);
+        if (it != end()) {
+            return {it, false, std::move(node)};
+        }
+        uint32_t slot = node.slot_;
+        node.map_ = nullptr;
+        addToIndex(slot, h);
+        return {iterator{&slots_[slot]}, true, {}};
+    }
+
+    node_type extract(iterator it) {
+        uint32_t slot = indexOf(it);
+        removeFromIndex(slot);
+        return node_type{this, slot};
+    }
+
+    void erase(iterator it) {
+        uint32_t slot = indexOf(it);
+        removeFromIndex(slot);
+        releaseSlot(slot);
+    }
+
+    void clear() {
+        for (uint32_t slot = 0; slot < used_; ++slot) {
+            slots_[slot] = Slot{};
+        }
+        std::memset(index_.get(), 0, (mask_ + 1) * sizeof(uint64_t));
+        free_.clear();
+        used_ = 0;
+        size_ = 0;
+    }
+
+    // Grows the capacity: the slots are moved to a larger array keeping their numbers (so the iterators are
+    // invalidated but not the slot numbers, see indexOf()) and the index is rebuilt from the stored hashes
+    void reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        assert(capacity < npos);
+        std::unique_ptr<Slot[]> slots(new Slot[capacity]);
+        std::move(slots_.get(), slots_.get() + used_, slots.get());
+        size_t index_size = indexSizeFor(capacity);
+        std::unique_ptr<uint64_t[]> index(new uint64_t[index_size]);
+        std::memset(index.get(), 0, index_size * sizeof(uint64_t));
+        for (size_t b = 0; b <= mask_; ++b) {
+            uint64_t e = index_[b];
+            if (e == 0) {
+                continue;
+            }
+            size_t to = static_cast<uint32_t>(e >> 32) & (index_size - 1);
+            while (index[to] != 0) {
+                to = (to + 1) & (index_size - 1);
+            }
+            index[to] = e;
+        }
+        slots_ = std::move(slots);
+        index_ = std::move(index);
+        mask_ = index_size - 1;
+        capacity_ = capacity;
+        free_.reserve(capacity);
+    }
+
+    // Slot number of a valid iterator (npos for end())
+    uint32_t indexOf(iterator it) const {
+        return it.slot_ ? static_cast<uint32_t>(it.slot_ - slots_.get()) : npos;
+    }
+
+    // Iterator to a slot number (end() for npos)
+    iterator iteratorAt(uint32_t slot) const {
+        return slot != npos ? iterator{&slots_[slot]} : end();
+    }
+
+private:
+    size_t capacity_{0};
+    size_t size_{0};
+    size_t mask_{0};
+    uint32_t used_{0};
+    std::unique_ptr<Slot[]> slots_;
+    // 0 for an empty bucket, otherwise (32 bits of hash << 32) | (slot + 1)
+    std::unique_ptr<uint64_t[]> index_;
+    std::vector<uint32_t> free_;
+    Hash hash_;
+    KeyEqual eq_;
+
+    // A power of 2 keeping the load factor of the index under 2/3
+    static size_t indexSizeFor(size_t capacity) {
+        size_t index_size = 16;
+        while (index_size < capacity + capacity / 2) {
+            index_size *= 2;
+        }
+        return index_size;
+    }
+
+    // Fibonacci hashing, the high half of the product depends on all the bits of the hash
+    template <typename K>
+    uint32_t hashOf(const K& key) const {
+        return static_cast<uint32_t>((static_cast<uint64_t>(hash_(key)) * 0x9e3779b97f4a7c15ULL) >> 32);
+    }
+
+    template <typename K>
+    iterator find(const K& key, uint32_t h) const {
+        for (size_t b = h & mask_; ; b = (b + 1) & mask_) {
+            uint64_t e = index_[b];
+            if (e == 0) {
+                return end();
+            }
+            if (static_cast<uint32_t>(e >> 32) == h && eq_(slots_[slotOf(e)].first, key)) {
+                return iterator{&slots_[slotOf(e)]};
+            }
+        }
+    }
+
+    static uint32_t slotOf(uint64_t e) { return static_cast<uint32_t>(e) - 1; }
+
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> emplaceKey(K&& key, Args&&... args) {
+        uint32_t h = hashOf(key);
+        iterator it = find(key, h);
+        if (it != end()) {
+            return {it, false};
+        }
+        assert(size_ < capacity_);
+        if (size_ == capacity_) {
+            return {end(), false};
+        }
+        uint32_t slot = acquireSlot();
+        try {
+            slots_[slot].first = std::forward<K>(key);
+            slots_[slot].second = T(std::forward<Args>(args)...);
+        } catch (...) {
+            releaseSlot(slot);
+            throw;
+        }
+        addToIndex(slot, h);
+        return {iterator{&slots_[slot]}, true};
+    }
+
+    uint32_t acquireSlot() {
+        if (!free_.empty()) {
+            uint32_t slot = free_.back();
+            free_.pop_back();
+            return slot;
+        }
+        return used_++;
+    }
+
+    void releaseSlot(uint32_t slot) {
+        slots_[slot] = Slot{};
+        free_.push_back(slot);
+    }
+
+    void addToIndex(uint32_t slot, uint32_t h) {
+        size_t b = h & mask_;
+        while (index_[b] != 0) {
+            b = (b + 1) & mask_;
+        }
+        index_[b] = (static_cast<uint64_t>(h) << 32) | (static_cast<uint64_t>(slot) + 1);
+        ++size_;
+    }
+
+    // Backward shift deletion, keeps the probe sequences free of tombstones
+    void removeFromIndex(uint32_t slot) {
+        size_t i = hashOf(slots_[slot].first) & mask_;
+        while (slotOf(index_[i]) != slot) {
+            assert(index_[i] != 0);
+            i = (i + 1) & mask_;
+        }
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & mask_;
+            uint64_t e = index_[j];
+            if (e == 0) {
+                break;
+            }
+            size_t home = static_cast<uint32_t>(e >> 32) & mask_;
+            if (((j - home) & mask_) >= ((j - i) & mask_)) {
+                index_[i] = e;
+                i = j;
+            }
+        }
+        index_[i] = 0;
+        --size_;
+    }
+
+};
+
+
+// Pass to LRUCache to keep the elements in a FlatMap, the list is represented by 32 bit slot numbers.
+// All the memory is allocated by the constructor, evicting an element reuses its slot in place.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class BaseFlat {
+protected:
+
+    struct ListNode {
+        uint32_t prev_;
+        uint32_t next_;
+        Value value_;
+
+        ListNode() = default;
+
+        template <typename... Args>
+        ListNode(uint32_t prev, uint32_t next, Args&&... args)
+            : prev_(prev)
+            , next_(next)
+            , value_(std::forward<Args>(args)...)
+        {
+
+        }
+    };
+
+    using Map = FlatMap<Key, ListNode, Hash, KeyEqual>;
+    using MapIter = typename Map::iterator;
+    using Pair = std::pair<Key, Value>;
+    using NodeType = typename Map::node_type;
+    using TKey = Key;
+    using TValue = Value;
+
+    Value& val(NodeType& node) { return node.mapped().value_; }
+
+    Value& val(MapIter it) { return it->second.value_; }
+    const Value& val(MapIter it) const { return it->second.value_; }
+
+    MapIter getNext(MapIter it) const {
+        return kv_.iteratorAt(it->second.next_);
+    }
+
+    MapIter getPrev(MapIter it) const {
+        return kv_.iteratorAt(it->second.prev_);
+    }
+
+    MapIter setNextTo(MapIter it, MapIter target) {
+        it->second.next_ = kv_.indexOf(target);
+        return target;
+    }
+
+    MapIter setPrevTo(MapIter it, MapIter target) {
+        it->second.prev_ = kv_.indexOf(target);
+        return target;
+    }
+
+    // Prefetches what moveToFront(it) reads besides the slot of it: the slots of its neighbours
+    void prefetchListNode(MapIter it) const {
+        if (it->second.prev_ != Map::npos) {
+            prefetchAddress(&*kv_.iteratorAt(it->second.prev_));
+        }
+        if (it->second.next_ != Map::npos) {
+            prefetchAddress(&*kv_.iteratorAt(it->second.next_));
+        }
+    }
+
+    // Inserts a missing key, the ListNode built from args is moved into the preallocated slot
+    template <typename K, typename... Args>
+    MapIter emplaceListNode(K&& key, Args&&... args) {
+        return kv_.try_emplace(std::forward<K>(key), Map::npos, Map::npos, std::forward<Args>(args)...).first;
+    }
+
+    void eraseListNode(MapIter it) {
+        kv_.erase(it);
+    }
+
+    void clear() {
+        kv_.clear();
+        first_ = kv_.end();
+        last_ = kv_.end();
+    }
+
+    void preAdd() {
+
+    }
+
+    // The FlatMap moves the slots, the list links are slot numbers: only first_ and last_ need updating
+    void reserve(size_t max_size) {
+        uint32_t first = kv_.indexOf(first_);
+        uint32_t last = kv_.indexOf(last_);
+        kv_.reserve(max_size);
+        first_ = kv_.iteratorAt(first);
+        last_ = kv_.iteratorAt(last);
+    }
+
+    size_t max_size_{0};
+    Map kv_;
+    MapIter first_;
+    MapIter last_;
+
+    explicit BaseFlat(size_t max_size)
+        : max_size_(max_size)
+        , kv_(max_size)
+        , first_(kv_.end())
+        , last_(kv_.end())
+    {
+
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef LRUCACHE_GENERATION_H
+#define LRUCACHE_GENERATION_H
+
+#include <vector>
+#include <optional>
+#include <limits>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// Value of a GenerationLRUCache element: the user value and the generation it was added in
+template <typename Value>
+struct GenerationValue {
+    Value value_{};
+    uint64_t generation_{0};
+
+    GenerationValue() = default;
+
+    template <typename... Args>
+    explicit GenerationValue(std::in_place_t, Args&&... args)
+        : value_(std::forward<Args>(args)...)
+    {
+
+    }
+};
+
+// Listener of the inner cache of GenerationLRUCache, passes the user value on to Listener
+template <typename Key, typename Value, typename Listener>
+struct GenerationRemovalListener {
+    Listener listener_;
+
+    void operator()(Key&& key, GenerationValue<Value>&& value, RemovalCause cause) {
+        listener_(std::move(key), std::move(value.value_), cause);
+    }
+};
+
+template <typename Base, typename Listener>
+using GenerationCacheFor = LRUCache<
+    RebindBaseT<Base, GenerationValue<typename LRUCache<Base>::TValue>>,
+    std::conditional_t<hasRemovalListener<Listener>,
+        GenerationRemovalListener<typename LRUCache<Base>::TKey, typename LRUCache<Base>::TValue, Listener>,
+        NoRemovalListener>>;
+
+// LRU cache (use BaseVal, BaseUniqPtr or BaseFlat) whose invalidateAll() is O(1): it starts a new generation,
+// the elements of the older ones become stale. A stale element is never returned nor promoted, so the stale
+// elements are always the least recently used ones: add() reclaims up to kReclaimStep of them from the back of
+// the list and the lookups remove the stale elements they find, spreading the cost of the invalidation over the
+// following operations instead of freeing every node at once like clear(). Listener receives the removals like
+// in LRUCache, the reclaimed stale elements with RemovalCause::Explicit.
+template <typename Base, typename Listener = NoRemovalListener>
+class GenerationLRUCache : protected GenerationCacheFor<Base, Listener> {
+    using Cache = GenerationCacheFor<Base, Listener>;
+    using typename Cache::Map;
+    using typename Cache::MapIter;
+    using Key = typename LRUCache<Base>::TKey;
+    using Value = typename LRUCache<Base>::TValue;
+    using Pair = std::pair<Key, Value>;
+
+    using Cache::val;
+    using Cache::getNext;
+    using Cache::moveToFront;
+    using Cache::insertFront;
+    using Cache::removeNode;
+    using Cache::notifyRemoval;
+    using Cache::kv_;
+    using Cache::first_;
+    using Cache::last_;
+
+    uint64_t generation_{0};
+    // The stale elements, the last stale_ ones of the list
+    size_t stale_{0};
+
+    bool stale(MapIter it) const {
+        return val(it).generation_ != generation_;
+    }
+
+    void removeStale(MapIter it) {
+        --stale_;
+        removeNode(it, RemovalCause::Explicit);
+    }
+
+    // find() does not modify the map, the non-const overload gives the MapIter val() takes
+    template <typename K>
+    MapIter findConst(const K& key) const {
+        return findKey(const_cast<Map&>(kv_), key);
+    }
+
+    // Returns the promoted live element or kv_.end(), a stale one is removed
+    template <typename K>
+    MapIter findLive(const K& key) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return it;
+        }
+        if (stale(it)) {
+            removeStale(it);
+            return kv_.end();
+        }
+        moveToFront(it);
+        return it;
+    }
+
+    // Returns true if the key existed (and was live)
+    template <typename K, typename... Args>
+    bool put(bool replace, K&& key, Args&&... args) {
+        // a full cache with stale elements frees one here, so insertFront() never reuses a stale node
+        reclaim(kReclaimStep);
+        auto it = findKey(kv_, key);
+        if (it != kv_.end() && stale(it)) {
+            removeStale(it);
+            it = kv_.end();
+        }
+        if (it != kv_.end()) {
+            if (replace) {
+                notifyRemoval(it, RemovalCause::Replaced);
+                assignValue(val(it).value_, std::forward<Args>(args)...);
+            }
+            moveToFront(it);
+            return true;
+        }
+        insertFront(std::forward<K>(key), std::in_place, std::forward<Args>(args)...);
+        val(first_).generation_ = generation_;
+        return false;
+    }
+
+    // The live elements are the first size() ones of the list
+    template <typename T, typename F>
+    std::vector<T> collectMRU(size_t n, F&& make) const {
+        n = std::min(n, size());
+        std::vector<T> v;
+        v.reserve(n);
+        for (auto it = first_; v.size() < n; it = getNext(it)) {
+            v.push_back(make(it));
+        }
+        return v;
+    }
+
+public:
+    using TKey = Key;
+    using TValue = Value;
+
+    // Number of stale elements add() reclaims at most
+    static constexpr size_t kReclaimStep = 4;
+
+    explicit GenerationLRUCache(size_t max_size)
+        : Cache(max_size)
+    {
+
+    }
+
+    template <typename K>
+    bool add(K&& key, const Value& value) {
+        return put(true, std::forward<K>(key), value);
+    }
+
+    template <typename K>
+    bool add(K&& key, Value&& value) {
+        return put(true, std::forward<K>(key), std::move(value));
+    }
+
+    template <typename K, typename... Args>
+    bool emplace(K&& key, Args&&... args) {
+        return put(true, std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    // An existing live element keeps its value
+    template <typename K, typename... Args>
+    bool tryEmplace(K&& key, Args&&... args) {
+        return !put(false, std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    template <typename K>
+    std::optional<Value> get(const K& key) {
+        auto it = findLive(key);
+        if (it == kv_.end()) {
+            return {};
+        }
+        return val(it).value_;
+    }
+
+    template <typename K>
+    bool contains(const K& key) const {
+        auto it = findConst(key);
+        return it != kv_.end() && !stale(it);
+    }
+
+    template <typename K>
+    std::optional<Value> peek(const K& key) const {
+        auto it = findConst(key);
+        if (it == kv_.end() || stale(it)) {
+            return {};
+        }
+        return val(it).value_;
+    }
+
+    // See LRUCache::getPtr(), the pointer is also invalidated when the element is reclaimed after invalidateAll()
+    template <typename K>
+    Value* getPtr(const K& key) {
+        auto it = findLive(key);
+        return it != kv_.end() ? &val(it).value_ : nullptr;
+    }
+
+    template <typename K, typename F>
+    bool visit(const K& key, F&& fn) {
+        Value* value = getPtr(key);
+        if (!value) {
+            return false;
+        }
+        std::forward<F>(fn)(*value);
+        return true;
+    }
+
+    // Returns false if the key is missing or stale (a stale element is reclaimed all the same)
+    template <typename K>
+    bool erase(const K& key) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return false;
+        }
+        bool live = !stale(it);
+        if (!live) {
+            --stale_;
+        }
+        removeNode(it, RemovalCause::Explicit);
+        return live;
+    }
+
+    // O(1): every element becomes stale, see the class comment
+    void invalidateAll() {
+        ++generation_;
+        stale_ = kv_.size();
+    }
+
+    // See LRUCache::invalidateIf(), only the live elements are passed to pred
+    template <typename Pred>
+    size_t invalidateIf(Pred&& pred) {
+        size_t removed = 0;
+        size_t live = size();
+        auto it = first_;
+        for (size_t i = 0; i < live; ++i) {
+            MapIter next = getNext(it);
+            if (pred(static_cast<const Key&>(it->first), static_cast<const Value&>(val(it).value_))) {
+                removeNode(it, RemovalCause::Explicit);
+                ++removed;
+            }
+            it = next;
+        }
+        return removed;
+    }
+
+    // Removes up to max_steps stale elements, returns their number
+    size_t reclaim(size_t max_steps = std::numeric_limits<size_t>::max()) {
+        size_t reclaimed = 0;
+        while (stale_ != 0 && reclaimed < max_steps) {
+            removeStale(last_);
+            ++reclaimed;
+        }
+        return reclaimed;
+    }
+
+    void clear() {
+        Cache::clear();
+        stale_ = 0;
+    }
+
+    // The live elements
+    size_t size() const { return kv_.size() - stale_; }
+    // The stale elements not reclaimed yet
+    size_t staleSize() const { return stale_; }
+    using Cache::maxSize;
+
+    std::vector<Key> getMRUKeys(size_t n) const {
+        return collectMRU<Key>(n, [](MapIter it) { return it->first; });
+    }
+
+    std::vector<Pair> getMRU(size_t n) const {
+        return collectMRU<Pair>(n, [this](MapIter it) { return Pair(it->first, val(it).value_); });
+    }
+
+    Listener& removalListener() { return Cache::removalListener().listener_; }
+
+};
+
+} // namespace lrucache
+
+#endif
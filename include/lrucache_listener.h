@@ -0,0 +1,86 @@
+#ifndef LRUCACHE_LISTENER_H
+#define LRUCACHE_LISTENER_H
+
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+namespace lrucache {
+
+// Why an element left the cache, passed to the removal listener
+enum class RemovalCause {
+    Size,       // evicted to make room for another element (or to fit the weight budget)
+    Replaced,   // the value was overwritten by add() or emplace()
+    Expired,    // the time to live elapsed
+    Explicit,   // removed by the user, e.g. by clear()
+};
+
+// Default listener of the caches: nothing is reported and the evicted elements are overwritten in place
+struct NoRemovalListener {};
+
+template <typename Listener>
+constexpr bool hasRemovalListener = !std::is_same_v<Listener, NoRemovalListener>;
+
+template <typename Key, typename Value>
+struct Removal {
+    Key key_;
+    Value value_;
+    RemovalCause cause_;
+};
+
+// Listener of the batched mode: the removals are only queued while the cache works (in its critical section)
+// and handed to bulk(std::vector<Removal>&&) by dispatch(). The thread safe caches take the queue under their
+// lock and dispatch it after releasing the lock, so bulk is then called concurrently by the writers.
+// The single threaded caches leave dispatch() to the user.
+template <typename Key, typename Value, typename BulkListener>
+class BatchedRemovalListener {
+public:
+    using Batch = std::vector<Removal<Key, Value>>;
+
+    explicit BatchedRemovalListener(BulkListener bulk = BulkListener())
+        : bulk_(std::move(bulk))
+    {
+
+    }
+
+    void operator()(Key&& key, Value&& value, RemovalCause cause) {
+        queue_.push_back({std::move(key), std::move(value), cause});
+    }
+
+    // Moves the queued removals out
+    Batch take() {
+        return std::exchange(queue_, Batch());
+    }
+
+    void dispatch(Batch&& batch) {
+        if (!batch.empty()) {
+            bulk_(std::move(batch));
+        }
+    }
+
+    // Hands the queued removals to the bulk listener
+    void dispatch() {
+        dispatch(take());
+    }
+
+    size_t pending() const { return queue_.size(); }
+
+    BulkListener& bulkListener() { return bulk_; }
+
+private:
+    Batch queue_;
+    BulkListener bulk_;
+};
+
+template <typename Listener>
+struct IsBatchedRemovalListener : std::false_type {};
+
+template <typename Key, typename Value, typename BulkListener>
+struct IsBatchedRemovalListener<BatchedRemovalListener<Key, Value, BulkListener>> : std::true_type {};
+
+template <typename Listener>
+constexpr bool isBatchedRemovalListener = IsBatchedRemovalListener<Listener>::value;
+
+} // namespace lrucache
+
+#endif
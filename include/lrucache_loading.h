@@ -0,0 +1,349 @@
+#ifndef LRUCACHE_LOADING_H
+#define LRUCACHE_LOADING_H
+
+#include <array>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+
+#include "lrucache.h"
+#include "lrucache_sharded.h"
+
+namespace lrucache {
+
+// The value stored by LoadingCache, with the time it was loaded at
+template <typename Value, typename TimePoint>
+struct LoadedValue {
+    Value value_{};
+    TimePoint loaded_{};
+};
+
+// A load in progress, the callers missing the same key wait for it instead of loading the key again
+template <typename Value>
+class LoadFlight {
+public:
+    void complete(std::optional<Value> value, std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            value_ = std::move(value);
+            error_ = error;
+            done_ = true;
+        }
+        done_cv_.notify_all();
+    }
+
+    // Blocks until the load completes, rethrows the exception of the loader
+    Value wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]() { return done_; });
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return *value_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+    bool done_{false};
+    std::optional<Value> value_;
+    std::exception_ptr error_;
+};
+
+// Thread safe cache (a ShardedLRUCache over Base with N shards) which loads the missing keys through a loader:
+// getOrLoad(key, loader) returns the cached value or calls loader(key), and the concurrent misses of a key wait
+// for the one load in progress (single flight) instead of loading it again. The loader is called without any
+// lock held; its exception is rethrown to all the callers waiting for the load and nothing is cached.
+// - expire_after: an element loaded longer ago is a miss (kNoExpiry by default)
+// - refresh_after: a hit on an element loaded longer ago returns it and reloads it on a background thread,
+//   so the elements still read are replaced before they expire (kNoRefresh by default)
+// Clock is an object with now() callable from any thread (a std::chrono clock by default).
+template <typename Base, size_t N = 16, typename Clock = std::chrono::steady_clock>
+class LoadingCache {
+    using Key = typename LRUCache<Base>::TKey;
+    using Value = typename LRUCache<Base>::TValue;
+    using TimePoint = typename Clock::time_point;
+    using Duration = typename Clock::duration;
+    using Entry = LoadedValue<Value, TimePoint>;
+    using Cache = ShardedLRUCache<RebindBaseT<Base, Entry>, N>;
+    using Flight = LoadFlight<Value>;
+    using FlightPtr = std::shared_ptr<Flight>;
+
+    struct alignas(64) FlightStripe {
+        std::mutex mutex_;
+        std::unordered_map<Key, FlightPtr> flights_;
+    };
+
+    Cache cache_;
+    Clock clock_;
+    Duration refresh_after_;
+    Duration expire_after_;
+    std::array<FlightStripe, N> stripes_;
+
+    // The refresh thread, started by the first refresh
+    std::mutex refresh_mutex_;
+    std::condition_variable refresh_cv_;
+    std::deque<std::function<void()>> refresh_queue_;
+    bool stopping_{false};
+    std::thread refresher_;
+
+    FlightStripe& stripeFor(const Key& key) {
+        return stripes_[mixHash(std::hash<Key>{}(key) + 1) % N];
+    }
+
+    bool expired(const Entry& entry, TimePoint now) const {
+        return expire_after_ != kNoExpiry && now - entry.loaded_ >= expire_after_;
+    }
+
+    bool refreshDue(const Entry& entry, TimePoint now) const {
+        return refresh_after_ != kNoRefresh && now - entry.loaded_ >= refresh_after_;
+    }
+
+    // The flight of the key, created if there is none: the caller is then the leader which has to load
+    std::pair<FlightPtr, bool> acquire(const Key& key) {
+        FlightStripe& stripe = stripeFor(key);
+        std::lock_guard<std::mutex> lock(stripe.mutex_);
+        auto [it, inserted] = stripe.flights_.try_emplace(key);
+        if (inserted) {
+            it->second = std::make_shared<Flight>();
+        }
+        return {it->second, inserted};
+    }
+
+    // Caches the loaded value before the flight is removed, so that a caller who finds no flight finds the value
+    void finish(const Key& key, const FlightPtr& flight, std::optional<Value> value, std::exception_ptr error) {
+        if (value) {
+            cache_.add(key, Entry{*value, clock_.now()});
+        }
+        {
+            FlightStripe& stripe = stripeFor(key);
+            std::lock_guard<std::mutex> lock(stripe.mutex_);
+            auto it = stripe.flights_.find(key);
+            if (it != stripe.flights_.end() && it->second == flight) {
+                stripe.flights_.erase(it);
+            }
+        }
+        flight->complete(std::move(value), error);
+    }
+
+    // The value of a live element, the leader rechecks the cache: the previous flight may have just finished
+    std::optional<Value> lookup(const Key& key, TimePoint now, bool promote) {
+        auto entry = promote ? cache_.get(key) : cache_.peek(key);
+        if (!entry || expired(*entry, now)) {
+            return {};
+        }
+        return std::move(entry->value_);
+    }
+
+    template <typename Loader>
+    Value load(const Key& key, Loader& loader) {
+        auto [flight, leader] = acquire(key);
+        if (!leader) {
+            return flight->wait();
+        }
+        if (auto value = lookup(key, clock_.now(), false)) {
+            finish(key, flight, value, nullptr);
+            return std::move(*value);
+        }
+        std::optional<Value> value;
+        try {
+            value.emplace(loader(key));
+        } catch (...) {
+            finish(key, flight, {}, std::current_exception());
+            throw;
+        }
+        finish(key, flight, value, nullptr);
+        return std::move(*value);
+    }
+
+    // Reloads the key on the refresh thread unless a load of it is in progress, errors keep the old value
+    template <typename Loader>
+    void refresh(const Key& key, const Loader& loader) {
+        auto [flight, leader] = acquire(key);
+        if (!leader) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(refresh_mutex_);
+        refresh_queue_.emplace_back([this, key, flight = std::move(flight), loader = Loader(loader)]() mutable {
+            std::optional<Value> value;
+            try {
+                value.emplace(loader(key));
+            } catch (...) {
+                finish(key, flight, {}, std::current_exception());
+                return;
+            }
+            finish(key, flight, std::move(value), nullptr);
+        });
+        if (!refresher_.joinable()) {
+            refresher_ = std::thread([this]() { runRefreshes(); });
+        }
+        refresh_cv_.notify_one();
+    }
+
+    void runRefreshes() {
+        std::unique_lock<std::mutex> lock(refresh_mutex_);
+        while (true) {
+            refresh_cv_.wait(lock, [this]() { return stopping_ || !refresh_queue_.empty(); });
+            if (refresh_queue_.empty()) {
+                return;
+            }
+            auto task = std::move(refresh_queue_.front());
+            refresh_queue_.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+public:
+    using TKey = Key;
+    using TValue = Value;
+
+    static constexpr Duration kNoExpiry = Duration::max();
+    static constexpr Duration kNoRefresh = Duration::max();
+
+    explicit LoadingCache(
+        size_t max_size,
+        Duration refresh_after = kNoRefresh,
+        Duration expire_after = kNoExpiry,
+        Clock clock = Clock())
+        : cache_(max_size)
+        , clock_(std::move(clock))
+        , refresh_after_(refresh_after)
+        , expire_after_(expire_after)
+    {
+
+    }
+
+    // The refreshes queued are run before the destructor returns
+    ~LoadingCache() {
+        {
+            std::lock_guard<std::mutex> lock(refresh_mutex_);
+            stopping_ = true;
+        }
+        refresh_cv_.notify_one();
+        if (refresher_.joinable()) {
+            refresher_.join();
+        }
+    }
+
+    LoadingCache(const LoadingCache&) = delete;
+    LoadingCache& operator=(const LoadingCache&) = delete;
+
+    // Returns the cached value or the one loader(key) returns, loaded once for all the concurrent callers.
+    // With refresh_after, the loader is copied to reload the key in the background.
+    template <typename Loader>
+    Value getOrLoad(const Key& key, Loader&& loader) {
+        TimePoint now = clock_.now();
+        if (auto entry = cache_.get(key); entry && !expired(*entry, now)) {
+            if (refreshDue(*entry, now)) {
+                refresh(key, loader);
+            }
+            return std::move(entry->value_);
+        }
+        return load(key, loader);
+    }
+
+    // getOrLoad() of every key: the missing keys which no other caller is loading are passed to one call of
+    // loader(const std::vector<Key>&), which returns their values in the same order, the others are waited for
+    template <typename Loader>
+    std::vector<Value> getAllOrLoad(const std::vector<Key>& keys, Loader&& loader) {
+        TimePoint now = clock_.now();
+        std::vector<std::optional<Value>> values(keys.size());
+        std::vector<size_t> loading;
+        std::vector<Key> missing;
+        std::vector<FlightPtr> flights;
+        std::vector<std::pair<size_t, FlightPtr>> waiting;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (auto entry = cache_.get(keys[i]); entry && !expired(*entry, now)) {
+                if (refreshDue(*entry, now)) {
+                    refresh(keys[i], [loader](const Key& key) mutable { return std::move(loader(std::vector<Key>{key}).at(0)); });
+                }
+                values[i] = std::move(entry->value_);
+                continue;
+            }
+            auto [flight, leader] = acquire(keys[i]);
+            if (!leader) {
+                waiting.emplace_back(i, std::move(flight));
+            } else if (auto value = lookup(keys[i], now, false)) {
+                finish(keys[i], flight, value, nullptr);
+                values[i] = std::move(value);
+            } else {
+                loading.push_back(i);
+                missing.push_back(keys[i]);
+                flights.push_back(std::move(flight));
+            }
+        }
+
+        // the own loads are completed before waiting, so that two batches waiting for each other can't deadlock
+        if (!missing.empty()) {
+            std::vector<Value> loaded;
+            try {
+                loaded = loader(missing);
+                if (loaded.size() != missing.size()) {
+                    throw std::length_error("the loader returned a wrong number of values");
+                }
+            } catch (...) {
+                for (size_t j = 0; j < missing.size(); ++j) {
+                    finish(missing[j], flights[j], {}, std::current_exception());
+                }
+                throw;
+            }
+            for (size_t j = 0; j < missing.size(); ++j) {
+                finish(missing[j], flights[j], loaded[j], nullptr);
+                values[loading[j]] = std::move(loaded[j]);
+            }
+        }
+        for (auto& [i, flight] : waiting) {
+            values[i] = flight->wait();
+        }
+
+        std::vector<Value> result;
+        result.reserve(values.size());
+        for (auto& value : values) {
+            result.push_back(std::move(*value));
+        }
+        return result;
+    }
+
+    // Does not load, an expired element is a miss
+    std::optional<Value> get(const Key& key) {
+        return lookup(key, clock_.now(), true);
+    }
+
+    // Caches a value loaded now
+    bool add(const Key& key, const Value& value) {
+        return cache_.add(key, Entry{value, clock_.now()});
+    }
+
+    // Includes the expired elements which have not been replaced yet
+    size_t size() const { return cache_.size(); }
+    size_t maxSize() const { return cache_.maxSize(); }
+
+    void clear() { cache_.clear(); }
+
+    // The keys being loaded or refreshed
+    size_t loadsInFlight() {
+        size_t n = 0;
+        for (auto& stripe : stripes_) {
+            std::lock_guard<std::mutex> lock(stripe.mutex_);
+            n += stripe.flights_.size();
+        }
+        return n;
+    }
+};
+
+} // namespace lrucache
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef LRUCACHE_LOOKUP_H
+#define LRUCACHE_LOOKUP_H
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace lrucache {
+
+// Transparent hash for std::string keys, lets the lookups by std::string_view or const char* skip building a std::string.
+// Use it together with std::equal_to<> in a hash map template passed as the MapClass.
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+template <typename Map, typename = void>
+struct HasTransparentCompare : std::false_type {};
+
+template <typename Map>
+struct HasTransparentCompare<Map, std::void_t<typename Map::key_compare::is_transparent>> : std::true_type {};
+
+template <typename Map, typename = void>
+struct HasTransparentHash : std::false_type {};
+
+template <typename Map>
+struct HasTransparentHash<Map, std::void_t<
+    typename Map::hasher::is_transparent,
+    typename Map::key_equal::is_transparent>> : std::true_type {};
+
+template <typename Map, typename K, typename = void>
+struct HasFindFor : std::false_type {};
+
+template <typename Map, typename K>
+struct HasFindFor<Map, K, std::void_t<decltype(std::declval<Map&>().find(std::declval<const K&>()))>> : std::true_type {};
+
+// True if Map looks K up without constructing its key_type: std::map with a transparent comparator,
+// hash maps with a transparent hash and key equality (std::unordered_map only since C++20)
+template <typename Map, typename K>
+constexpr bool isHeterogeneousLookup =
+    std::is_same_v<K, typename Map::key_type> ||
+    ((HasTransparentCompare<Map>::value || HasTransparentHash<Map>::value) && HasFindFor<Map, K>::value);
+
+template <typename Map, typename K, typename = void>
+struct HasPrefetchFor : std::false_type {};
+
+template <typename Map, typename K>
+struct HasPrefetchFor<Map, K, std::void_t<decltype(std::declval<const Map&>().prefetch(std::declval<const K&>()))>> : std::true_type {};
+
+// Asks the CPU to start loading the cache line at p, a no-op without the compiler builtin
+inline void prefetchAddress(const void* p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+// Prefetches the bucket of key in the maps exposing it (FlatMap, SwissMap), does nothing for the standard maps
+template <typename Map, typename K>
+void prefetchKey(const Map& map, const K& key) {
+    if constexpr (isHeterogeneousLookup<Map, K> && HasPrefetchFor<Map, K>::value) {
+        map.prefetch(key);
+    }
+}
+
+// Finds key in map, converting it to the key_type only when the map can't compare K directly
+template <typename Map, typename K>
+auto findKey(Map& map, const K& key) {
+    if constexpr (isHeterogeneousLookup<std::remove_const_t<Map>, K>) {
+        return map.find(key);
+    } else {
+        return map.find(typename Map::key_type(key));
+    }
+}
+
+// True for the ordered maps (std::map, std::pmr::map), which LRUCache::eraseRange() and erasePrefix() walk in key order
+template <typename Map, typename = void>
+struct IsOrderedMap : std::false_type {};
+
+template <typename Map>
+struct IsOrderedMap<Map, std::void_t<typename Map::key_compare>> : std::true_type {};
+
+// The first element of an ordered map not before key, converting key like findKey()
+template <typename Map, typename K>
+auto lowerBoundKey(Map& map, const K& key) {
+    if constexpr (isHeterogeneousLookup<Map, K>) {
+        return map.lower_bound(key);
+    } else {
+        return map.lower_bound(typename Map::key_type(key));
+    }
+}
+
+// The key itself (forwarded) if it already is a Key, otherwise a Key constructed from it
+template <typename Key, typename K>
+decltype(auto) toKey(K&& key) {
+    if constexpr (std::is_same_v<std::remove_cv_t<std::remove_reference_t<K>>, Key>) {
+        return std::forward<K>(key);
+    } else {
+        return Key(std::forward<K>(key));
+    }
+}
+
+template <typename Key, typename K>
+void assignKey(Key& target, K&& key) {
+    if constexpr (std::is_assignable_v<Key&, K&&>) {
+        target = std::forward<K>(key);
+    } else {
+        target = Key(std::forward<K>(key));
+    }
+}
+
+// Assigns a single argument directly when Value accepts it, otherwise a Value constructed from the arguments
+template <typename Value, typename... Args>
+void assignValue(Value& target, Args&&... args) {
+    if constexpr (sizeof...(Args) == 1 && (std::is_assignable_v<Value&, Args&&> && ...)) {
+        ((target = std::forward<Args>(args)), ...);
+    } else {
+        target = Value(std::forward<Args>(args)...);
+    }
+}
+
+} // namespace lrucache
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef LRUCACHE_MRC_H
+#define LRUCACHE_MRC_H
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cstdint>
+
+#include "lrucache.h"
+#include "lrucache_stats.h"
+
+namespace lrucache {
+
+// Online miss ratio curve of an LRU cache by SHARDS (Waldspurger et al., FAST '15): the keys whose 24 bit
+// hash is below a threshold are sampled (rate R = threshold / 2^24) and their LRU reuse distances, scaled
+// by 1/R, fill a histogram with the log buckets of LatencyHistogram. At most max_samples keys are tracked:
+// when there are more, the key with the largest hash is dropped and the threshold lowered to it, so the
+// memory stays constant. With the default rate 1 every key is sampled until max_samples keys are seen, then
+// the rate adapts. A sampled access costs a hash map lookup and two Fenwick tree updates, the other ones a hash.
+template <typename Key, typename Hash = std::hash<Key>>
+class ShardsEstimator {
+public:
+    static constexpr uint64_t kHashRange = uint64_t(1) << 24;
+
+    explicit ShardsEstimator(size_t max_samples = 8192, double rate = 1.0)
+        : max_samples_(std::max<size_t>(max_samples, 1))
+        , initial_threshold_(std::clamp<uint64_t>(static_cast<uint64_t>(rate * kHashRange), 1, kHashRange))
+        , threshold_(initial_threshold_)
+        , weights_(LatencyHistogram::kBuckets)
+    {
+        last_.reserve(max_samples_ + 1);
+        ticks_.assign(4 * max_samples_ + 1, 0);
+    }
+
+    template <typename K>
+    void access(const K& key) {
+        ++accesses_;
+        uint64_t h = mixHash(hashOf(key));
+        if ((h & (kHashRange - 1)) >= threshold_) {
+            return;
+        }
+        sample(h);
+    }
+
+    // Estimated hit ratio of an LRU cache of the capacity on the accesses seen so far. The sampled accesses
+    // of the popular keys are over or under represented, the difference between the weight of the samples and
+    // the number of the accesses is counted at the distance 0 (SHARDS_adj).
+    double hitRatio(size_t capacity) const {
+        if (accesses_ == 0 || capacity == 0) {
+            return 0.0;
+        }
+        double hits = static_cast<double>(accesses_) - total_;
+        for (size_t b = 0; b < weights_.size(); ++b) {
+            if (weights_[b] == 0) {
+                continue;
+            }
+            uint64_t lo = LatencyHistogram::lowerBound(b);
+            uint64_t hi = b + 1 < weights_.size() ? LatencyHistogram::lowerBound(b + 1) : UINT64_MAX;
+            if (hi <= capacity) {
+                hits += weights_[b];
+            } else if (lo < capacity) {
+                // the distances are taken as uniform in the bucket
+                hits += weights_[b] * static_cast<double>(capacity - lo) / static_cast<double>(hi - lo);
+            }
+        }
+        return std::clamp(hits / static_cast<double>(accesses_), 0.0, 1.0);
+    }
+
+    std::vector<double> hitRatios(const std::vector<size_t>& capacities) const {
+        std::vector<double> ratios;
+        ratios.reserve(capacities.size());
+        for (size_t capacity : capacities) {
+            ratios.push_back(hitRatio(capacity));
+        }
+        return ratios;
+    }
+
+    double samplingRate() const { return static_cast<double>(threshold_) / kHashRange; }
+    uint64_t accesses() const { return accesses_; }
+    uint64_t sampledAccesses() const { return sampled_; }
+    size_t trackedKeys() const { return last_.size(); }
+
+    void clear() {
+        last_.clear();
+        largest_ = {};
+        std::fill(ticks_.begin(), ticks_.end(), 0);
+        std::fill(weights_.begin(), weights_.end(), 0.0);
+        threshold_ = initial_threshold_;
+        now_ = 0;
+        total_ = 0;
+        accesses_ = 0;
+        sampled_ = 0;
+    }
+
+private:
+    size_t max_samples_;
+    uint64_t initial_threshold_;
+    uint64_t threshold_;
+    Hash hash_;
+
+    // the time of the last access of every tracked key (by its 64 bit hash)
+    std::unordered_map<uint64_t, size_t> last_;
+    // the tracked keys by their sampled hash, largest first
+    std::priority_queue<std::pair<uint64_t, uint64_t>> largest_;
+    // Fenwick tree over the times, 1 at the last access of every tracked key
+    std::vector<uint32_t> ticks_;
+    size_t now_{0};
+
+    std::vector<double> weights_;
+    double total_{0};
+    uint64_t accesses_{0};
+    uint64_t sampled_{0};
+
+    template <typename K>
+    size_t hashOf(const K& key) const {
+        if constexpr (std::is_invocable_v<const Hash&, const K&>) {
+            return hash_(key);
+        } else {
+            return hash_(Key(key));
+        }
+    }
+
+    void add(size_t time, int delta) {
+        for (size_t i = time + 1; i < ticks_.size(); i += i & (~i + 1)) {
+            ticks_[i] += delta;
+        }
+    }
+
+    // Number of the marks at the times 0..time-1
+    size_t prefix(size_t time) const {
+        size_t sum = 0;
+        for (size_t i = time; i > 0; i -= i & (~i + 1)) {
+            sum += ticks_[i];
+        }
+        return sum;
+    }
+
+    void sample(uint64_t h) {
+        if (now_ + 1 == ticks_.size()) {
+            renumber();
+        }
+        ++sampled_;
+        double weight = 1.0 / samplingRate();
+        total_ += weight;
+
+        auto it = last_.find(h);
+        if (it == last_.end()) {
+            // a cold miss
+            last_.emplace(h, now_);
+            largest_.emplace(h & (kHashRange - 1), h);
+            if (last_.size() > max_samples_) {
+                dropLargest();
+                if (last_.count(h) == 0) {
+                    return;
+                }
+            }
+        } else {
+            // the distinct keys accessed since the last access of this one
+            size_t distance = prefix(now_) - prefix(it->second + 1);
+            weights_[LatencyHistogram::bucketOf(static_cast<uint64_t>(distance * weight))] += weight;
+            add(it->second, -1);
+            it->second = now_;
+        }
+        add(now_, 1);
+        ++now_;
+    }
+
+    // Lowers the threshold to the largest sampled hash, dropping all the keys having it
+    void dropLargest() {
+        threshold_ = largest_.top().first;
+        while (!largest_.empty() && largest_.top().first >= threshold_) {
+            auto found = last_.find(largest_.top().second);
+            if (found != last_.end()) {
+                if (found->second < now_) {
+                    add(found->second, -1);
+                }
+                last_.erase(found);
+            }
+            largest_.pop();
+        }
+    }
+
+    // Moves the last accesses to the times 0..n-1 keeping their order
+    void renumber() {
+        std::vector<std::pair<size_t, uint64_t>> live;
+        live.reserve(last_.size());
+        for (auto& [h, time] : last_) {
+            live.emplace_back(time, h);
+        }
+        std::sort(live.begin(), live.end());
+        std::fill(ticks_.begin(), ticks_.end(), 0);
+        for (size_t i = 0; i < live.size(); ++i) {
+            last_[live[i].second] = i;
+            add(i, 1);
+        }
+        now_ = live.size();
+    }
+};
+
+// Stats policy adding a ShardsEstimator to Counters (CacheStats by default), fed with the keys looked up
+// (get, getPtr, getMany), see LRUCache::statsPolicy(). Not thread safe.
+template <typename Key, typename Counters = CacheStats, typename Hash = std::hash<Key>>
+class MissRatioCurveStats : public Counters {
+public:
+    static constexpr bool kThreadSafe = false;
+
+    explicit MissRatioCurveStats(size_t max_samples = 8192, double rate = 1.0)
+        : estimator_(max_samples, rate)
+    {
+
+    }
+
+    template <typename K>
+    void recordAccess(const K& key) { estimator_.access(key); }
+
+    // Estimated hit ratio of the cache if its capacity were capacity
+    double hitRatioAt(size_t capacity) const { return estimator_.hitRatio(capacity); }
+
+    const ShardsEstimator<Key, Hash>& estimator() const { return estimator_; }
+
+    void reset() {
+        Counters::reset();
+        estimator_.clear();
+    }
+
+private:
+    ShardsEstimator<Key, Hash> estimator_;
+};
+
+} // namespace lrucache
+
+#endif
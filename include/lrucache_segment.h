@@ -0,0 +1,122 @@
+#ifndef LRUCACHE_SEGMENT_H
+#define LRUCACHE_SEGMENT_H
+
+#include <optional>
+#include <utility>
+#include <functional>
+#include <cstdint>
+
+#include "lrucache.h"
+#include "lrucache_flat.h"
+
+namespace lrucache {
+
+// LRUCache<Base> opening the access to its least recently used end, a building block of the caches
+// made of several LRU lists (a window and a main segment, probation and protected segments...)
+template <typename Base>
+class LRUSegment : public LRUCache<Base> {
+    using Cache = LRUCache<Base>;
+    using Key = typename Cache::TKey;
+    using Value = typename Cache::TValue;
+
+    using Cache::val;
+    using Cache::removeNode;
+    using Cache::max_size_;
+    using Cache::kv_;
+    using Cache::first_;
+    using Cache::last_;
+
+public:
+    using Cache::Cache;
+
+    bool full() const { return kv_.size() >= max_size_; }
+    bool empty() const { return kv_.size() == 0; }
+
+    // Key of the least recently used element, nullptr if the segment is empty
+    const Key* lruKey() const {
+        return last_ != kv_.end() ? &last_->first : nullptr;
+    }
+
+    // Value of the most recently used element (the one just added), the segment must not be empty
+    Value& mruValue() {
+        return val(first_);
+    }
+
+    // Removes the least recently used element and returns it, the segment must not be empty
+    std::pair<Key, Value> popLru() {
+        std::pair<Key, Value> pair(last_->first, std::move(val(last_)));
+        removeNode(last_);
+        return pair;
+    }
+
+    // Removes the element if present, returns false if it was not
+    template <typename K>
+    bool remove(const K& key) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return false;
+        }
+        removeNode(it);
+        return true;
+    }
+
+    // Replaces the value of an existing element without promoting it, returns false if the key is missing
+    template <typename K, typename V>
+    bool assign(const K& key, V&& value) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return false;
+        }
+        assignValue(val(it), std::forward<V>(value));
+        return true;
+    }
+
+    // Removes the element if present and returns its value
+    template <typename K>
+    std::optional<Value> take(const K& key) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return {};
+        }
+        std::optional<Value> value(std::move(val(it)));
+        removeNode(it);
+        return value;
+    }
+
+};
+
+// Keys recently evicted from a cache (the ghost entries of 2Q and ARC) in LRU order. Only a 64 bit hash of
+// every key is kept, in a BaseFlat segment allocated up front, so a colliding key may be taken for a ghost.
+template <typename Key, typename Hash = std::hash<Key>>
+class GhostList {
+public:
+    explicit GhostList(size_t max_size)
+        : hashes_(max_size)
+    {
+
+    }
+
+    bool contains(const Key& key) const { return hashes_.contains(hashOf(key)); }
+
+    // Inserts the key as the most recent one, dropping the oldest key of a full list
+    void add(const Key& key) { hashes_.add(hashOf(key), true); }
+
+    bool remove(const Key& key) { return hashes_.remove(hashOf(key)); }
+
+    // Drops the oldest key, the list must not be empty
+    void popLru() { hashes_.popLru(); }
+
+    void clear() { hashes_.clear(); }
+    size_t size() const { return hashes_.size(); }
+    bool empty() const { return hashes_.empty(); }
+
+private:
+    LRUSegment<BaseFlat<uint64_t, bool>> hashes_;
+    Hash hash_;
+
+    uint64_t hashOf(const Key& key) const { return mixHash(hash_(key)); }
+};
+
+} // namespace lrucache
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef LRUCACHE_SHARDED_H
+#define LRUCACHE_SHARDED_H
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// Thread safe LRU cache, the keys are hashed across N independently locked LRUCache<Base> shards.
+// Each shard runs its own LRU list, so the eviction order is exact only within a shard.
+// Every shard gets a copy of the removal listener, which is called under the shard lock,
+// except a BatchedRemovalListener: its removals are dispatched after the lock is released.
+// Every shard keeps its own Stats (updated under the shard lock), stats() sums them.
+template <typename Base, size_t N = 16, typename Listener = NoRemovalListener, typename Stats = NoStats>
+class ShardedLRUCache {
+public:
+    using Cache = LRUCache<Base, Listener, Stats>;
+    using TKey = typename Cache::TKey;
+    using TValue = typename Cache::TValue;
+
+private:
+    using Key = TKey;
+    using Value = TValue;
+    using Pair = std::pair<Key, Value>;
+
+    static_assert(N > 0, "ShardedLRUCache needs at least one shard");
+
+    // Aligned to keep the mutexes of the neighbouring shards in separate cache lines
+    struct alignas(64) Shard {
+        Shard(size_t max_size, const Listener& listener)
+            : cache_(max_size)
+        {
+            if constexpr (hasRemovalListener<Listener>) {
+                cache_.removalListener() = listener;
+            }
+        }
+
+        mutable std::mutex mutex_;
+        Cache cache_;
+    };
+
+    std::atomic<size_t> max_size_{0};
+    std::array<std::unique_ptr<Shard>, N> shards_;
+
+    static size_t shardSize(size_t max_size, size_t i) {
+        return std::max<size_t>(max_size / N + (i < max_size % N ? 1 : 0), 1);
+    }
+
+    Shard& shardFor(const Key& key) const {
+        if constexpr (N == 1) {
+            return *shards_[0];
+        } else {
+            return *shards_[mixHash(std::hash<Key>{}(key)) % N];
+        }
+    }
+
+    // Hands the removals queued by a batched listener over after releasing the shard lock
+    static void unlockAndDispatch(Shard& shard, std::unique_lock<std::mutex>& lock) {
+        if constexpr (isBatchedRemovalListener<Listener>) {
+            auto batch = shard.cache_.removalListener().take();
+            lock.unlock();
+            shard.cache_.removalListener().dispatch(std::move(batch));
+        }
+    }
+
+public:
+    // The capacity is split evenly, every shard holds at least one element
+    explicit ShardedLRUCache(size_t max_size, const Listener& listener = Listener())
+        : max_size_(max_size)
+    {
+        for (size_t i = 0; i < N; ++i) {
+            shards_[i] = std::make_unique<Shard>(shardSize(max_size, i), listener);
+        }
+    }
+
+    bool add(const Key& key, const Value& value) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        bool existed = shard.cache_.add(key, value);
+        unlockAndDispatch(shard, lock);
+        return existed;
+    }
+
+    bool add(Key&& key, Value&& value) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        bool existed = shard.cache_.add(std::move(key), std::move(value));
+        unlockAndDispatch(shard, lock);
+        return existed;
+    }
+
+    // See LRUCache::emplace(), the value is constructed under the shard lock
+    template <typename K, typename... Args>
+    bool emplace(K&& key, Args&&... args) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        bool existed = shard.cache_.emplace(std::forward<K>(key), std::forward<Args>(args)...);
+        unlockAndDispatch(shard, lock);
+        return existed;
+    }
+
+    // See LRUCache::tryEmplace()
+    template <typename K, typename... Args>
+    bool tryEmplace(K&& key, Args&&... args) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        bool inserted = shard.cache_.tryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+        unlockAndDispatch(shard, lock);
+        return inserted;
+    }
+
+    // May evict after setMaxSize() shrank the cache, so the removals are dispatched like by the writers
+    std::optional<Value> get(const Key& key) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        auto value = shard.cache_.get(key);
+        unlockAndDispatch(shard, lock);
+        return value;
+    }
+
+    // Does not change the LRU order
+    std::optional<Value> peek(const Key& key) const {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex_);
+        return shard.cache_.peek(key);
+    }
+
+    // Calls fn(value) on the stored value under the shard lock, see LRUCache::visit()
+    template <typename F>
+    bool visit(const Key& key, F&& fn) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        bool found = shard.cache_.visit(key, std::forward<F>(fn));
+        unlockAndDispatch(shard, lock);
+        return found;
+    }
+
+    bool erase(const Key& key) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex_);
+        bool erased = shard.cache_.erase(key);
+        unlockAndDispatch(shard, lock);
+        return erased;
+    }
+
+    // See LRUCache::invalidateIf(), the shards are swept one by one under their lock (pred is called
+    // concurrently with the operations on the other shards)
+    template <typename Pred>
+    size_t invalidateIf(Pred&& pred) {
+        size_t removed = 0;
+        for (auto& shard : shards_) {
+            std::unique_lock<std::mutex> lock(shard->mutex_);
+            removed += shard->cache_.invalidateIf(pred);
+            unlockAndDispatch(*shard, lock);
+        }
+        return removed;
+    }
+
+    void clear() {
+        for (auto& shard : shards_) {
+            std::unique_lock<std::mutex> lock(shard->mutex_);
+            shard->cache_.clear();
+            unlockAndDispatch(*shard, lock);
+        }
+    }
+
+    // Not atomic with respect to the concurrent writers, the shards are visited one by one
+    size_t size() const {
+        size_t total = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex_);
+            total += shard->cache_.size();
+        }
+        return total;
+    }
+
+    size_t maxSize() const { return max_size_; }
+
+    // Splits the new capacity like the constructor, see LRUCache::setMaxSize(): the shards above their
+    // new size are trimmed by the following operations on them, a few elements each
+    void setMaxSize(size_t max_size) {
+        max_size_ = max_size;
+        for (size_t i = 0; i < N; ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i]->mutex_);
+            shards_[i]->cache_.setMaxSize(shardSize(max_size, i));
+        }
+    }
+
+    static constexpr size_t shardCount() { return N; }
+
+    // Sum of the shard statistics, not atomic with respect to the concurrent operations like size()
+    StatsSnapshot stats() const {
+        StatsSnapshot total;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex_);
+            total += shard->cache_.stats();
+        }
+        return total;
+    }
+
+    void resetStats() {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex_);
+            shard->cache_.resetStats();
+        }
+    }
+
+    // Approximate order: the per shard MRU lists are interleaved round robin
+    std::vector<Key> getMRUKeys(size_t n) const {
+        return interleave<Key>(n, [n](const Cache& cache) { return cache.getMRUKeys(n); });
+    }
+
+    // Approximate order: the per shard MRU lists are interleaved round robin
+    std::vector<Pair> getMRU(size_t n) const {
+        return interleave<Pair>(n, [n](const Cache& cache) { return cache.getMRU(n); });
+    }
+
+private:
+    // Takes the first n elements of every shard list (one shard locked at a time) and merges them round robin
+    template <typename T, typename F>
+    std::vector<T> interleave(size_t n, F&& listOf) const {
+        std::array<std::vector<T>, N> parts;
+        size_t total = 0;
+        for (size_t i = 0; i < N; ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i]->mutex_);
+            parts[i] = listOf(shards_[i]->cache_);
+            total += parts[i].size();
+        }
+
+        std::vector<T> v;
+        v.reserve(std::min(n, total));
+        for (size_t rank = 0; v.size() < n; ++rank) {
+            bool any = false;
+            for (size_t i = 0; i < N && v.size() < n; ++i) {
+                if (rank < parts[i].size()) {
+                    v.push_back(std::move(parts[i][rank]));
+                    any = true;
+                }
+            }
+            if (!any) {
+                break;
+            }
+        }
+        return v;
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef LRUCACHE_SHM_H
+#define LRUCACHE_SHM_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// LRU cache living in a memory mapped file shared by several processes (a file in /dev/shm keeps it in memory only).
+// The segment is a header and Shards shards, each one a fixed array of slots, a hash index of chains and
+// a process shared robust mutex: the links are slot indices instead of pointers, so every process may map the
+// segment at its own address. Key and Value must be trivially copyable and Hash must give the same hash in all
+// the processes (std::hash of an integer does). A process dying with a shard locked leaves it possibly
+// inconsistent, the next process locking it clears it. POSIX only (robust mutexes: Linux, FreeBSD).
+template <typename Key, typename Value, size_t Shards = 16, typename Hash = std::hash<Key>>
+class SharedLRUCache {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+        "SharedLRUCache stores the keys and the values as bytes");
+    static_assert(Shards > 0, "SharedLRUCache needs a shard");
+
+    static constexpr uint32_t kNone = UINT32_MAX;
+    static constexpr char kMagic[8] = {'L', 'R', 'U', 'S', 'H', 'M', '1', '\0'};
+
+    struct Slot {
+        Key key_;
+        Value value_;
+        uint32_t prev_;
+        uint32_t next_;
+        // the next slot of the same bucket
+        uint32_t chain_;
+    };
+
+    struct alignas(64) ShardHeader {
+        pthread_mutex_t mutex_;
+        uint32_t first_;
+        uint32_t last_;
+        uint32_t free_;
+        uint32_t size_;
+    };
+
+    struct Header {
+        char magic_[8];
+        uint64_t max_size_;
+        uint32_t shards_;
+        uint32_t key_size_;
+        uint32_t value_size_;
+        uint32_t capacity_;
+        uint32_t buckets_;
+        uint64_t shard_bytes_;
+    };
+
+    // Views of a shard inside the mapping
+    struct Shard {
+        ShardHeader* header_;
+        uint32_t* buckets_;
+        Slot* slots_;
+    };
+
+    class ShardLock {
+    public:
+        ShardLock(const SharedLRUCache& cache, const Shard& shard)
+            : mutex_(&shard.header_->mutex_)
+        {
+            if (pthread_mutex_lock(mutex_) == EOWNERDEAD) {
+                cache.reset(shard);
+                pthread_mutex_consistent(mutex_);
+            }
+        }
+
+        ~ShardLock() { pthread_mutex_unlock(mutex_); }
+
+        ShardLock(const ShardLock&) = delete;
+        ShardLock& operator=(const ShardLock&) = delete;
+
+    private:
+        pthread_mutex_t* mutex_;
+    };
+
+    size_t max_size_;
+    uint32_t capacity_{0};
+    uint32_t buckets_{0};
+    size_t shard_bytes_{0};
+    char* data_{nullptr};
+    size_t length_{0};
+    Hash hash_;
+
+    static size_t alignUp(size_t n) { return (n + 63) & ~size_t(63); }
+
+    Header* header() const { return reinterpret_cast<Header*>(data_); }
+
+    Shard shardAt(size_t index) const {
+        char* base = data_ + alignUp(sizeof(Header)) + index * shard_bytes_;
+        auto* buckets = reinterpret_cast<uint32_t*>(base + alignUp(sizeof(ShardHeader)));
+        auto* slots = reinterpret_cast<Slot*>(base + alignUp(sizeof(ShardHeader)) + alignUp(sizeof(uint32_t) * buckets_));
+        return {reinterpret_cast<ShardHeader*>(base), buckets, slots};
+    }
+
+    uint64_t hashOf(const Key& key) const { return mixHash(hash_(key)); }
+
+    Shard shardOf(uint64_t h) const { return shardAt((h >> 32) % Shards); }
+
+    uint32_t& bucketOf(const Shard& shard, uint64_t h) const { return shard.buckets_[h & (buckets_ - 1)]; }
+
+    // Empties the shard: every slot on the free list
+    void reset(const Shard& shard) const {
+        std::fill(shard.buckets_, shard.buckets_ + buckets_, kNone);
+        for (uint32_t i = 0; i < capacity_; ++i) {
+            shard.slots_[i].next_ = i + 1 < capacity_ ? i + 1 : kNone;
+        }
+        shard.header_->first_ = kNone;
+        shard.header_->last_ = kNone;
+        shard.header_->free_ = capacity_ > 0 ? 0 : kNone;
+        shard.header_->size_ = 0;
+    }
+
+    uint32_t find(const Shard& shard, const Key& key, uint64_t h) const {
+        for (uint32_t i = bucketOf(shard, h); i != kNone; i = shard.slots_[i].chain_) {
+            if (shard.slots_[i].key_ == key) {
+                return i;
+            }
+        }
+        return kNone;
+    }
+
+    void unlink(const Shard& shard, uint32_t i) {
+        Slot& slot = shard.slots_[i];
+        if (slot.prev_ != kNone) {
+            shard.slots_[slot.prev_].next_ = slot.next_;
+        } else {
+            shard.header_->first_ = slot.next_;
+        }
+        if (slot.next_ != kNone) {
+            shard.slots_[slot.next_].prev_ = slot.prev_;
+        } else {
+            shard.header_->last_ = slot.prev_;
+        }
+    }
+
+    void linkFront(const Shard& shard, uint32_t i) {
+        Slot& slot = shard.slots_[i];
+        slot.prev_ = kNone;
+        slot.next_ = shard.header_->first_;
+        if (slot.next_ != kNone) {
+            shard.slots_[slot.next_].prev_ = i;
+        } else {
+            shard.header_->last_ = i;
+        }
+        shard.header_->first_ = i;
+    }
+
+    void moveToFront(const Shard& shard, uint32_t i) {
+        if (shard.header_->first_ != i) {
+            unlink(shard, i);
+            linkFront(shard, i);
+        }
+    }
+
+    void removeFromBucket(const Shard& shard, uint32_t i) {
+        uint32_t* link = &bucketOf(shard, hashOf(shard.slots_[i].key_));
+        while (*link != i) {
+            link = &shard.slots_[*link].chain_;
+        }
+        *link = shard.slots_[i].chain_;
+    }
+
+    // Maps the file and initializes it if it is new, under an exclusive flock() against the other processes
+    bool open(const std::string& path) {
+        capacity_ = static_cast<uint32_t>((max_size_ + Shards - 1) / Shards);
+        buckets_ = 1;
+        while (buckets_ < 2 * capacity_) {
+            buckets_ *= 2;
+        }
+        shard_bytes_ = alignUp(sizeof(ShardHeader)) + alignUp(sizeof(uint32_t) * buckets_) + alignUp(sizeof(Slot) * capacity_);
+        length_ = alignUp(sizeof(Header)) + Shards * shard_bytes_;
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        if (::flock(fd, LOCK_EX) != 0) {
+            ::close(fd);
+            return false;
+        }
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0;
+        if (ok && st.st_size == 0) {
+            ok = ::ftruncate(fd, static_cast<off_t>(length_)) == 0;
+        } else if (ok && static_cast<size_t>(st.st_size) != length_) {
+            ok = false;
+        }
+        void* data = ok ? ::mmap(nullptr, length_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        if (data != MAP_FAILED) {
+            data_ = static_cast<char*>(data);
+            bool initialized = std::memcmp(header()->magic_, kMagic, sizeof(kMagic)) == 0;
+            ok = initialized ? matches() : initialize();
+            if (!ok) {
+                ::munmap(data_, length_);
+                data_ = nullptr;
+            }
+        }
+        ::flock(fd, LOCK_UN);
+        ::close(fd);
+        return data_ != nullptr;
+    }
+
+    bool initialize() {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        bool ok = true;
+        for (size_t i = 0; i < Shards; ++i) {
+            Shard shard = shardAt(i);
+            ok = ok && pthread_mutex_init(&shard.header_->mutex_, &attr) == 0;
+            reset(shard);
+        }
+        pthread_mutexattr_destroy(&attr);
+        if (!ok) {
+            return false;
+        }
+        Header* h = header();
+        h->max_size_ = max_size_;
+        h->shards_ = Shards;
+        h->key_size_ = sizeof(Key);
+        h->value_size_ = sizeof(Value);
+        h->capacity_ = capacity_;
+        h->buckets_ = buckets_;
+        h->shard_bytes_ = shard_bytes_;
+        // the magic last: a segment whose creator died half way is initialized again by the next process
+        std::memcpy(h->magic_, kMagic, sizeof(kMagic));
+        return true;
+    }
+
+    bool matches() const {
+        const Header* h = header();
+        return h->max_size_ == max_size_ && h->shards_ == Shards
+            && h->key_size_ == sizeof(Key) && h->value_size_ == sizeof(Value)
+            && h->capacity_ == capacity_ && h->buckets_ == buckets_ && h->shard_bytes_ == shard_bytes_;
+    }
+
+public:
+    using TKey = Key;
+    using TValue = Value;
+
+    // Maps the segment at path, creating it if the file is missing or empty. An existing segment must have been
+    // created with the same max_size, Shards, Key and Value, otherwise (or on an I/O error) isOpen() is false.
+    // Every shard holds max_size / Shards elements, rounded up (see maxSize()).
+    SharedLRUCache(const std::string& path, size_t max_size)
+        : max_size_(max_size)
+    {
+        if (max_size > 0 && (max_size + Shards - 1) / Shards < kNone / 2) {
+            open(path);
+        }
+    }
+
+    ~SharedLRUCache() {
+        if (data_) {
+            ::munmap(data_, length_);
+        }
+    }
+
+    SharedLRUCache(const SharedLRUCache&) = delete;
+    SharedLRUCache& operator=(const SharedLRUCache&) = delete;
+
+    bool isOpen() const { return data_ != nullptr; }
+
+    // Returns true if the key existed (its value is replaced), a new key evicts the least recently used
+    // element of its shard when the shard is full
+    bool add(const Key& key, const Value& value) {
+        uint64_t h = hashOf(key);
+        Shard shard = shardOf(h);
+        ShardLock lock(*this, shard);
+        uint32_t i = find(shard, key, h);
+        if (i != kNone) {
+            shard.slots_[i].value_ = value;
+            moveToFront(shard, i);
+            return true;
+        }
+        ShardHeader& sh = *shard.header_;
+        if (sh.free_ != kNone) {
+            i = sh.free_;
+            sh.free_ = shard.slots_[i].next_;
+            ++sh.size_;
+        } else {
+            // reuse the last_
+            i = sh.last_;
+            removeFromBucket(shard, i);
+            unlink(shard, i);
+        }
+        Slot& slot = shard.slots_[i];
+        slot.key_ = key;
+        slot.value_ = value;
+        slot.chain_ = bucketOf(shard, h);
+        bucketOf(shard, h) = i;
+        linkFront(shard, i);
+        return false;
+    }
+
+    std::optional<Value> get(const Key& key) {
+        uint64_t h = hashOf(key);
+        Shard shard = shardOf(h);
+        ShardLock lock(*this, shard);
+        uint32_t i = find(shard, key, h);
+        if (i == kNone) {
+            return {};
+        }
+        moveToFront(shard, i);
+        return shard.slots_[i].value_;
+    }
+
+    // Does not change the LRU order
+    std::optional<Value> peek(const Key& key) const {
+        uint64_t h = hashOf(key);
+        Shard shard = shardOf(h);
+        ShardLock lock(*this, shard);
+        uint32_t i = find(shard, key, h);
+        if (i == kNone) {
+            return {};
+        }
+        return shard.slots_[i].value_;
+    }
+
+    // Promotes the element like get() and calls fn(value) on the stored value under the lock of its shard.
+    // Returns false if the key is missing. fn must not call the cache.
+    template <typename F>
+    bool visit(const Key& key, F&& fn) {
+        uint64_t h = hashOf(key);
+        Shard shard = shardOf(h);
+        ShardLock lock(*this, shard);
+        uint32_t i = find(shard, key, h);
+        if (i == kNone) {
+            return false;
+        }
+        moveToFront(shard, i);
+        std::forward<F>(fn)(shard.slots_[i].value_);
+        return true;
+    }
+
+    bool contains(const Key& key) const {
+        return peek(key).has_value();
+    }
+
+    // Clears the segment for all the processes
+    void clear() {
+        for (size_t s = 0; s < Shards; ++s) {
+            Shard shard = shardAt(s);
+            ShardLock lock(*this, shard);
+            reset(shard);
+        }
+    }
+
+    // The shards are counted one after the other, the sum is not a snapshot under concurrent changes
+    size_t size() const {
+        size_t n = 0;
+        for (size_t s = 0; s < Shards; ++s) {
+            Shard shard = shardAt(s);
+            ShardLock lock(*this, shard);
+            n += shard.header_->size_;
+        }
+        return n;
+    }
+
+    // max_size rounded up to a multiple of Shards
+    size_t maxSize() const { return size_t(capacity_) * Shards; }
+
+    // The keys of the shard of key, most recently used first (the shards have separate LRU orders)
+    std::vector<Key> getShardMRUKeys(const Key& key, size_t n) const {
+        Shard shard = shardOf(hashOf(key));
+        ShardLock lock(*this, shard);
+        std::vector<Key> keys;
+        for (uint32_t i = shard.header_->first_; i != kNone && keys.size() < n; i = shard.slots_[i].next_) {
+            keys.push_back(shard.slots_[i].key_);
+        }
+        return keys;
+    }
+};
+
+} // namespace lrucache
+
+#endif
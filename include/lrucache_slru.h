@@ -0,0 +1,150 @@
+#ifndef LRUCACHE_SLRU_H
+#define LRUCACHE_SLRU_H
+
+#include <vector>
+#include <optional>
+#include <utility>
+#include <algorithm>
+
+#include "lrucache.h"
+#include "lrucache_segment.h"
+
+namespace lrucache {
+
+// Segmented LRU cache (use BaseVal, BaseUniqPtr or BaseFlat): new keys enter the probation segment and
+// move to the protected segment (80% of the capacity by default) when they are accessed again, the least
+// recently used protected element going back to the probation. The victim is the least recently used
+// probation element, so keys seen once can't evict the ones used repeatedly.
+// Either segment may hold the whole capacity (the probation one while nothing was accessed twice), so each is
+// allocated for it: the maps (and a BaseFlat) take about 1.8 times the memory of an LRUCache of the same size.
+template <typename Base>
+class SLRUCache {
+public:
+    using TKey = typename LRUCache<Base>::TKey;
+    using TValue = typename LRUCache<Base>::TValue;
+
+private:
+    using Key = TKey;
+    using Value = TValue;
+    using Pair = std::pair<Key, Value>;
+    using Segment = LRUSegment<Base>;
+
+    size_t max_size_;
+    Segment probation_;
+    Segment protected_;
+
+    // Inserts an element accessed again into the protected segment
+    template <typename K>
+    void protect(K&& key, Value&& value) {
+        if (protected_.full()) {
+            Pair demoted = protected_.popLru();
+            probation_.add(std::move(demoted.first), std::move(demoted.second));
+        }
+        protected_.add(std::forward<K>(key), std::move(value));
+    }
+
+    template <typename K, typename V>
+    bool put(K&& key, V&& value) {
+        if (protected_.contains(key)) {
+            return protected_.add(std::forward<K>(key), std::forward<V>(value));
+        }
+        if (probation_.remove(key)) {
+            protect(std::forward<K>(key), Value(std::forward<V>(value)));
+            return true;
+        }
+        if (full()) {
+            popLru();
+        }
+        probation_.add(std::forward<K>(key), std::forward<V>(value));
+        return false;
+    }
+
+public:
+    explicit SLRUCache(size_t max_size)
+        : SLRUCache(max_size, max_size * 8 / 10)
+    {
+
+    }
+
+    SLRUCache(size_t max_size, size_t protected_size)
+        : max_size_(max_size)
+        , probation_(max_size)
+        , protected_(std::clamp<size_t>(protected_size, 1, std::max<size_t>(max_size, 1)))
+    {
+
+    }
+
+    bool add(const Key& key, const Value& value) {
+        return put(key, value);
+    }
+
+    bool add(Key&& key, Value&& value) {
+        return put(std::move(key), std::move(value));
+    }
+
+    std::optional<Value> get(const Key& key) {
+        if (auto value = protected_.get(key)) {
+            return value;
+        }
+        std::optional<Value> value = probation_.take(key);
+        if (!value) {
+            return {};
+        }
+        // the value is moved between the segments, the only copy is the one returned
+        protect(key, std::move(*value));
+        return protected_.mruValue();
+    }
+
+    bool contains(const Key& key) const {
+        return protected_.contains(key) || probation_.contains(key);
+    }
+
+    std::optional<Value> peek(const Key& key) const {
+        if (auto value = protected_.peek(key)) {
+            return value;
+        }
+        return probation_.peek(key);
+    }
+
+    void clear() {
+        probation_.clear();
+        protected_.clear();
+    }
+
+    size_t size() const { return probation_.size() + protected_.size(); }
+    size_t maxSize() const { return max_size_; }
+    bool full() const { return size() >= max_size_; }
+
+    // Key of the next victim, nullptr if the cache is empty
+    const Key* lruKey() const {
+        return probation_.empty() ? protected_.lruKey() : probation_.lruKey();
+    }
+
+    // Removes the next victim and returns it, the cache must not be empty
+    Pair popLru() {
+        return probation_.empty() ? protected_.popLru() : probation_.popLru();
+    }
+
+    // Approximate order: the protected elements precede the probation ones
+    std::vector<Key> getMRUKeys(size_t n) const {
+        std::vector<Key> v = protected_.getMRUKeys(n);
+        for (auto& key : probation_.getMRUKeys(n - v.size())) {
+            v.push_back(std::move(key));
+        }
+        return v;
+    }
+
+    // Approximate order: the protected elements precede the probation ones
+    std::vector<Pair> getMRU(size_t n) const {
+        std::vector<Pair> v = protected_.getMRU(n);
+        for (auto& pair : probation_.getMRU(n - v.size())) {
+            v.push_back(std::move(pair));
+        }
+        return v;
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
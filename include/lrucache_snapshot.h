@@ -0,0 +1,326 @@
+#ifndef LRUCACHE_SNAPSHOT_H
+#define LRUCACHE_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <type_traits>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LRUCACHE_SNAPSHOT_MMAP
+#endif
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// Binary form of the keys and the values in a snapshot. A specialization provides
+//   static size_t size(const T&)                                  bytes written by write()
+//   static char* write(const T&, char* out)                      returns the end of the bytes written
+//   static bool read(const char*& in, const char* end, T& out)  false if the bytes are cut short
+// The trivially copyable types are copied as is (in the byte order of the machine), std::basic_string
+// is its length (LEB128) then its characters. read() assigns into a default constructed T.
+template <typename T, typename = void>
+struct SnapshotSerializer;
+
+template <typename T>
+struct SnapshotSerializer<T, std::enable_if_t<std::is_trivially_copyable_v<T>>> {
+    static size_t size(const T&) { return sizeof(T); }
+
+    static char* write(const T& value, char* out) {
+        std::memcpy(out, &value, sizeof(T));
+        return out + sizeof(T);
+    }
+
+    static bool read(const char*& in, const char* end, T& value) {
+        if (static_cast<size_t>(end - in) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, in, sizeof(T));
+        in += sizeof(T);
+        return true;
+    }
+};
+
+template <typename Char, typename Traits, typename Alloc>
+struct SnapshotSerializer<std::basic_string<Char, Traits, Alloc>, std::enable_if_t<std::is_trivially_copyable_v<Char>>> {
+    using String = std::basic_string<Char, Traits, Alloc>;
+
+    static size_t size(const String& s) {
+        size_t bytes = s.size() * sizeof(Char);
+        size_t n = 1;
+        for (uint64_t length = s.size(); length >= 0x80; length >>= 7) {
+            ++n;
+        }
+        return n + bytes;
+    }
+
+    static char* write(const String& s, char* out) {
+        uint64_t length = s.size();
+        for (; length >= 0x80; length >>= 7) {
+            *out++ = static_cast<char>(length | 0x80);
+        }
+        *out++ = static_cast<char>(length);
+        std::memcpy(out, s.data(), s.size() * sizeof(Char));
+        return out + s.size() * sizeof(Char);
+    }
+
+    static bool read(const char*& in, const char* end, String& s) {
+        uint64_t length = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            if (in == end || shift > 63) {
+                return false;
+            }
+            uint8_t byte = static_cast<uint8_t>(*in++);
+            length |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        if (length > static_cast<uint64_t>(end - in) / sizeof(Char)) {
+            return false;
+        }
+        s.resize(length);
+        std::memcpy(s.data(), in, length * sizeof(Char));
+        in += length * sizeof(Char);
+        return true;
+    }
+};
+
+// Checksum of the snapshot payload, fed in pieces of any size. Every step is a bijection of the state
+// and of the 64 bit word, so a corrupted word always changes the result.
+class SnapshotChecksum {
+public:
+    void update(const char* data, size_t n) {
+        length_ += n;
+        if (pending_ > 0) {
+            size_t take = std::min(n, sizeof(uint64_t) - pending_);
+            std::memcpy(tail_ + pending_, data, take);
+            pending_ += take;
+            data += take;
+            n -= take;
+            if (pending_ < sizeof(uint64_t)) {
+                return;
+            }
+            mix(load(tail_));
+            pending_ = 0;
+        }
+        for (; n >= sizeof(uint64_t); data += sizeof(uint64_t), n -= sizeof(uint64_t)) {
+            mix(load(data));
+        }
+        std::memcpy(tail_, data, n);
+        pending_ = n;
+    }
+
+    uint64_t value() const {
+        SnapshotChecksum last = *this;
+        if (pending_ > 0) {
+            std::memset(last.tail_ + pending_, 0, sizeof(uint64_t) - pending_);
+            last.mix(load(last.tail_));
+        }
+        return mixHash(last.state_ ^ length_);
+    }
+
+private:
+    uint64_t state_{0x243f6a8885a308d3ULL};
+    uint64_t length_{0};
+    char tail_[sizeof(uint64_t)];
+    size_t pending_{0};
+
+    static uint64_t load(const char* data) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        return word;
+    }
+
+    void mix(uint64_t word) {
+        uint64_t h = state_ ^ (word * 0x9e3779b97f4a7c15ULL);
+        state_ = ((h << 31) | (h >> 33)) * 0xc2b2ae3d27d4eb4fULL;
+    }
+};
+
+// Layout of a snapshot file: this header, then count keys and values in MRU order (see SnapshotSerializer)
+struct SnapshotHeader {
+    static constexpr char kMagic[8] = {'L', 'R', 'U', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr uint32_t kVersion = 1;
+    // written in the byte order of the machine, a file from a machine of the other order is rejected
+    static constexpr uint32_t kByteOrder = 0x01020304;
+
+    char magic_[8];
+    uint32_t version_;
+    uint32_t byte_order_;
+    uint64_t count_;
+    uint64_t payload_size_;
+    uint64_t checksum_;
+};
+
+// The implementation of LRUCache::saveSnapshot() and LRUCache::loadSnapshot()
+template <typename Cache>
+struct SnapshotIO {
+    using Key = typename Cache::Key;
+    using Value = typename Cache::Value;
+    using MapIter = typename Cache::MapIter;
+
+    static constexpr size_t kBufferSize = 1 << 20;
+
+    // Written to path + ".tmp" then renamed, so an existing snapshot is replaced only by a complete one
+    static bool save(const Cache& cache, const std::string& path) {
+        std::string tmp_path = path + ".tmp";
+        std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        SnapshotHeader header{};
+        std::memcpy(header.magic_, SnapshotHeader::kMagic, sizeof(header.magic_));
+        header.version_ = SnapshotHeader::kVersion;
+        header.byte_order_ = SnapshotHeader::kByteOrder;
+
+        // the header is rewritten with the count and the checksum at the end
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        SnapshotChecksum checksum;
+        std::vector<char> buffer(kBufferSize);
+        size_t used = 0;
+        auto flush = [&]() {
+            checksum.update(buffer.data(), used);
+            ok = ok && std::fwrite(buffer.data(), 1, used, file) == used;
+            header.payload_size_ += used;
+            used = 0;
+        };
+        auto& kv = const_cast<typename Cache::Map&>(cache.kv_);
+        for (MapIter it = cache.first_; ok && it != kv.end(); it = cache.getNext(it)) {
+            size_t bytes = SnapshotSerializer<Key>::size(it->first) + SnapshotSerializer<Value>::size(cache.val(it));
+            if (used + bytes > buffer.size()) {
+                flush();
+                if (bytes > buffer.size()) {
+                    buffer.resize(bytes);
+                }
+            }
+            char* out = buffer.data() + used;
+            out = SnapshotSerializer<Key>::write(it->first, out);
+            out = SnapshotSerializer<Value>::write(cache.val(it), out);
+            used = out - buffer.data();
+            ++header.count_;
+        }
+        flush();
+        header.checksum_ = checksum.value();
+        ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    static bool load(Cache& cache, const std::string& path) {
+        cache.clear();
+#if defined(LRUCACHE_SNAPSHOT_MMAP)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            return false;
+        }
+        size_t length = static_cast<size_t>(st.st_size);
+        void* data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        ::madvise(data, length, MADV_SEQUENTIAL);
+        bool ok = false;
+        try {
+            ok = build(cache, static_cast<const char*>(data), length);
+        } catch (...) {
+            ::munmap(data, length);
+            cache.clear();
+            throw;
+        }
+        ::munmap(data, length);
+#else
+        bool ok = loadFromStream(cache, path);
+#endif
+        if (!ok) {
+            cache.clear();
+        }
+        return ok;
+    }
+
+    // The load() of the platforms without mmap: reads the whole file into memory with an ifstream
+    static bool loadFromStream(Cache& cache, const std::string& path) {
+        cache.clear();
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open() || !in.seekg(0, std::ios::end)) {
+            return false;
+        }
+        std::streamoff length = in.tellg();
+        if (length < static_cast<std::streamoff>(sizeof(SnapshotHeader)) || !in.seekg(0, std::ios::beg)) {
+            return false;
+        }
+        std::vector<char> data(static_cast<size_t>(length));
+        if (!in.read(data.data(), length) || in.gcount() != length) {
+            return false;
+        }
+        if (!build(cache, data.data(), data.size())) {
+            cache.clear();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // Appends the entries at the back of the empty cache, the first max_size ones (the most recently used)
+    static bool build(Cache& cache, const char* data, size_t length) {
+        if (length < sizeof(SnapshotHeader)) {
+            return false;
+        }
+        SnapshotHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic_, SnapshotHeader::kMagic, sizeof(header.magic_)) != 0
+            || header.version_ != SnapshotHeader::kVersion
+            || header.byte_order_ != SnapshotHeader::kByteOrder
+            || header.payload_size_ != length - sizeof(header)) {
+            return false;
+        }
+        const char* in = data + sizeof(header);
+        const char* end = data + length;
+        SnapshotChecksum checksum;
+        checksum.update(in, end - in);
+        if (checksum.value() != header.checksum_) {
+            return false;
+        }
+
+        uint64_t count = std::min<uint64_t>(header.count_, cache.max_size_);
+        for (uint64_t i = 0; i < count; ++i) {
+            Key key{};
+            Value value{};
+            if (!SnapshotSerializer<Key>::read(in, end, key) || !SnapshotSerializer<Value>::read(in, end, value)) {
+                return false;
+            }
+            size_t size = cache.kv_.size();
+            cache.preAdd();
+            MapIter it = cache.emplaceListNode(std::move(key), std::move(value));
+            if (cache.kv_.size() == size) {
+                // a key twice, the list would be broken
+                return false;
+            }
+            cache.addToBack(it);
+        }
+        return true;
+    }
+};
+
+} // namespace lrucache
+
+#endif
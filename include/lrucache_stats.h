@@ -0,0 +1,343 @@
+#ifndef LRUCACHE_STATS_H
+#define LRUCACHE_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace lrucache {
+
+// Latency distribution in log buckets with 8 linear sub-buckets each (HDR histogram style, 12.5% precision):
+// the values 0..7 ns have their own bucket, then every power of two range is split in 8.
+class LatencyHistogram {
+public:
+    static constexpr size_t kSubBuckets = 8;
+    static constexpr size_t kBuckets = kSubBuckets * 62;
+
+    static size_t bucketOf(uint64_t ns) {
+        if (ns < kSubBuckets) {
+            return static_cast<size_t>(ns);
+        }
+        unsigned e = 63 - countLeadingZeros(ns);
+        return (e - 2) * kSubBuckets + ((ns >> (e - 3)) & (kSubBuckets - 1));
+    }
+
+    // Smallest value of the bucket
+    static uint64_t lowerBound(size_t bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        unsigned e = static_cast<unsigned>(bucket / kSubBuckets) + 2;
+        return (kSubBuckets + bucket % kSubBuckets) << (e - 3);
+    }
+
+    LatencyHistogram() = default;
+
+    explicit LatencyHistogram(std::vector<uint64_t> counts)
+        : counts_(std::move(counts))
+    {
+
+    }
+
+    // Number of recorded values
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (uint64_t c : counts_) {
+            total += c;
+        }
+        return total;
+    }
+
+    // Upper bound of the bucket holding the q quantile (0 < q <= 1), 0 if nothing was recorded
+    uint64_t percentile(double q) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < counts_.size(); ++b) {
+            seen += counts_[b];
+            if (seen > rank || seen == total) {
+                return b + 1 < kBuckets ? lowerBound(b + 1) - 1 : UINT64_MAX;
+            }
+        }
+        return UINT64_MAX;
+    }
+
+    const std::vector<uint64_t>& counts() const { return counts_; }
+
+    LatencyHistogram& operator+=(const LatencyHistogram& other) {
+        if (counts_.size() < other.counts_.size()) {
+            counts_.resize(other.counts_.size());
+        }
+        for (size_t b = 0; b < other.counts_.size(); ++b) {
+            counts_[b] += other.counts_[b];
+        }
+        return *this;
+    }
+
+private:
+    // Empty when nothing is timed
+    std::vector<uint64_t> counts_;
+
+    static unsigned countLeadingZeros(uint64_t x) {
+#if defined(__GNUC__)
+        return static_cast<unsigned>(__builtin_clzll(x));
+#else
+        unsigned n = 0;
+        for (uint64_t bit = uint64_t(1) << 63; (x & bit) == 0; bit >>= 1) {
+            ++n;
+        }
+        return n;
+#endif
+    }
+};
+
+// The statistics of a cache at one point in time
+struct StatsSnapshot {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t insertions{0};
+    uint64_t evictions{0};
+    uint64_t updates{0};
+    uint64_t promotions{0};
+    // Sampled durations of get() and add() in nanoseconds, empty unless TimedCacheStats is used
+    LatencyHistogram get_latency;
+    LatencyHistogram add_latency;
+
+    double hitRatio() const {
+        uint64_t lookups = hits + misses;
+        return lookups != 0 ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0;
+    }
+
+    StatsSnapshot& operator+=(const StatsSnapshot& other) {
+        hits += other.hits;
+        misses += other.misses;
+        insertions += other.insertions;
+        evictions += other.evictions;
+        updates += other.updates;
+        promotions += other.promotions;
+        get_latency += other.get_latency;
+        add_latency += other.add_latency;
+        return *this;
+    }
+};
+
+// What the time*() functions of the untimed policies return
+struct NoTiming {};
+
+// Default statistics policy of the caches: every call is empty, the disabled statistics cost nothing
+struct NoStats {
+    static constexpr bool kThreadSafe = true;
+
+    void recordHit() {}
+    void recordMiss() {}
+    void recordInsertion() {}
+    void recordEviction() {}
+    void recordUpdate() {}
+    void recordPromotion() {}
+
+    // Every key looked up (get, getPtr, getMany), for the policies which sample the keys (MissRatioCurveStats)
+    template <typename K>
+    void recordAccess(const K&) {}
+
+    NoTiming timeGet() { return {}; }
+    NoTiming timeAdd() { return {}; }
+};
+
+// Plain counters, for a cache used by one thread at a time (LRUCache, the shards of ShardedLRUCache)
+class CacheStats {
+public:
+    static constexpr bool kThreadSafe = false;
+
+    void recordHit() { ++hits_; }
+    void recordMiss() { ++misses_; }
+    void recordInsertion() { ++insertions_; }
+    void recordEviction() { ++evictions_; }
+    void recordUpdate() { ++updates_; }
+    void recordPromotion() { ++promotions_; }
+
+    template <typename K>
+    void recordAccess(const K&) {}
+
+    NoTiming timeGet() { return {}; }
+    NoTiming timeAdd() { return {}; }
+
+    StatsSnapshot snapshot() const {
+        StatsSnapshot s;
+        s.hits = hits_;
+        s.misses = misses_;
+        s.insertions = insertions_;
+        s.evictions = evictions_;
+        s.updates = updates_;
+        s.promotions = promotions_;
+        return s;
+    }
+
+    void reset() {
+        *this = CacheStats();
+    }
+
+private:
+    uint64_t hits_{0};
+    uint64_t misses_{0};
+    uint64_t insertions_{0};
+    uint64_t evictions_{0};
+    uint64_t updates_{0};
+    uint64_t promotions_{0};
+};
+
+// Counters updated concurrently (by the readers of BufferedLRUCache): Stripes cache line aligned sets of
+// relaxed atomics, a thread always increments the same stripe. snapshot() sums the stripes, it is not atomic.
+template <size_t Stripes = 16>
+class ConcurrentCacheStats {
+public:
+    static constexpr bool kThreadSafe = true;
+
+    void recordHit() { increment(&Stripe::hits_); }
+    void recordMiss() { increment(&Stripe::misses_); }
+    void recordInsertion() { increment(&Stripe::insertions_); }
+    void recordEviction() { increment(&Stripe::evictions_); }
+    void recordUpdate() { increment(&Stripe::updates_); }
+    void recordPromotion() { increment(&Stripe::promotions_); }
+
+    template <typename K>
+    void recordAccess(const K&) {}
+
+    NoTiming timeGet() { return {}; }
+    NoTiming timeAdd() { return {}; }
+
+    StatsSnapshot snapshot() const {
+        StatsSnapshot s;
+        for (auto& stripe : stripes_) {
+            s.hits += stripe.hits_.load(std::memory_order_relaxed);
+            s.misses += stripe.misses_.load(std::memory_order_relaxed);
+            s.insertions += stripe.insertions_.load(std::memory_order_relaxed);
+            s.evictions += stripe.evictions_.load(std::memory_order_relaxed);
+            s.updates += stripe.updates_.load(std::memory_order_relaxed);
+            s.promotions += stripe.promotions_.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    void reset() {
+        for (auto& stripe : stripes_) {
+            for (auto counter : {&Stripe::hits_, &Stripe::misses_, &Stripe::insertions_,
+                                 &Stripe::evictions_, &Stripe::updates_, &Stripe::promotions_}) {
+                (stripe.*counter).store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> hits_{0};
+        std::atomic<uint64_t> misses_{0};
+        std::atomic<uint64_t> insertions_{0};
+        std::atomic<uint64_t> evictions_{0};
+        std::atomic<uint64_t> updates_{0};
+        std::atomic<uint64_t> promotions_{0};
+    };
+
+    std::array<Stripe, Stripes> stripes_;
+
+    static size_t stripeIndex() {
+        static thread_local size_t index = std::hash<std::thread::id>{}(std::this_thread::get_id()) % Stripes;
+        return index;
+    }
+
+    void increment(std::atomic<uint64_t> Stripe::* counter) {
+        (stripes_[stripeIndex()].*counter).fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Latency histogram filled concurrently with relaxed atomics
+class LatencyRecorder {
+public:
+    void record(uint64_t ns) {
+        counts_[LatencyHistogram::bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram snapshot() const {
+        std::vector<uint64_t> counts(LatencyHistogram::kBuckets);
+        for (size_t b = 0; b < counts.size(); ++b) {
+            counts[b] = counts_[b].load(std::memory_order_relaxed);
+        }
+        return LatencyHistogram(std::move(counts));
+    }
+
+    void reset() {
+        for (auto& c : counts_) {
+            c.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, LatencyHistogram::kBuckets> counts_{};
+};
+
+// Records the duration of its scope into a LatencyRecorder, does nothing if constructed with nullptr
+class ScopedLatency {
+public:
+    explicit ScopedLatency(LatencyRecorder* recorder)
+        : recorder_(recorder)
+    {
+        if (recorder_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+    ~ScopedLatency() {
+        if (recorder_) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            recorder_->record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    }
+
+private:
+    LatencyRecorder* recorder_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Counters plus the latency histograms of get() and add(), one call in 2^SampleShift of every thread is timed
+// (reading the clock twice). Thread safe if Counters is.
+template <typename Counters = CacheStats, unsigned SampleShift = 6>
+class TimedCacheStats : public Counters {
+public:
+    ScopedLatency timeGet() { return ScopedLatency(sampled() ? &get_latency_ : nullptr); }
+    ScopedLatency timeAdd() { return ScopedLatency(sampled() ? &add_latency_ : nullptr); }
+
+    StatsSnapshot snapshot() const {
+        StatsSnapshot s = Counters::snapshot();
+        s.get_latency = get_latency_.snapshot();
+        s.add_latency = add_latency_.snapshot();
+        return s;
+    }
+
+    void reset() {
+        Counters::reset();
+        get_latency_.reset();
+        add_latency_.reset();
+    }
+
+private:
+    LatencyRecorder get_latency_;
+    LatencyRecorder add_latency_;
+
+    static bool sampled() {
+        static thread_local uint32_t calls = 0;
+        return (calls++ & ((uint32_t(1) << SampleShift) - 1)) == 0;
+    }
+};
+
+} // namespace lrucache
+
+#endif
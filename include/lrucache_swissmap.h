@@ -0,0 +1,482 @@
+#ifndef LRUCACHE_SWISSMAP_H
+#define LRUCACHE_SWISSMAP_H
+
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <tuple>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LRUCACHE_SWISSMAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+namespace swiss {
+
+using ctrl_t = int8_t;
+
+constexpr ctrl_t kEmpty = -128;
+constexpr ctrl_t kDeleted = -2;
+constexpr size_t kGroupWidth = 16;
+
+// One multiplication folding the 128 bit product, mixes well enough for the 7 bit tags and the group index
+inline uint64_t foldedMultiply(uint64_t h) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t p = static_cast<__uint128_t>(h) * 0x9e3779b97f4a7c15ULL;
+    return static_cast<uint64_t>(p) ^ static_cast<uint64_t>(p >> 64);
+#else
+    return mixHash(h);
+#endif
+}
+
+inline int lowestBit(uint32_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+// 16 control bytes matched at once, bit i of a mask refers to the i-th byte
+struct Group {
+#if defined(LRUCACHE_SWISSMAP_SSE2)
+    __m128i ctrl_;
+
+    explicit Group(const ctrl_t* ctrl) : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+    uint32_t match(ctrl_t h2) const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_)));
+    }
+
+    uint32_t matchEmpty() const { return match(kEmpty); }
+
+    // Empty and deleted are the only negative control bytes
+    uint32_t matchEmptyOrDeleted() const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(ctrl_));
+    }
+#else
+    const ctrl_t* ctrl_;
+
+    explicit Group(const ctrl_t* ctrl) : ctrl_(ctrl) {}
+
+    uint32_t match(ctrl_t h2) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupWidth; ++i) {
+            mask |= static_cast<uint32_t>(ctrl_[i] == h2) << i;
+        }
+        return mask;
+    }
+
+    uint32_t matchEmpty() const { return match(kEmpty); }
+
+    uint32_t matchEmptyOrDeleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupWidth; ++i) {
+            mask |= static_cast<uint32_t>(ctrl_[i] < 0) << i;
+        }
+        return mask;
+    }
+#endif
+};
+
+} // namespace swiss
+
+// Node based hash map indexed by groups of 16 control bytes holding 7 bit hash tags (Swiss table layout).
+// A lookup matches the tag against a whole group with SSE2 (scalar fallback elsewhere), so most misses
+// are decided without touching the key memory. The elements live in separately allocated nodes:
+// the iterators stay valid on rehash and extract/insert of node handles is supported, as LRUCache requires.
+// Provides the subset of the std::unordered_map interface used by LRUCache, iterators can't be incremented.
+template <
+    typename Key,
+    typename T,
+    typename Hash = std::hash<Key>,
+    typename KeyEqual = std::equal_to<Key>,
+    typename Allocator = std::allocator<std::pair<const Key, T>>>
+class SwissMap {
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using allocator_type = Allocator;
+
+private:
+    // The key is mutable so that it can be reassigned through a node handle
+    using Node = std::pair<Key, T>;
+    using NodeAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAlloc>;
+    using CtrlAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<swiss::ctrl_t>;
+    using SlotAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<Node*>;
+
+public:
+    class iterator {
+        Node* node_{nullptr};
+        friend class SwissMap;
+        explicit iterator(Node* node) : node_(node) {}
+    public:
+        iterator() = default;
+        Node& operator*() const { return *node_; }
+        Node* operator->() const { return node_; }
+        bool operator==(const iterator& other) const { return node_ == other.node_; }
+        bool operator!=(const iterator& other) const { return node_ != other.node_; }
+    };
+
+    using const_iterator = iterator;
+
+    class node_type {
+        Node* node_{nullptr};
+        NodeAlloc alloc_;
+        friend class SwissMap;
+        node_type(Node* node, const NodeAlloc& alloc) : node_(node), alloc_(alloc) {}
+    public:
+        node_type() = default;
+        node_type(node_type&& other) noexcept
+            : node_(std::exchange(other.node_, nullptr))
+            , alloc_(other.alloc_)
+        {
+
+        }
+        node_type& operator=(node_type&& other) noexcept {
+            if (this != &other) {
+                reset();
+                node_ = std::exchange(other.node_, nullptr);
+                alloc_ = other.alloc_;
+            }
+            return *this;
+        }
+        ~node_type() { reset(); }
+
+        bool empty() const { return node_ == nullptr; }
+        explicit operator bool() const { return node_ != nullptr; }
+        Key& key() const { return node_->first; }
+        T& mapped() const { return node_->second; }
+
+    private:
+        void reset() {
+            if (node_) {
+                NodeTraits::destroy(alloc_, node_);
+                NodeTraits::deallocate(alloc_, node_, 1);
+                node_ = nullptr;
+            }
+        }
+    };
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+    SwissMap() : SwissMap(Allocator()) {}
+
+    explicit SwissMap(const Allocator& alloc)
+        : node_alloc_(alloc)
+        , ctrl_alloc_(alloc)
+        , slot_alloc_(alloc)
+    {
+
+    }
+
+    SwissMap(const SwissMap&) = delete;
+    SwissMap& operator=(const SwissMap&) = delete;
+
+    ~SwissMap() {
+        destroyNodes();
+        deallocateArrays();
+    }
+
+    allocator_type get_allocator() const { return allocator_type(node_alloc_); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t bucket_count() const { return capacity_; }
+
+    iterator end() const { return iterator{}; }
+
+    iterator find(const Key& key) const {
+        return findImpl(key);
+    }
+
+    // Heterogeneous lookup, enabled when both Hash and KeyEqual are transparent
+    template <typename K, typename H = Hash, typename E = KeyEqual,
+              typename = typename H::is_transparent, typename = typename E::is_transparent>
+    iterator find(const K& key) const {
+        return findImpl(key);
+    }
+
+    // Prefetches the first control group and slots find(key) reads
+    template <typename K>
+    void prefetch(const K& key) const {
+        if (capacity_ == 0) {
+            return;
+        }
+        size_t group = groupOf(hashOf(key));
+        prefetchAddress(ctrl_ + group * swiss::kGroupWidth);
+        prefetchAddress(&slots_[group * swiss::kGroupWidth]);
+    }
+
+    std::pair<iterator, bool> insert(value_type&& v) {
+        return try_emplace(v.first, std::move(v.second));
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        return emplaceKey(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        return emplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+
+    insert_return_type insert(node_type&& nh) {
+        if (nh.empty()) {
+            return {end(), false, {}};
+        }
+        iterator it = find(nh.key());
+        if (it != end()) {
+            return {it, false, std::move(nh)};
+        }
+        Node* node = std::exchange(nh.node_, nullptr);
+        insertNode(node);
+        return {iterator{node}, true, {}};
+    }
+
+    node_type extract(iterator it) {
+        assert(it != end());
+        eraseSlot(slotOf(it.node_));
+        return node_type{it.node_, node_alloc_};
+    }
+
+    void erase(iterator it) {
+        node_type nh{extract(it)};
+    }
+
+    size_t erase(const Key& key) {
+        iterator it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    // Keeps the control and slot arrays, like std::unordered_map keeps its buckets
+    void clear() {
+        destroyNodes();
+        if (capacity_ != 0) {
+            std::memset(ctrl_, static_cast<uint8_t>(swiss::kEmpty), capacity_);
+        }
+        size_ = 0;
+        deleted_ = 0;
+        growth_left_ = maxLoad(capacity_);
+    }
+
+    void reserve(size_t n) {
+        size_t capacity = swiss::kGroupWidth;
+        while (maxLoad(capacity) < n) {
+            capacity *= 2;
+        }
+        if (capacity > capacity_) {
+            rehash(capacity);
+        }
+    }
+
+private:
+    swiss::ctrl_t* ctrl_{nullptr};
+    Node** slots_{nullptr};
+    size_t capacity_{0};
+    size_t group_mask_{0};
+    size_t size_{0};
+    size_t deleted_{0};
+    size_t growth_left_{0};
+    Hash hash_;
+    KeyEqual eq_;
+    NodeAlloc node_alloc_;
+    CtrlAlloc ctrl_alloc_;
+    SlotAlloc slot_alloc_;
+
+    // Load factor 7/8
+    static size_t maxLoad(size_t capacity) { return capacity - capacity / 8; }
+
+    template <typename K>
+    uint64_t hashOf(const K& key) const { return swiss::foldedMultiply(hash_(key)); }
+
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> emplaceKey(K&& key, Args&&... args) {
+        iterator it = find(key);
+        if (it != end()) {
+            return {it, false};
+        }
+        Node* node = NodeTraits::allocate(node_alloc_, 1);
+        try {
+            NodeTraits::construct(node_alloc_, node, std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch (...) {
+            NodeTraits::deallocate(node_alloc_, node, 1);
+            throw;
+        }
+        insertNode(node);
+        return {iterator{node}, true};
+    }
+
+    template <typename K>
+    iterator findImpl(const K& key) const {
+        if (capacity_ == 0) {
+            return end();
+        }
+        uint64_t h = hashOf(key);
+        swiss::ctrl_t h2 = tagOf(h);
+        size_t group = groupOf(h);
+        for (size_t step = 1; ; ++step) {
+            swiss::Group g(ctrl_ + group * swiss::kGroupWidth);
+            for (uint32_t mask = g.match(h2); mask != 0; mask &= mask - 1) {
+                Node* node = slots_[group * swiss::kGroupWidth + swiss::lowestBit(mask)];
+                if (eq_(node->first, key)) {
+                    return iterator{node};
+                }
+            }
+            if (g.matchEmpty() != 0 || step > group_mask_) {
+                return end();
+            }
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    static swiss::ctrl_t tagOf(uint64_t h) { return static_cast<swiss::ctrl_t>(h & 0x7f); }
+    size_t groupOf(uint64_t h) const { return (h >> 7) & group_mask_; }
+
+    size_t slotOf(const Node* node) const {
+        uint64_t h = hashOf(node->first);
+        swiss::ctrl_t h2 = tagOf(h);
+        size_t group = groupOf(h);
+        for (size_t step = 1; ; ++step) {
+            swiss::Group g(ctrl_ + group * swiss::kGroupWidth);
+            for (uint32_t mask = g.match(h2); mask != 0; mask &= mask - 1) {
+                size_t slot = group * swiss::kGroupWidth + swiss::lowestBit(mask);
+                if (slots_[slot] == node) {
+                    return slot;
+                }
+            }
+            assert(g.matchEmpty() == 0);
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    // First empty or deleted slot on the probe sequence of h
+    size_t findFreeSlot(uint64_t h) const {
+        size_t group = groupOf(h);
+        for (size_t step = 1; ; ++step) {
+            swiss::Group g(ctrl_ + group * swiss::kGroupWidth);
+            uint32_t mask = g.matchEmptyOrDeleted();
+            if (mask != 0) {
+                return group * swiss::kGroupWidth + swiss::lowestBit(mask);
+            }
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    void insertNode(Node* node) {
+        if (growth_left_ == 0) {
+            // Tombstones only: rehash in place, otherwise double
+            rehash(size_ + 1 <= maxLoad(capacity_) / 2 ? capacity_ : std::max(capacity_ * 2, swiss::kGroupWidth));
+        }
+        uint64_t h = hashOf(node->first);
+        size_t slot = findFreeSlot(h);
+        if (ctrl_[slot] == swiss::kDeleted) {
+            --deleted_;
+        } else {
+            --growth_left_;
+        }
+        ctrl_[slot] = tagOf(h);
+        slots_[slot] = node;
+        ++size_;
+    }
+
+    void eraseSlot(size_t slot) {
+        // A group with an empty byte stops every probe sequence passing through it,
+        // so the slot can become empty instead of a tombstone
+        size_t group_start = slot - slot % swiss::kGroupWidth;
+        if (swiss::Group(ctrl_ + group_start).matchEmpty() != 0) {
+            ctrl_[slot] = swiss::kEmpty;
+            ++growth_left_;
+        } else {
+            ctrl_[slot] = swiss::kDeleted;
+            ++deleted_;
+        }
+        slots_[slot] = nullptr;
+        --size_;
+    }
+
+    void rehash(size_t capacity) {
+        swiss::ctrl_t* old_ctrl = ctrl_;
+        Node** old_slots = slots_;
+        size_t old_capacity = capacity_;
+
+        ctrl_ = std::allocator_traits<CtrlAlloc>::allocate(ctrl_alloc_, capacity);
+        slots_ = std::allocator_traits<SlotAlloc>::allocate(slot_alloc_, capacity);
+        std::memset(ctrl_, static_cast<uint8_t>(swiss::kEmpty), capacity);
+        capacity_ = capacity;
+        group_mask_ = capacity / swiss::kGroupWidth - 1;
+        growth_left_ = maxLoad(capacity) - size_;
+        deleted_ = 0;
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_ctrl[i] >= 0) {
+                uint64_t h = hashOf(old_slots[i]->first);
+                size_t slot = findFreeSlot(h);
+                ctrl_[slot] = tagOf(h);
+                slots_[slot] = old_slots[i];
+            }
+        }
+
+        if (old_capacity != 0) {
+            std::allocator_traits<CtrlAlloc>::deallocate(ctrl_alloc_, old_ctrl, old_capacity);
+            std::allocator_traits<SlotAlloc>::deallocate(slot_alloc_, old_slots, old_capacity);
+        }
+    }
+
+    void destroyNodes() {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0) {
+                NodeTraits::destroy(node_alloc_, slots_[i]);
+                NodeTraits::deallocate(node_alloc_, slots_[i], 1);
+            }
+        }
+    }
+
+    void deallocateArrays() {
+        if (capacity_ != 0) {
+            std::allocator_traits<CtrlAlloc>::deallocate(ctrl_alloc_, ctrl_, capacity_);
+            std::allocator_traits<SlotAlloc>::deallocate(slot_alloc_, slots_, capacity_);
+        }
+    }
+
+};
+
+namespace pmr {
+
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+using SwissMap = lrucache::SwissMap<Key, T, Hash, KeyEqual, std::pmr::polymorphic_allocator<std::pair<const Key, T>>>;
+
+} // namespace pmr
+
+} // namespace lrucache
+
+#endif
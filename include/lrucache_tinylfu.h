@@ -0,0 +1,244 @@
+#ifndef LRUCACHE_TINYLFU_H
+#define LRUCACHE_TINYLFU_H
+
+#include <vector>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+#include "lrucache.h"
+#include "lrucache_segment.h"
+#include "lrucache_slru.h"
+
+namespace lrucache {
+
+// Approximate access frequencies of the keys: a count-min sketch of 4 bit counters (16 in a word, 4 counters per key)
+// behind a doorkeeper Bloom filter which absorbs the first access of every key. After 10 * capacity recorded
+// accesses all the counters are halved and the doorkeeper is cleared, so the old popularity fades away.
+template <typename Key, typename Hash = std::hash<Key>>
+class FrequencySketch {
+public:
+    explicit FrequencySketch(size_t capacity)
+        : sample_size_(10 * std::max<size_t>(capacity, 1))
+    {
+        size_t words = 1;
+        while (words < capacity) {
+            words *= 2;
+        }
+        table_.assign(words, 0);
+        counter_mask_ = words * 16 - 1;
+        size_t bits = 64;
+        while (bits < 32 * capacity) {
+            bits *= 2;
+        }
+        doorkeeper_.assign(bits / 64, 0);
+        doorkeeper_mask_ = bits - 1;
+    }
+
+    // Records an access
+    void increment(const Key& key) {
+        if (++additions_ == sample_size_) {
+            age();
+        }
+        uint64_t h = mixHash(hash_(key));
+        if (!testAndSetDoorkeeper(h)) {
+            return;
+        }
+        for (unsigned i = 0; i < kDepth; ++i) {
+            size_t counter = counterOf(h, i);
+            uint64_t& word = table_[counter >> 4];
+            unsigned shift = (counter & 15) * 4;
+            if (((word >> shift) & 15) != 15) {
+                word += uint64_t(1) << shift;
+            }
+        }
+    }
+
+    // Estimated number of the recent accesses (0..16)
+    unsigned frequency(const Key& key) const {
+        uint64_t h = mixHash(hash_(key));
+        unsigned frequency = 15;
+        for (unsigned i = 0; i < kDepth; ++i) {
+            size_t counter = counterOf(h, i);
+            frequency = std::min(frequency, static_cast<unsigned>((table_[counter >> 4] >> ((counter & 15) * 4)) & 15));
+        }
+        return frequency + (inDoorkeeper(h) ? 1 : 0);
+    }
+
+    void clear() {
+        std::fill(table_.begin(), table_.end(), 0);
+        std::fill(doorkeeper_.begin(), doorkeeper_.end(), 0);
+        additions_ = 0;
+    }
+
+private:
+    static constexpr unsigned kDepth = 4;
+
+    std::vector<uint64_t> table_;
+    std::vector<uint64_t> doorkeeper_;
+    size_t counter_mask_{0};
+    size_t doorkeeper_mask_{0};
+    size_t sample_size_{0};
+    size_t additions_{0};
+    Hash hash_;
+
+    // Double hashing, the odd step visits distinct counters
+    size_t counterOf(uint64_t h, unsigned i) const {
+        return static_cast<size_t>((h + i * ((h >> 32) | 1)) & counter_mask_);
+    }
+
+    bool inDoorkeeper(uint64_t h) const {
+        size_t b1 = h & doorkeeper_mask_;
+        size_t b2 = (h >> 32) & doorkeeper_mask_;
+        return ((doorkeeper_[b1 >> 6] >> (b1 & 63)) & (doorkeeper_[b2 >> 6] >> (b2 & 63)) & 1) != 0;
+    }
+
+    // Returns true if the key was already in the doorkeeper
+    bool testAndSetDoorkeeper(uint64_t h) {
+        if (inDoorkeeper(h)) {
+            return true;
+        }
+        size_t b1 = h & doorkeeper_mask_;
+        size_t b2 = (h >> 32) & doorkeeper_mask_;
+        doorkeeper_[b1 >> 6] |= uint64_t(1) << (b1 & 63);
+        doorkeeper_[b2 >> 6] |= uint64_t(1) << (b2 & 63);
+        return false;
+    }
+
+    void age() {
+        for (uint64_t& word : table_) {
+            word = (word >> 1) & 0x7777777777777777ULL;
+        }
+        std::fill(doorkeeper_.begin(), doorkeeper_.end(), 0);
+        additions_ /= 2;
+    }
+
+};
+
+
+// W-TinyLFU cache (use BaseVal, BaseUniqPtr or BaseFlat): new keys enter a small window LRU (1% of the capacity),
+// the element leaving the window is admitted into the main SLRUCache only if the FrequencySketch estimates it
+// more frequently used than the victim of the main cache, which it then replaces. A scan of keys seen once
+// therefore passes through the window without flushing the main cache.
+template <typename Base, typename Hash = std::hash<typename LRUCache<Base>::TKey>>
+class TinyLFUCache {
+public:
+    using TKey = typename LRUCache<Base>::TKey;
+    using TValue = typename LRUCache<Base>::TValue;
+
+private:
+    using Key = TKey;
+    using Value = TValue;
+    using Pair = std::pair<Key, Value>;
+
+    size_t max_size_;
+    LRUSegment<Base> window_;
+    SLRUCache<Base> main_;
+    FrequencySketch<Key, Hash> sketch_;
+
+    static size_t windowSize(size_t max_size) {
+        return std::max<size_t>(max_size / 100, 1);
+    }
+
+    template <typename K, typename V>
+    bool put(K&& key, V&& value) {
+        sketch_.increment(key);
+        if (window_.contains(key)) {
+            return window_.add(std::forward<K>(key), std::forward<V>(value));
+        }
+        if (main_.contains(key)) {
+            return main_.add(std::forward<K>(key), std::forward<V>(value));
+        }
+        if (!window_.full()) {
+            window_.add(std::forward<K>(key), std::forward<V>(value));
+            return false;
+        }
+        Pair candidate = window_.popLru();
+        window_.add(std::forward<K>(key), std::forward<V>(value));
+        if (!main_.full() || sketch_.frequency(candidate.first) > sketch_.frequency(*main_.lruKey())) {
+            // replaces the victim of a full main_
+            main_.add(std::move(candidate.first), std::move(candidate.second));
+        }
+        return false;
+    }
+
+public:
+    explicit TinyLFUCache(size_t max_size)
+        : max_size_(max_size)
+        , window_(windowSize(max_size))
+        , main_(std::max<size_t>(max_size - std::min(max_size, windowSize(max_size)), 1))
+        , sketch_(max_size)
+    {
+
+    }
+
+    bool add(const Key& key, const Value& value) {
+        return put(key, value);
+    }
+
+    bool add(Key&& key, Value&& value) {
+        return put(std::move(key), std::move(value));
+    }
+
+    // Only the hits are recorded, the misses are recorded by the following add()
+    std::optional<Value> get(const Key& key) {
+        std::optional<Value> value = window_.get(key);
+        if (!value) {
+            value = main_.get(key);
+        }
+        if (value) {
+            sketch_.increment(key);
+        }
+        return value;
+    }
+
+    bool contains(const Key& key) const {
+        return window_.contains(key) || main_.contains(key);
+    }
+
+    std::optional<Value> peek(const Key& key) const {
+        if (auto value = window_.peek(key)) {
+            return value;
+        }
+        return main_.peek(key);
+    }
+
+    // Estimated recent access frequency of the key
+    unsigned frequency(const Key& key) const {
+        return sketch_.frequency(key);
+    }
+
+    void clear() {
+        window_.clear();
+        main_.clear();
+        sketch_.clear();
+    }
+
+    size_t size() const { return window_.size() + main_.size(); }
+    size_t maxSize() const { return max_size_; }
+
+    // Approximate order: the window elements precede the main ones
+    std::vector<Key> getMRUKeys(size_t n) const {
+        std::vector<Key> v = window_.getMRUKeys(n);
+        for (auto& key : main_.getMRUKeys(n - v.size())) {
+            v.push_back(std::move(key));
+        }
+        return v;
+    }
+
+    // Approximate order: the window elements precede the main ones
+    std::vector<Pair> getMRU(size_t n) const {
+        std::vector<Pair> v = window_.getMRU(n);
+        for (auto& pair : main_.getMRU(n - v.size())) {
+            v.push_back(std::move(pair));
+        }
+        return v;
+    }
+
+};
+
+} // namespace lrucache
+
+#endif
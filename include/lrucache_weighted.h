@@ -0,0 +1,174 @@
+#ifndef LRUCACHE_WEIGHTED_H
+#define LRUCACHE_WEIGHTED_H
+
+#include <utility>
+
+#include "lrucache.h"
+
+namespace lrucache {
+
+// LRU cache (use BaseVal, BaseUniqPtr or BaseFlat) limited by the total weight of its elements, e.g. their size in bytes,
+// besides the element count. weigher(key, value) must depend only on the key and the value: the weights aren't stored,
+// they are recomputed when an element is replaced, modified by visit() or evicted. Inserting evicts as many least
+// recently used elements as needed to fit the new one, an element heavier than maxWeight() is rejected.
+// Listener receives the removals like in LRUCache, the evictions to fit the budget with RemovalCause::Size.
+template <typename Base, typename Weigher, typename Listener = NoRemovalListener>
+class WeightedLRUCache : protected LRUCache<Base, Listener> {
+    using Cache = LRUCache<Base, Listener>;
+    using typename Cache::MapIter;
+    using Key = typename Cache::TKey;
+    using Value = typename Cache::TValue;
+
+    using Cache::val;
+    using Cache::moveToFront;
+    using Cache::insertFront;
+    using Cache::removeNode;
+    using Cache::notifyRemoval;
+    using Cache::max_size_;
+    using Cache::kv_;
+    using Cache::last_;
+
+    size_t max_weight_{0};
+    size_t total_weight_{0};
+    Weigher weigher_;
+
+    size_t weigh(MapIter it) const {
+        return weigher_(it->first, val(it));
+    }
+
+    // Evicts the least recently used elements until weight more fits
+    void evictToFit(size_t weight) {
+        while (last_ != kv_.end() && total_weight_ + weight > max_weight_) {
+            total_weight_ -= weigh(last_);
+            removeNode(last_, RemovalCause::Size);
+        }
+    }
+
+    // Inserts a missing key, returns false if the value is too heavy
+    template <typename K>
+    bool insert(K&& key, Value&& value, size_t weight) {
+        if (weight > max_weight_) {
+            return false;
+        }
+        evictToFit(weight);
+        if (kv_.size() == max_size_) {
+            // insertFront() reuses the node of the last_
+            total_weight_ -= weigh(last_);
+        }
+        insertFront(std::forward<K>(key), std::move(value));
+        total_weight_ += weight;
+        return true;
+    }
+
+    // Returns true if the key existed
+    template <typename K>
+    bool put(K&& key, Value&& value) {
+        size_t weight = weigher_(key, value);
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            insert(std::forward<K>(key), std::move(value), weight);
+            return false;
+        }
+        total_weight_ -= weigh(it);
+        if (weight > max_weight_) {
+            removeNode(it, RemovalCause::Replaced);
+            return true;
+        }
+        notifyRemoval(it, RemovalCause::Replaced);
+        val(it) = std::move(value);
+        total_weight_ += weight;
+        moveToFront(it);
+        // it is the first_ and fits alone, so the eviction stops before reaching it
+        evictToFit(0);
+        return true;
+    }
+
+public:
+    using typename Cache::TKey;
+    using typename Cache::TValue;
+
+    // max_size still limits the element count (and sizes the preallocated structures)
+    WeightedLRUCache(size_t max_weight, size_t max_size, Weigher weigher = Weigher())
+        : Cache(max_size)
+        , max_weight_(max_weight)
+        , weigher_(std::move(weigher))
+    {
+
+    }
+
+    // Returns true if the key existed. A value heavier than maxWeight() is not stored
+    // and the previous value of the key is removed, contains() tells whether the value was stored.
+    template <typename K>
+    bool add(K&& key, const Value& value) {
+        return put(std::forward<K>(key), Value(value));
+    }
+
+    template <typename K>
+    bool add(K&& key, Value&& value) {
+        return put(std::forward<K>(key), std::move(value));
+    }
+
+    // The value is constructed from args before the insertion, so that it can be weighed
+    template <typename K, typename... Args>
+    bool emplace(K&& key, Args&&... args) {
+        return put(std::forward<K>(key), Value(std::forward<Args>(args)...));
+    }
+
+    // Returns true if the element was inserted, false if the key exists (args are left untouched) or the value is too heavy
+    template <typename K, typename... Args>
+    bool tryEmplace(K&& key, Args&&... args) {
+        auto it = findKey(kv_, key);
+        if (it != kv_.end()) {
+            moveToFront(it);
+            return false;
+        }
+        Value value(std::forward<Args>(args)...);
+        size_t weight = weigher_(key, value);
+        return insert(std::forward<K>(key), std::move(value), weight);
+    }
+
+    using Cache::get;
+    using Cache::contains;
+    using Cache::peek;
+
+    // Calls fn(value) like LRUCache::visit() and reweighs the value, which fn may modify
+    // (the element itself is removed if it no longer fits the budget)
+    template <typename K, typename F>
+    bool visit(const K& key, F&& fn) {
+        auto it = findKey(kv_, key);
+        if (it == kv_.end()) {
+            return false;
+        }
+        moveToFront(it);
+        total_weight_ -= weigh(it);
+        std::forward<F>(fn)(val(it));
+        size_t weight = weigh(it);
+        if (weight > max_weight_) {
+            removeNode(it, RemovalCause::Size);
+            return true;
+        }
+        total_weight_ += weight;
+        evictToFit(0);
+        return true;
+    }
+
+    void clear() {
+        Cache::clear();
+        total_weight_ = 0;
+    }
+
+    using Cache::size;
+    using Cache::maxSize;
+    using Cache::getMRUKeys;
+    using Cache::getMRU;
+
+    using Cache::removalListener;
+
+    size_t maxWeight() const { return max_weight_; }
+    size_t totalWeight() const { return total_weight_; }
+
+};
+
+} // namespace lrucache
+
+#endif
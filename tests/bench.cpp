@@ -0,0 +1,522 @@
+// Workload benchmark of the cache representations: Zipf, scan, loop, mixed read/write and multithreaded
+// traces, reporting ops/s, sampled latency percentiles, bytes per entry and hit ratio (see tests/README.md)
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <optional>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "lrucache.h"
+#include "lrucache_alt.h"
+#include "lrucache_flat.h"
+#include "lrucache_sharded.h"
+#include "lrucache_stats.h"
+#include "zipf.h"
+
+// Live heap bytes, every block carries its size in a 16 byte header
+static std::atomic<size_t> g_live_bytes{0};
+
+void* operator new(std::size_t size) {
+    if (void* p = std::malloc(size + 16)) {
+        *static_cast<size_t*>(p) = size;
+        g_live_bytes.fetch_add(size, std::memory_order_relaxed);
+        return static_cast<char*>(p) + 16;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    if (p) {
+        void* block = static_cast<char*>(p) - 16;
+        g_live_bytes.fetch_sub(*static_cast<size_t*>(block), std::memory_order_relaxed);
+        std::free(block);
+    }
+}
+
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+
+namespace {
+
+struct Options {
+    std::vector<size_t> sizes{1000, 10000, 100000, 1000000};
+    std::vector<unsigned> threads{1, 2, 4, 8};
+    size_t ops{0};
+    std::string filter;
+    std::string json;
+    bool perf{false};
+};
+
+struct Op {
+    uint64_t key_;
+    bool write_;
+};
+
+// A named trace over a cache of the given size
+struct Workload {
+    std::string name_;
+    std::vector<Op> ops_;
+};
+
+struct Result {
+    std::string cache_;
+    std::string workload_;
+    size_t size_{0};
+    unsigned threads_{1};
+    size_t ops_{0};
+    double ops_per_sec_{0};
+    uint64_t p50_{0};
+    uint64_t p99_{0};
+    uint64_t p999_{0};
+    double bytes_per_entry_{0};
+    double hit_ratio_{0};
+    std::optional<double> llc_misses_per_op_;
+    std::optional<double> branch_misses_per_op_;
+};
+
+// Time one op in 16 (the two clock reads are included in the percentiles)
+constexpr size_t kLatencySampling = 16;
+
+size_t opsFor(const Options& options, size_t size) {
+    if (options.ops != 0) {
+        return options.ops;
+    }
+    return std::clamp<size_t>(4 * size, size_t(1) << 20, size_t(1) << 24);
+}
+
+std::vector<Op> zipfTrace(size_t count, size_t universe, double skew, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    ZipfGenerator zipf(universe, skew);
+    std::vector<Op> ops(count);
+    for (auto& op : ops) {
+        // scatter the popular ranks over the key space
+        op = {zipf(rng) * 0x9E3779B97F4A7C15ULL, false};
+    }
+    return ops;
+}
+
+std::vector<Workload> workloadsFor(const Options& options, size_t size) {
+    size_t count = opsFor(options, size);
+    std::vector<Workload> workloads;
+    for (double skew : {0.7, 0.9, 1.1}) {
+        std::ostringstream name;
+        name << "zipf-" << skew;
+        workloads.push_back({name.str(), zipfTrace(count, 10 * size, skew, 1)});
+    }
+
+    // every key once: no hits
+    Workload scan{"scan", std::vector<Op>(count)};
+    for (size_t i = 0; i < count; ++i) {
+        scan.ops_[i] = {i, false};
+    }
+    workloads.push_back(std::move(scan));
+
+    // a cycle 10% longer than the cache: LRU always evicts the next key
+    Workload loop{"loop", std::vector<Op>(count)};
+    for (size_t i = 0; i < count; ++i) {
+        loop.ops_[i] = {i % (size + size / 10 + 1), false};
+    }
+    workloads.push_back(std::move(loop));
+
+    for (unsigned writes : {10, 50}) {
+        std::mt19937_64 rng(writes);
+        Workload mixed{"mixed-" + std::to_string(100 - writes) + "/" + std::to_string(writes), std::vector<Op>(count)};
+        for (auto& op : mixed.ops_) {
+            op = {rng() % (size + size / 4), rng() % 100 < writes};
+        }
+        workloads.push_back(std::move(mixed));
+    }
+    return workloads;
+}
+
+#if defined(__linux__)
+// LLC and branch misses of the calling thread, read as a perf_event_open group
+class PerfCounters {
+public:
+    PerfCounters() {
+        llc_ = open(PERF_COUNT_HW_CACHE_MISSES, -1);
+        if (llc_ >= 0) {
+            branch_ = open(PERF_COUNT_HW_BRANCH_MISSES, llc_);
+        }
+    }
+
+    ~PerfCounters() {
+        if (branch_ >= 0) {
+            close(branch_);
+        }
+        if (llc_ >= 0) {
+            close(llc_);
+        }
+    }
+
+    bool available() const { return llc_ >= 0 && branch_ >= 0; }
+
+    void start() {
+        ioctl(llc_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(llc_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // Returns the LLC misses and the branch misses since start()
+    std::pair<uint64_t, uint64_t> stop() {
+        ioctl(llc_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t values[3] = {0, 0, 0};
+        if (read(llc_, values, sizeof(values)) != sizeof(values)) {
+            return {0, 0};
+        }
+        return {values[1], values[2]};
+    }
+
+private:
+    int llc_{-1};
+    int branch_{-1};
+
+    static int open(uint64_t config, int group) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = group < 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+};
+#else
+class PerfCounters {
+public:
+    bool available() const { return false; }
+    void start() {}
+    std::pair<uint64_t, uint64_t> stop() { return {0, 0}; }
+};
+#endif
+
+// A read is a get() followed by an add() on a miss (cache-aside), a write is an add(). Returns true on a hit.
+template <typename T>
+bool applyOp(T& cache, const Op& op) {
+    if (op.write_) {
+        cache.add(op.key_, op.key_);
+        return false;
+    }
+    if (cache.get(op.key_)) {
+        return true;
+    }
+    cache.add(op.key_, op.key_);
+    return false;
+}
+
+template <typename T>
+Result runSingle(const Options& options, const std::string& cache_name, const Workload& workload, size_t size) {
+    Result result;
+    result.cache_ = cache_name;
+    result.workload_ = workload.name_;
+    result.size_ = size;
+    result.ops_ = workload.ops_.size();
+
+    size_t live_before = g_live_bytes.load();
+    auto cache = std::make_unique<T>(size);
+
+    // warm up, then the timed pass
+    for (auto& op : workload.ops_) {
+        applyOp(*cache, op);
+    }
+    result.bytes_per_entry_ = static_cast<double>(g_live_bytes.load() - live_before) / std::max<size_t>(cache->size(), 1);
+
+    PerfCounters perf;
+    bool use_perf = options.perf && perf.available();
+    size_t hits = 0;
+    if (use_perf) {
+        perf.start();
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (auto& op : workload.ops_) {
+        hits += applyOp(*cache, op) ? 1 : 0;
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (use_perf) {
+        auto [llc, branch] = perf.stop();
+        result.llc_misses_per_op_ = static_cast<double>(llc) / result.ops_;
+        result.branch_misses_per_op_ = static_cast<double>(branch) / result.ops_;
+    }
+    result.ops_per_sec_ = result.ops_ / elapsed;
+    result.hit_ratio_ = static_cast<double>(hits) / result.ops_;
+
+    // latency pass
+    lrucache::LatencyRecorder recorder;
+    for (size_t i = 0; i < workload.ops_.size(); ++i) {
+        if (i % kLatencySampling != 0) {
+            applyOp(*cache, workload.ops_[i]);
+            continue;
+        }
+        auto op_start = std::chrono::steady_clock::now();
+        applyOp(*cache, workload.ops_[i]);
+        recorder.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - op_start).count()));
+    }
+    auto histogram = recorder.snapshot();
+    result.p50_ = histogram.percentile(0.5);
+    result.p99_ = histogram.percentile(0.99);
+    result.p999_ = histogram.percentile(0.999);
+    return result;
+}
+
+// Zipf 0.9 reads by every thread on its own trace, shared ShardedLRUCache
+template <typename Base>
+Result runThreads(const Options& options, const std::string& cache_name, size_t size, unsigned threads) {
+    using Cache = lrucache::ShardedLRUCache<Base, 16>;
+    Result result;
+    result.cache_ = "ShardedLRUCache<" + cache_name + ", 16>";
+    result.workload_ = "mt-zipf-0.9";
+    result.size_ = size;
+    result.threads_ = threads;
+
+    size_t per_thread = opsFor(options, size) / threads;
+    std::vector<std::vector<Op>> traces;
+    for (unsigned t = 0; t < threads; ++t) {
+        traces.push_back(zipfTrace(per_thread, 10 * size, 0.9, t + 1));
+    }
+    result.ops_ = per_thread * threads;
+
+    size_t live_before = g_live_bytes.load();
+    auto cache = std::make_unique<Cache>(size);
+    for (auto& trace : traces) {
+        for (auto& op : trace) {
+            applyOp(*cache, op);
+        }
+    }
+    result.bytes_per_entry_ = static_cast<double>(g_live_bytes.load() - live_before) / std::max<size_t>(cache->size(), 1);
+
+    lrucache::LatencyRecorder recorder;
+    std::atomic<size_t> hits{0};
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&cache, &recorder, &hits, &trace = traces[t]]() {
+            size_t local_hits = 0;
+            for (size_t i = 0; i < trace.size(); ++i) {
+                if (i % kLatencySampling != 0) {
+                    local_hits += applyOp(*cache, trace[i]) ? 1 : 0;
+                    continue;
+                }
+                auto op_start = std::chrono::steady_clock::now();
+                local_hits += applyOp(*cache, trace[i]) ? 1 : 0;
+                recorder.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - op_start).count()));
+            }
+            hits += local_hits;
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.ops_per_sec_ = result.ops_ / elapsed;
+    result.hit_ratio_ = static_cast<double>(hits.load()) / result.ops_;
+    auto histogram = recorder.snapshot();
+    result.p50_ = histogram.percentile(0.5);
+    result.p99_ = histogram.percentile(0.99);
+    result.p999_ = histogram.percentile(0.999);
+    return result;
+}
+
+class Runner {
+public:
+    explicit Runner(const Options& options)
+        : options_(options)
+    {
+
+    }
+
+    template <typename T>
+    void single(const std::string& name) {
+        if (!selected(name)) {
+            return;
+        }
+        for (size_t size : options_.sizes) {
+            for (auto& workload : workloadsFor(options_, size)) {
+                report(runSingle<T>(options_, name, workload, size));
+            }
+        }
+    }
+
+    template <typename Base>
+    void threaded(const std::string& name) {
+        if (!selected("ShardedLRUCache<" + name)) {
+            return;
+        }
+        for (size_t size : options_.sizes) {
+            for (unsigned threads : options_.threads) {
+                report(runThreads<Base>(options_, name, size, threads));
+            }
+        }
+    }
+
+    const std::vector<Result>& results() const { return results_; }
+
+private:
+    const Options& options_;
+    std::vector<Result> results_;
+
+    bool selected(const std::string& name) const {
+        return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+    }
+
+    // With --json - the JSON goes to stdout and the report lines to stderr
+    void report(Result result) {
+        std::ostream& out = options_.json == "-" ? std::cerr : std::cout;
+        out << result.cache_ << " " << result.workload_ << " size=" << result.size_
+            << " threads=" << result.threads_
+            << " ops/s=" << static_cast<uint64_t>(result.ops_per_sec_)
+            << " p50=" << result.p50_ << "ns p99=" << result.p99_ << "ns p999=" << result.p999_ << "ns"
+            << " bytes/entry=" << static_cast<uint64_t>(result.bytes_per_entry_)
+            << " hit=" << result.hit_ratio_;
+        if (result.llc_misses_per_op_) {
+            out << " llc-miss/op=" << *result.llc_misses_per_op_
+                << " branch-miss/op=" << *result.branch_misses_per_op_;
+        }
+        out << std::endl;
+        results_.push_back(std::move(result));
+    }
+};
+
+std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+std::string jsonNumber(const std::optional<double>& value) {
+    if (!value) {
+        return "null";
+    }
+    std::ostringstream s;
+    s << *value;
+    return s.str();
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+        out << "  {\"cache\": " << jsonString(r.cache_)
+            << ", \"workload\": " << jsonString(r.workload_)
+            << ", \"size\": " << r.size_
+            << ", \"threads\": " << r.threads_
+            << ", \"ops\": " << r.ops_
+            << ", \"ops_per_sec\": " << jsonNumber(r.ops_per_sec_)
+            << ", \"p50_ns\": " << r.p50_
+            << ", \"p99_ns\": " << r.p99_
+            << ", \"p999_ns\": " << r.p999_
+            << ", \"bytes_per_entry\": " << jsonNumber(r.bytes_per_entry_)
+            << ", \"hit_ratio\": " << jsonNumber(r.hit_ratio_)
+            << ", \"llc_misses_per_op\": " << jsonNumber(r.llc_misses_per_op_)
+            << ", \"branch_misses_per_op\": " << jsonNumber(r.branch_misses_per_op_)
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+template <typename T>
+std::vector<T> parseList(const std::string& s) {
+    std::vector<T> values;
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        values.push_back(static_cast<T>(std::stoull(item)));
+    }
+    return values;
+}
+
+void usage() {
+    std::cerr << "usage: LRUCacheBench [--sizes 1000,10000,...] [--max-size N] [--threads 1,2,4,8] [--ops N]\n"
+                 "                     [--filter substring] [--json file|-] [--perf]\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--sizes" && has_value) {
+            options.sizes = parseList<size_t>(argv[++i]);
+        } else if (arg == "--max-size" && has_value) {
+            // 1K, 10K, ... up to N (100M needs tens of GB with the node based maps)
+            size_t max_size = std::stoull(argv[++i]);
+            options.sizes.clear();
+            for (size_t size = 1000; size <= max_size; size *= 10) {
+                options.sizes.push_back(size);
+            }
+        } else if (arg == "--threads" && has_value) {
+            options.threads = parseList<unsigned>(argv[++i]);
+        } else if (arg == "--ops" && has_value) {
+            options.ops = std::stoull(argv[++i]);
+        } else if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--json" && has_value) {
+            options.json = argv[++i];
+        } else if (arg == "--perf") {
+            options.perf = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (options.perf && !PerfCounters().available()) {
+        std::cerr << "perf_event_open is not available, the hardware counters are not reported\n";
+    }
+
+    using K = unsigned long;
+    using V = unsigned long;
+    using namespace lrucache;
+    Runner runner(options);
+
+    runner.single<LRUCache<BaseUniqPtr<K, V, std::unordered_map>>>("LRUCache<BaseUniqPtr U>");
+    runner.single<LRUCache<BaseUniqPtr<K, V, std::map>>>("LRUCache<BaseUniqPtr M>");
+    runner.single<LRUCache<BaseVal<K, V, std::unordered_map>>>("LRUCache<BaseVal U>");
+    runner.single<LRUCache<BaseVal<K, V, std::map>>>("LRUCache<BaseVal M>");
+    runner.single<LRUCacheUniqPtr<K, V, std::unordered_map>>("LRUCacheUniqPtr U");
+    runner.single<LRUCacheUniqPtr<K, V, std::map>>("LRUCacheUniqPtr M");
+    runner.single<LRUCacheVal<K, V, std::unordered_map>>("LRUCacheVal U");
+    runner.single<LRUCacheVal<K, V, std::map>>("LRUCacheVal M");
+    runner.single<LRUCache<BaseFlat<K, V>>>("LRUCache<BaseFlat>");
+
+    runner.threaded<BaseUniqPtr<K, V, std::unordered_map>>("BaseUniqPtr U");
+    runner.threaded<BaseVal<K, V, std::unordered_map>>("BaseVal U");
+    runner.threaded<BaseFlat<K, V>>("BaseFlat");
+
+    if (options.json == "-") {
+        writeJson(std::cout, runner.results());
+    } else if (!options.json.empty()) {
+        std::ofstream out(options.json);
+        writeJson(out, runner.results());
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Cache-aside loading with a slow backend: thread blocking LoadingCache::getOrLoad() on a pool of threads against
+// coroutines awaiting AsyncCache::asyncGet() on a pool of the same size, see tests/README.md
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "lrucache.h"
+#include "lrucache_loading.h"
+#include "lrucache_coro.h"
+#include "coro_pool.h"
+#include "zipf.h"
+
+namespace {
+
+using Key = uint64_t;
+using Value = uint64_t;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    unsigned threads = 8;
+    size_t requests = 20000;
+    uint64_t keys = 100000;
+    size_t capacity = 10000;
+    double skew = 0.9;
+    std::chrono::microseconds latency{1000};
+};
+
+std::vector<Key> requestKeys(const Options& options) {
+    std::mt19937_64 rng(1);
+    ZipfGenerator zipf(options.keys, options.skew);
+    std::vector<Key> keys(options.requests);
+    for (auto& key : keys) {
+        key = zipf(rng);
+    }
+    return keys;
+}
+
+void report(const std::string& name, const Options& options, double seconds, size_t loads) {
+    std::cout << name << ": " << static_cast<uint64_t>(options.requests / seconds) << " requests/s, "
+              << loads << " loads, " << seconds << " s\n";
+}
+
+// Every pool thread takes the next request and blocks in the loader on a miss
+void runBlocking(const Options& options, const std::vector<Key>& keys) {
+    lrucache::LoadingCache<lrucache::BaseVal<Key, Value, std::unordered_map>> cache(options.capacity);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> loads{0};
+    auto loader = [&](Key key) {
+        ++loads;
+        std::this_thread::sleep_for(options.latency);
+        return key * 2;
+    };
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < options.threads; ++t) {
+        threads.emplace_back([&]() {
+            for (size_t i = next++; i < keys.size(); i = next++) {
+                cache.getOrLoad(keys[i], loader);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    report("blocking LoadingCache", options, std::chrono::duration<double>(Clock::now() - start).count(), loads);
+}
+
+lrucache::Task<void> request(
+    lrucache::AsyncCache<lrucache::LRUCache<lrucache::BaseVal<Key, Value, std::unordered_map>>>& cache,
+    Key key,
+    ThreadPool& pool,
+    std::chrono::microseconds latency,
+    std::atomic<size_t>& loads)
+{
+    co_await cache.asyncGet(key, [&pool, latency, &loads](Key k) -> lrucache::Task<Value> {
+        ++loads;
+        co_await pool.sleepFor(latency);
+        co_return k * 2;
+    });
+}
+
+// All the requests are coroutines, a miss suspends until the timer of the backend resumes it
+void runCoroutines(const Options& options, const std::vector<Key>& keys) {
+    ThreadPool pool(options.threads);
+    lrucache::AsyncCache<lrucache::LRUCache<lrucache::BaseVal<Key, Value, std::unordered_map>>> cache(
+        options.capacity, [&pool](std::coroutine_handle<> handle) { pool.post(handle); });
+    std::atomic<size_t> loads{0};
+    auto start = Clock::now();
+    for (Key key : keys) {
+        pool.spawn(request(cache, key, pool, options.latency, loads));
+    }
+    pool.waitIdle();
+    report("coroutine AsyncCache", options, std::chrono::duration<double>(Clock::now() - start).count(), loads);
+}
+
+void usage() {
+    std::cerr << "usage: LRUCacheCoroBench [--threads N] [--requests N] [--keys N] [--capacity N] [--skew S]\n"
+                 "                         [--latency-us backend latency]\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                usage();
+                return 1;
+            }
+            std::string value = argv[++i];
+            if (arg == "--threads") {
+                options.threads = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+            } else if (arg == "--requests") {
+                options.requests = std::stoull(value);
+            } else if (arg == "--keys") {
+                options.keys = std::stoull(value);
+            } else if (arg == "--capacity") {
+                options.capacity = std::stoull(value);
+            } else if (arg == "--skew") {
+                options.skew = std::stod(value);
+            } else if (arg == "--latency-us") {
+                options.latency = std::chrono::microseconds(std::stoll(value));
+            } else {
+                usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        usage();
+        return 1;
+    }
+
+    std::cout << options.threads << " threads, " << options.requests << " requests over " << options.keys
+              << " keys (Zipf " << options.skew << "), capacity " << options.capacity << ", backend latency "
+              << options.latency.count() << " us\n";
+    auto keys = requestKeys(options);
+    runBlocking(options, keys);
+    runCoroutines(options, keys);
+    return 0;
+}
@@ -0,0 +1,158 @@
+#ifndef LRUCACHE_TESTS_CORO_POOL_H
+#define LRUCACHE_TESTS_CORO_POOL_H
+
+#include <coroutine>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <functional>
+
+#include "lrucache_coro.h"
+
+// Executor of the coroutine tests and benchmark: a fixed pool of threads resuming coroutine handles, and a timer
+// thread which hands the sleeping coroutines back to the pool when their deadline passes (a stand-in for async I/O)
+class ThreadPool {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this]() { work(); });
+        }
+        timer_ = std::thread([this]() { runTimers(); });
+    }
+
+    // Runs the queued handles, then stops
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        timer_cv_.notify_all();
+        timer_.join();
+        work_cv_.notify_all();
+        for (auto& w : workers_) {
+            w.join();
+        }
+    }
+
+    void post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(handle);
+        }
+        work_cv_.notify_one();
+    }
+
+    // co_await pool.schedule() continues on a pool thread
+    auto schedule() {
+        struct Awaiter {
+            ThreadPool& pool_;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { pool_.post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    // co_await pool.sleepFor(d) continues on a pool thread after d, no thread is blocked meanwhile
+    auto sleepFor(Clock::duration duration) {
+        struct Awaiter {
+            ThreadPool& pool_;
+            Clock::time_point deadline_;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { pool_.addTimer(deadline_, handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, Clock::now() + duration};
+    }
+
+    // Runs the task on the pool, detached; waitIdle() waits for all the spawned tasks
+    void spawn(lrucache::Task<void> task) {
+        ++running_;
+        runDetached(std::move(task), *this);
+    }
+
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_cv_.wait(lock, [this]() { return running_ == 0; });
+    }
+
+private:
+    struct Timer {
+        Clock::time_point deadline_;
+        std::coroutine_handle<> handle_;
+        bool operator>(const Timer& other) const { return deadline_ > other.deadline_; }
+    };
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable timer_cv_;
+    std::condition_variable idle_cv_;
+    std::deque<std::coroutine_handle<>> queue_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    std::atomic<size_t> running_{0};
+    bool stopping_{false};
+    std::vector<std::thread> workers_;
+    std::thread timer_;
+
+    static lrucache::coro_detail::Detached runDetached(lrucache::Task<void> task, ThreadPool& pool) {
+        co_await pool.schedule();
+        try {
+            co_await task;
+        } catch (...) {
+        }
+        std::lock_guard<std::mutex> lock(pool.mutex_);
+        if (--pool.running_ == 0) {
+            pool.idle_cv_.notify_all();
+        }
+    }
+
+    void addTimer(Clock::time_point deadline, std::coroutine_handle<> handle) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            timers_.push({deadline, handle});
+        }
+        timer_cv_.notify_one();
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            work_cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            auto handle = queue_.front();
+            queue_.pop_front();
+            lock.unlock();
+            handle.resume();
+            lock.lock();
+        }
+    }
+
+    void runTimers() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_ || !timers_.empty()) {
+            if (timers_.empty()) {
+                timer_cv_.wait(lock);
+                continue;
+            }
+            auto deadline = timers_.top().deadline_;
+            if (Clock::now() < deadline) {
+                timer_cv_.wait_until(lock, deadline);
+                continue;
+            }
+            queue_.push_back(timers_.top().handle_);
+            timers_.pop();
+            work_cv_.notify_one();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+// Tests of the C++20 coroutine API (lrucache_coro.h), built apart from main.cpp which stays C++17
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+#include "lrucache.h"
+#include "lrucache_alt.h"
+#include "lrucache_coro.h"
+#include "coro_pool.h"
+
+using namespace std::chrono_literals;
+
+lrucache::Task<int> answer() {
+    co_return 42;
+}
+
+lrucache::Task<int> twice() {
+    int a = co_await answer();
+    int b = co_await answer();
+    co_return a + b;
+}
+
+lrucache::Task<int> failing() {
+    throw std::runtime_error("failed");
+    co_return 0;
+}
+
+TEST_CASE( "lrucache::Task", "[coro]" ) {
+    REQUIRE( lrucache::syncWait(twice()) == 84 );
+    REQUIRE_THROWS_AS( lrucache::syncWait(failing()), std::runtime_error );
+
+    ThreadPool pool(2);
+    auto onPool = [&pool]() -> lrucache::Task<std::thread::id> {
+        co_await pool.sleepFor(1ms);
+        co_return std::this_thread::get_id();
+    };
+    REQUIRE( lrucache::syncWait(onPool()) != std::this_thread::get_id() );
+}
+
+template <typename Cache>
+void testAsyncGet() {
+    ThreadPool pool(4);
+    Cache cache(100, [&pool](std::coroutine_handle<> handle) { pool.post(handle); });
+    std::atomic<int> loads{0};
+    auto loader = [&pool, &loads](const std::string& key) -> lrucache::Task<std::string> {
+        ++loads;
+        co_await pool.sleepFor(50ms);
+        co_return key + "!";
+    };
+
+    // 32 coroutines miss the same key: one load, the others parked on it
+    std::vector<std::string> results(32);
+    for (size_t i = 0; i < results.size(); ++i) {
+        pool.spawn([](Cache& c, decltype(loader) l, std::string& out) -> lrucache::Task<void> {
+            out = co_await c.asyncGet("key", l);
+        }(cache, loader, results[i]));
+    }
+    pool.waitIdle();
+    REQUIRE( loads == 1 );
+    for (auto& r : results) {
+        REQUIRE( r == "key!" );
+    }
+    REQUIRE( cache.loadsInFlight() == 0 );
+    REQUIRE( cache.get("key") == "key!" );
+    REQUIRE( lrucache::syncWait(cache.asyncGet("key", loader)) == "key!" );
+    REQUIRE( loads == 1 );
+
+    // the exception of the loader reaches the waiters, nothing is cached
+    auto failingLoader = [&pool, &loads](const std::string&) -> lrucache::Task<std::string> {
+        ++loads;
+        co_await pool.sleepFor(20ms);
+        throw std::runtime_error("backend down");
+    };
+    std::atomic<int> failures{0};
+    for (int i = 0; i < 8; ++i) {
+        pool.spawn([](Cache& c, decltype(failingLoader) l, std::atomic<int>& f) -> lrucache::Task<void> {
+            try {
+                co_await c.asyncGet("bad", l);
+            } catch (const std::runtime_error&) {
+                ++f;
+            }
+        }(cache, failingLoader, failures));
+    }
+    pool.waitIdle();
+    REQUIRE( failures == 8 );
+    REQUIRE( loads == 2 );
+    REQUIRE( !cache.get("bad") );
+}
+
+TEST_CASE( "lrucache::AsyncCache single flight", "[coro]" ) {
+    testAsyncGet<lrucache::AsyncCache<lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>>>>();
+    testAsyncGet<lrucache::AsyncCache<lrucache::LRUCacheUniqPtr<std::string, std::string, std::map>>>();
+}
+
+TEST_CASE( "lrucache::AsyncCache resumes the waiters inline by default", "[coro]" ) {
+    ThreadPool pool(2);
+    lrucache::AsyncCache<lrucache::LRUCache<lrucache::BaseVal<int, int, std::unordered_map>>> cache(10);
+    auto loader = [&pool](int key) -> lrucache::Task<int> {
+        co_await pool.sleepFor(10ms);
+        co_return key * 2;
+    };
+    std::vector<int> results(4);
+    for (size_t i = 0; i < results.size(); ++i) {
+        pool.spawn([](auto& c, auto l, int& out) -> lrucache::Task<void> {
+            out = co_await c.asyncGet(5, l);
+        }(cache, loader, results[i]));
+    }
+    pool.waitIdle();
+    REQUIRE( results == std::vector<int>{10, 10, 10, 10} );
+    REQUIRE( cache.size() == 1 );
+}
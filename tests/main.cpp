@@ -5,6 +5,10 @@
 //#include <list>
 #include <algorithm>
 #include <cassert>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <filesystem>
 
 
 #define CATCH_CONFIG_ENABLE_BENCHMARKING 1
@@ -13,6 +17,47 @@
 
 #include "lrucache.h"
 #include "lrucache_alt.h"
+#include "lrucache_sharded.h"
+#include "lrucache_buffered.h"
+#include "lrucache_weighted.h"
+#include "lrucache_expiring.h"
+#include "lrucache_generation.h"
+#include "lrucache_tinylfu.h"
+#include "lrucache_slru.h"
+#include "lrucache_2q.h"
+#include "lrucache_arc.h"
+#include "lrucache_clock.h"
+#include "lrucache_mrc.h"
+#include "lrucache_snapshot.h"
+#include "lrucache_loading.h"
+#include "lrucache_flat.h"
+#include "lrucache_swissmap.h"
+#if defined(__linux__)
+#include <sys/wait.h>
+#include "lrucache_shm.h"
+#endif
+#include "zipf.h"
+#include "trace.h"
+
+template <class K, class T> using TransparentMap = std::map<K, T, std::less<>>;
+template <class K, class T> using TransparentSwissMap = lrucache::SwissMap<K, T, lrucache::StringHash, std::equal_to<>>;
+#if defined(__cpp_lib_generic_unordered_lookup)
+template <class K, class T> using TransparentUnorderedMap = std::unordered_map<K, T, lrucache::StringHash, std::equal_to<>>;
+#endif
+
+// Counts the global heap allocations, used to check the allocation free code paths
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    ++g_allocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
 
 template <class T>
 void testCacheOps(T& cache) {
@@ -45,118 +90,2102 @@ void testCacheOps(T& cache) {
     REQUIRE( !opt.has_value() );   
 }
 
-TEST_CASE( "lrucache::LRUCache Ptr U ops", "[lru]" ) {
-    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::unordered_map>> cache(3);
+TEST_CASE( "lrucache::LRUCache Ptr U ops", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::unordered_map>> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Ptr M ops", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Val U ops", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Val M ops", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::map>> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Flat ops", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseFlat<std::string, std::string>> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Ptr S ops", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, lrucache::SwissMap>> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Val S ops", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, lrucache::SwissMap>> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheUniqPtr U ops", "[lru]" ) {
+    lrucache::LRUCacheUniqPtr<std::string, std::string, std::unordered_map> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheUniqPtr M ops", "[lru]" ) {
+    lrucache::LRUCacheUniqPtr<std::string, std::string, std::map> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheVal U ops", "[lru]" ) {
+    lrucache::LRUCacheVal<std::string, std::string, std::unordered_map> cache(3);
+
+    testCacheOps(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheVal M ops", "[lru]" ) {
+    lrucache::LRUCacheVal<std::string, std::string, std::map> cache(3);
+
+    testCacheOps(cache);
+}
+
+template <class T>
+void testCacheLRUStringToString(T& cache) {
+    using PV = std::vector<std::pair<std::string, std::string>>;  
+
+    REQUIRE( cache.size() == 0 );
+    cache.add("one", "jeden");    
+    REQUIRE( cache.getMRU(5) == PV{{"one", "jeden"}} );
+    cache.add("two", "dwa");
+    REQUIRE( cache.getMRU(5) == PV{{"two", "dwa"}, {"one", "jeden"}} );
+    cache.add("three", "trzy");
+    REQUIRE( cache.size() == 3 );
+    PV v{cache.getMRU(5)};
+    REQUIRE( v == PV{{"three", "trzy"}, {"two", "dwa"}, {"one", "jeden"}} );
+    auto x = cache.get("one");
+    v = cache.getMRU(3);
+    REQUIRE( v == PV{{"one", "jeden"}, {"three", "trzy"}, {"two", "dwa"}} );
+    v = cache.getMRU(2);
+    REQUIRE( v == PV{{"one", "jeden"}, {"three", "trzy"}} );    
+    x = cache.get("two");
+    v = cache.getMRU(4);
+    REQUIRE( v == PV{{"two", "dwa"}, {"one", "jeden"}, {"three", "trzy"}} );    
+    cache.add("four", "cztery");    
+    v = cache.getMRU(4);
+    REQUIRE( v == PV{{"four", "cztery"}, {"two", "dwa"}, {"one", "jeden"}} );    
+}
+
+TEST_CASE( "lrucache::LRUCache Ptr U order getMRU", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::unordered_map>> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Ptr M order getMRU", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Val U order getMRU", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Val M order getMRU", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::map>> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Flat order getMRU", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseFlat<std::string, std::string>> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Ptr S order getMRU", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, lrucache::SwissMap>> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCache Val S order getMRU", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, lrucache::SwissMap>> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheUniqPtr U order getMRU", "[lru]" ) {
+    lrucache::LRUCacheUniqPtr<std::string, std::string, std::unordered_map> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheUniqPtr M order getMRU", "[lru]" ) {
+    lrucache::LRUCacheUniqPtr<std::string, std::string, std::map> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheVal U order getMRU", "[lru]" ) {
+    lrucache::LRUCacheVal<std::string, std::string, std::unordered_map> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheVal M order getMRU", "[lru]" ) {
+    lrucache::LRUCacheVal<std::string, std::string, std::map> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::LRUCacheVal S order getMRU", "[lru]" ) {
+    lrucache::LRUCacheVal<std::string, std::string, lrucache::SwissMap> cache(3);
+    testCacheLRUStringToString(cache);
+}
+
+TEST_CASE( "lrucache::SwissMap matches std::unordered_map", "[swissmap]" ) {
+    lrucache::SwissMap<unsigned long, unsigned long> swiss;
+    std::unordered_map<unsigned long, unsigned long> reference;
+    std::mt19937_64 rng(3);
+    bool same = true;
+    for (unsigned long i = 0; i < 200000; ++i) {
+        // the key range grows, then shrinks, so the table both grows and fills with tombstones
+        unsigned long range = i < 100000 ? 10 + i / 20 : 5000 - (i - 100000) / 25;
+        unsigned long key = rng() % range;
+        switch (rng() % 4) {
+        case 0:
+        case 1: {
+            bool inserted = swiss.insert({key, i}).second;
+            same = same && inserted == reference.insert({key, i}).second;
+            break;
+        }
+        case 2:
+            same = same && swiss.erase(key) == reference.erase(key);
+            break;
+        default: {
+            auto it = swiss.find(key);
+            auto ref = reference.find(key);
+            same = same && (it == swiss.end()) == (ref == reference.end());
+            same = same && (it == swiss.end() || it->second == ref->second);
+        }
+        }
+        same = same && swiss.size() == reference.size();
+    }
+    REQUIRE( same );
+
+    auto it = swiss.find(reference.begin()->first);
+    REQUIRE( it != swiss.end() );
+    auto node = swiss.extract(it);
+    node.key() = 1000000;
+    swiss.insert(std::move(node));
+    REQUIRE( swiss.find(reference.begin()->first) == swiss.end() );
+    REQUIRE( swiss.find(1000000) == it );
+
+    swiss.clear();
+    REQUIRE( swiss.size() == 0 );
+    REQUIRE( swiss.find(1000000) == swiss.end() );
+}
+
+TEST_CASE( "lrucache::LRUCache Flat matches BaseVal on random operations", "[lru][flat]" ) {
+    lrucache::LRUCache<lrucache::BaseFlat<unsigned long, unsigned long>> flat(100);
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>> reference(100);
+    std::mt19937_64 rng(7);
+    bool same = true;
+    for (unsigned long i = 0; i < 50000; ++i) {
+        unsigned long key = rng() % 300;
+        if (rng() % 2) {
+            same = same && flat.add(key, i) == reference.add(key, i);
+        } else {
+            same = same && flat.get(key) == reference.get(key);
+        }
+        if (i % 1000 == 0) {
+            same = same && flat.getMRU(100) == reference.getMRU(100);
+        }
+    }
+    REQUIRE( same );
+    REQUIRE( flat.size() == 100 );
+    flat.clear();
+    REQUIRE( flat.size() == 0 );
+    REQUIRE( !flat.get(1).has_value() );
+}
+
+TEST_CASE( "lrucache::LRUCache Flat does not allocate after construction", "[lru][flat]" ) {
+    lrucache::LRUCache<lrucache::BaseFlat<unsigned long, unsigned long>> cache(1000);
+    size_t allocations = g_allocations;
+    volatile unsigned long r{0};
+    for (unsigned long i = 0; i < 5000; ++i) {
+        cache.add(i % 1700, i);
+        r = r + cache.get(i % 1300).value_or(0);
+    }
+    cache.clear();
+    for (unsigned long i = 0; i < 5000; ++i) {
+        cache.add(i, i);
+    }
+    REQUIRE( g_allocations == allocations );
+    REQUIRE( cache.size() == 1000 );
+}
+
+TEST_CASE( "lrucache::LRUCache pmr ops", "[lru][pmr]" ) {
+    std::pmr::monotonic_buffer_resource resource;
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::pmr::unordered_map>> cache1(3, &resource);
+    testCacheOps(cache1);
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::pmr::map>> cache2(3, &resource);
+    testCacheLRUStringToString(cache2);
+    lrucache::LRUCacheUniqPtr<std::string, std::string, lrucache::pmr::SwissMap> cache3(3, &resource);
+    testCacheOps(cache3);
+    lrucache::LRUCacheVal<std::string, std::string, std::pmr::unordered_map> cache4(3, &resource);
+    testCacheLRUStringToString(cache4);
+}
+
+// Fills, clears and refills a cache allocating from a NodePool sized by the cache, counting the global allocations
+template <typename T>
+void testNodePoolNoGlobalAllocations() {
+    const size_t Size = 5000;
+    lrucache::NodePool pool(T::nodePoolBytes(Size), std::pmr::new_delete_resource());
+    T cache(Size, &pool);
+
+    size_t allocations = g_allocations;
+    for (int round = 0; round < 3; ++round) {
+        for (unsigned long i = 0; i < 3 * Size; ++i) {
+            cache.add(i, i);
+        }
+        cache.clear();
+    }
+    for (unsigned long i = 0; i < Size; ++i) {
+        cache.add(i, i);
+    }
+    REQUIRE( g_allocations == allocations );
+    REQUIRE( pool.upstreamAllocations() == 0 );
+    REQUIRE( cache.size() == Size );
+}
+
+TEST_CASE( "lrucache::NodePool no global allocations", "[lru][pmr]" ) {
+    testNodePoolNoGlobalAllocations<lrucache::LRUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, std::pmr::unordered_map>>>();
+    testNodePoolNoGlobalAllocations<lrucache::LRUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, std::pmr::map>>>();
+    testNodePoolNoGlobalAllocations<lrucache::LRUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, lrucache::pmr::SwissMap>>>();
+    testNodePoolNoGlobalAllocations<lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::pmr::unordered_map>>>();
+    testNodePoolNoGlobalAllocations<lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::pmr::map>>>();
+    testNodePoolNoGlobalAllocations<lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, lrucache::pmr::SwissMap>>>();
+    testNodePoolNoGlobalAllocations<lrucache::LRUCacheUniqPtr<unsigned long, unsigned long, std::pmr::unordered_map>>();
+    testNodePoolNoGlobalAllocations<lrucache::LRUCacheVal<unsigned long, unsigned long, std::pmr::map>>();
+}
+
+TEST_CASE( "lrucache::LRUCache transparent map ops", "[lru][heterogeneous]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, TransparentMap>> cache1(3);
+    testCacheOps(cache1);
+    lrucache::LRUCacheUniqPtr<std::string, std::string, TransparentSwissMap> cache2(3);
+    testCacheLRUStringToString(cache2);
+}
+
+// Lookups by std::string_view of long keys must not build a std::string, only inserting a new key may allocate
+template <typename T>
+void testHeterogeneousLookupNoAllocations(T& cache) {
+    std::vector<std::string> keys;
+    for (unsigned long i = 0; i < 100; ++i) {
+        keys.push_back(std::string(60, 'k') + std::to_string(1000 + i));
+        cache.add(std::string_view(keys.back()), i);
+    }
+    REQUIRE( keys[0].size() == 64 );
+
+    size_t allocations = g_allocations;
+    unsigned long sum = 0;
+    for (unsigned long i = 0; i < 100; ++i) {
+        std::string_view key(keys[i]);
+        sum += cache.get(key).value_or(1000);
+        sum += cache.contains(key) ? 0 : 1000;
+        cache.add(key, i);
+    }
+    REQUIRE( g_allocations == allocations );
+    REQUIRE( sum == 99 * 100 / 2 );
+    REQUIRE( !cache.contains(std::string_view("missing")) );
+    REQUIRE( cache.add(std::string_view("new"), 1UL) == false );
+    REQUIRE( cache.get("new") == 1UL );
+}
+
+TEST_CASE( "lrucache heterogeneous lookup does not allocate", "[lru][heterogeneous]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, unsigned long, TransparentMap>> cache1(200);
+    testHeterogeneousLookupNoAllocations(cache1);
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, unsigned long, TransparentSwissMap>> cache2(200);
+    testHeterogeneousLookupNoAllocations(cache2);
+    lrucache::LRUCache<lrucache::BaseFlat<std::string, unsigned long, lrucache::StringHash, std::equal_to<>>> cache3(200);
+    testHeterogeneousLookupNoAllocations(cache3);
+    lrucache::LRUCacheVal<std::string, unsigned long, TransparentSwissMap> cache4(200);
+    testHeterogeneousLookupNoAllocations(cache4);
+    lrucache::LRUCacheUniqPtr<std::string, unsigned long, TransparentMap> cache5(200);
+    testHeterogeneousLookupNoAllocations(cache5);
+#if defined(__cpp_lib_generic_unordered_lookup)
+    lrucache::LRUCache<lrucache::BaseVal<std::string, unsigned long, TransparentUnorderedMap>> cache6(200);
+    testHeterogeneousLookupNoAllocations(cache6);
+#endif
+}
+
+// peek() must leave the order alone, getPtr(), getRef() and visit() modify the value in place and promote it
+template <class T>
+void testCacheInPlaceAccess(T& cache) {
+    using PV = std::vector<std::pair<std::string, std::string>>;
+
+    cache.add("one", "jeden");
+    cache.add("two", "dwa");
+    cache.add("three", "trzy");
+    REQUIRE( cache.peek("one") == std::string("jeden") );
+    REQUIRE( !cache.peek("four").has_value() );
+    REQUIRE( cache.getMRU(3) == PV{{"three", "trzy"}, {"two", "dwa"}, {"one", "jeden"}} );
+
+    std::string* p = cache.getPtr("one");
+    REQUIRE( p != nullptr );
+    *p += "!";
+    REQUIRE( cache.getPtr("four") == nullptr );
+    REQUIRE( cache.getMRU(3) == PV{{"one", "jeden!"}, {"three", "trzy"}, {"two", "dwa"}} );
+
+    auto ref = cache.getRef("two");
+    REQUIRE( ref.has_value() );
+    ref->get() = "DWA";
+    REQUIRE( !cache.getRef("four").has_value() );
+    REQUIRE( cache.getMRU(3) == PV{{"two", "DWA"}, {"one", "jeden!"}, {"three", "trzy"}} );
+
+    size_t length = 0;
+    REQUIRE( cache.visit("three", [&length](std::string& v) { length = v.size(); v.clear(); }) );
+    REQUIRE( length == 4 );
+    REQUIRE( !cache.visit("four", [](std::string&) { FAIL( "visited a missing key" ); }) );
+    REQUIRE( cache.getMRU(3) == PV{{"three", ""}, {"two", "DWA"}, {"one", "jeden!"}} );
+
+    // add() of an existing key assigns through the same storage
+    p = cache.getPtr("two");
+    cache.add("two", "dwa");
+    REQUIRE( *p == "dwa" );
+}
+
+TEST_CASE( "lrucache::LRUCache peek, getPtr, getRef and visit", "[lru]" ) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::unordered_map>> cache1(3);
+    testCacheInPlaceAccess(cache1);
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::map>> cache2(3);
+    testCacheInPlaceAccess(cache2);
+    lrucache::LRUCache<lrucache::BaseFlat<std::string, std::string>> cache3(3);
+    testCacheInPlaceAccess(cache3);
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, lrucache::SwissMap>> cache4(3);
+    testCacheInPlaceAccess(cache4);
+    lrucache::LRUCacheUniqPtr<std::string, std::string, std::map> cache5(3);
+    testCacheInPlaceAccess(cache5);
+    lrucache::LRUCacheVal<std::string, std::string, std::unordered_map> cache6(3);
+    testCacheInPlaceAccess(cache6);
+}
+
+// Counts the copies, the value type of the move aware add() and emplace() tests
+struct CopyCounted {
+    static inline size_t copies = 0;
+
+    std::string s;
+
+    CopyCounted() = default;
+    explicit CopyCounted(std::string v) : s(std::move(v)) {}
+    CopyCounted(const char* a, const char* b) : s(std::string(a) + b) {}
+    CopyCounted(const CopyCounted& other) : s(other.s) { ++copies; }
+    CopyCounted(CopyCounted&&) = default;
+    CopyCounted& operator=(const CopyCounted& other) { s = other.s; ++copies; return *this; }
+    CopyCounted& operator=(CopyCounted&&) = default;
+};
+
+template <class T>
+void testCacheMoveOnly(T& cache) {
+    auto value = [&cache](unsigned long key) {
+        int v = -1;
+        cache.visit(key, [&v](std::unique_ptr<int>& p) { v = *p; });
+        return v;
+    };
+
+    REQUIRE( !cache.add(1UL, std::make_unique<int>(1)) );
+    REQUIRE( !cache.emplace(2UL, new int(2)) );
+    REQUIRE( cache.add(1UL, std::make_unique<int>(10)) );
+    REQUIRE( value(1) == 10 );
+
+    auto p = std::make_unique<int>(20);
+    REQUIRE( !cache.tryEmplace(2UL, std::move(p)) );
+    REQUIRE( p != nullptr );
+    REQUIRE( value(2) == 2 );
+    REQUIRE( cache.tryEmplace(3UL, std::move(p)) );
+    REQUIRE( p == nullptr );
+    REQUIRE( value(3) == 20 );
+
+    // 1 is the least recently used, its node is reused for 4
+    REQUIRE( cache.tryEmplace(4UL, new int(4)) );
+    REQUIRE( value(1) == -1 );
+    REQUIRE( value(4) == 4 );
+    REQUIRE( cache.getMRUKeys(3) == std::vector<unsigned long>{4, 3, 2} );
+}
+
+template <class T>
+void testCacheNoCopies(T& cache) {
+    CopyCounted::copies = 0;
+    std::string key("one");
+    cache.add(std::move(key), CopyCounted("jeden"));
+    cache.emplace("two", "d", "wa");
+    cache.emplace(std::string("three"), std::string("trzy"));
+    cache.tryEmplace("three", "not", "used");
+    cache.add("two", CopyCounted("DWA"));
+    REQUIRE( cache.getRef("three")->get().s == "trzy" );
+    // evicts one and then two
+    cache.emplace("four", "czt", "ery");
+    cache.add("five", CopyCounted("piec"));
+    REQUIRE( CopyCounted::copies == 0 );
+    REQUIRE( !cache.contains("one") );
+    REQUIRE( !cache.contains("two") );
+    REQUIRE( cache.getRef("four")->get().s == "cztery" );
+    REQUIRE( cache.getRef("five")->get().s == "piec" );
+}
+
+TEST_CASE( "lrucache move only values", "[lru][move]" ) {
+    using Ptr = std::unique_ptr<int>;
+    lrucache::LRUCache<lrucache::BaseUniqPtr<unsigned long, Ptr, std::unordered_map>> cache1(3);
+    testCacheMoveOnly(cache1);
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, Ptr, std::map>> cache2(3);
+    testCacheMoveOnly(cache2);
+    lrucache::LRUCache<lrucache::BaseFlat<unsigned long, Ptr>> cache3(3);
+    testCacheMoveOnly(cache3);
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, Ptr, lrucache::SwissMap>> cache4(3);
+    testCacheMoveOnly(cache4);
+    lrucache::LRUCacheUniqPtr<unsigned long, Ptr, std::map> cache5(3);
+    testCacheMoveOnly(cache5);
+    lrucache::LRUCacheVal<unsigned long, Ptr, std::unordered_map> cache6(3);
+    testCacheMoveOnly(cache6);
+    lrucache::ShardedLRUCache<lrucache::BaseVal<unsigned long, Ptr, std::unordered_map>, 1> cache7(3);
+    testCacheMoveOnly(cache7);
+    lrucache::BufferedLRUCache<lrucache::BaseUniqPtr<unsigned long, Ptr, std::unordered_map>> cache8(3);
+    testCacheMoveOnly(cache8);
+}
+
+TEST_CASE( "lrucache add and emplace do not copy", "[lru][move]" ) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, CopyCounted, std::unordered_map>> cache1(3);
+    testCacheNoCopies(cache1);
+    lrucache::LRUCache<lrucache::BaseVal<std::string, CopyCounted, std::map>> cache2(3);
+    testCacheNoCopies(cache2);
+    lrucache::LRUCache<lrucache::BaseFlat<std::string, CopyCounted>> cache3(3);
+    testCacheNoCopies(cache3);
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, CopyCounted, lrucache::SwissMap>> cache4(3);
+    testCacheNoCopies(cache4);
+    lrucache::LRUCacheUniqPtr<std::string, CopyCounted, std::unordered_map> cache5(3);
+    testCacheNoCopies(cache5);
+    lrucache::LRUCacheVal<std::string, CopyCounted, std::map> cache6(3);
+    testCacheNoCopies(cache6);
+}
+
+struct StringSizeWeigher {
+    size_t operator()(const std::string&, const std::string& value) const { return value.size(); }
+};
+
+template <class T>
+void testWeightedCache(T& cache) {
+    using KV = std::vector<std::string>;
+
+    REQUIRE( cache.maxWeight() == 10 );
+    REQUIRE( !cache.add("a", "12345") );
+    REQUIRE( !cache.add("b", "123") );
+    REQUIRE( cache.totalWeight() == 8 );
+    cache.add("c", "1234");
+    REQUIRE( cache.totalWeight() == 7 );
+    REQUIRE( cache.getMRUKeys(5) == KV{"c", "b"} );
+
+    // too heavy, rejected
+    REQUIRE( !cache.add("d", "12345678901") );
+    REQUIRE( !cache.contains("d") );
+    REQUIRE( cache.totalWeight() == 7 );
+
+    // growing b evicts c
+    REQUIRE( cache.add("b", "1234567") );
+    REQUIRE( cache.totalWeight() == 7 );
+    REQUIRE( cache.getMRUKeys(5) == KV{"b"} );
+
+    // a value too heavy for an existing key removes it
+    REQUIRE( cache.add("b", "12345678901") );
+    REQUIRE( !cache.contains("b") );
+    REQUIRE( cache.totalWeight() == 0 );
+    REQUIRE( cache.size() == 0 );
+
+    // the element count is limited as well (to 3)
+    cache.add("e", "1");
+    cache.add("f", "12");
+    cache.add("g", "123");
+    cache.add("h", "1234");
+    REQUIRE( cache.getMRUKeys(5) == KV{"h", "g", "f"} );
+    REQUIRE( cache.totalWeight() == 9 );
+
+    REQUIRE( !cache.tryEmplace("g", "12345") );
+    REQUIRE( cache.peek("g") == std::string("123") );
+    REQUIRE( !cache.tryEmplace("i", "12345678901") );
+    REQUIRE( cache.tryEmplace("i", 3, 'x') );
+    REQUIRE( cache.getMRUKeys(5) == KV{"i", "g", "h"} );
+    REQUIRE( cache.totalWeight() == 10 );
+
+    // visit() reweighs the modified value
+    REQUIRE( cache.visit("g", [](std::string& v) { v += "456"; }) );
+    REQUIRE( cache.getMRUKeys(5) == KV{"g", "i"} );
+    REQUIRE( cache.totalWeight() == 9 );
+
+    cache.clear();
+    REQUIRE( cache.totalWeight() == 0 );
+
+    // the total always matches the sum of the weights of the cached values
+    std::mt19937 rng(7);
+    for (int i = 0; i < 20000; ++i) {
+        std::string key = std::to_string(rng() % 20);
+        if (rng() % 4 == 0) {
+            cache.visit(key, [&rng](std::string& v) { v.resize(rng() % 6); });
+        } else {
+            cache.add(key, std::string(rng() % 8, 'v'));
+        }
+    }
+    size_t total = 0;
+    for (auto& [key, value] : cache.getMRU(5)) {
+        total += value.size();
+    }
+    REQUIRE( cache.totalWeight() == total );
+    REQUIRE( total <= 10 );
+}
+
+TEST_CASE( "lrucache::WeightedLRUCache weight budget", "[lru][weighted]" ) {
+    lrucache::WeightedLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, StringSizeWeigher> cache1(10, 3);
+    testWeightedCache(cache1);
+    lrucache::WeightedLRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>, StringSizeWeigher> cache2(10, 3);
+    testWeightedCache(cache2);
+    lrucache::WeightedLRUCache<lrucache::BaseFlat<std::string, std::string>, StringSizeWeigher> cache3(10, 3);
+    testWeightedCache(cache3);
+}
+
+// Deterministic clock for the expiration tests, reads the time from a variable of the test
+struct ManualClock {
+    using duration = std::chrono::steady_clock::duration;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    const time_point* now_;
+
+    time_point now() const { return *now_; }
+};
+
+template <class T>
+void testExpiringCache(T& cache, std::chrono::steady_clock::time_point& now) {
+    using namespace std::chrono_literals;
+    using KV = std::vector<std::string>;
+
+    cache.add("a", "alpha");
+    cache.add("b", "beta", 30s);
+    cache.add("c", "gamma", T::kNoExpiry);
+    REQUIRE( cache.getMRUKeys(5) == KV{"c", "b", "a"} );
+
+    now += 9s;
+    REQUIRE( cache.get("a") == std::string("alpha") );
+    now += 1s;
+    // expired, neither returned nor promoted
+    REQUIRE( !cache.contains("a") );
+    REQUIRE( !cache.peek("a").has_value() );
+    REQUIRE( cache.getMRUKeys(5) == KV{"c", "b"} );
+    REQUIRE( cache.size() == 3 );
+    REQUIRE( !cache.get("a").has_value() );
+    REQUIRE( cache.size() == 2 );
+
+    // re-adding renews the TTL
+    now += 15s;
+    REQUIRE( cache.add("b", "BETA", 10s) );
+    now += 6s;
+    REQUIRE( cache.get("b") == std::string("BETA") );
+    REQUIRE( cache.cleanUp() == 0 );
+    now += 4s;
+    REQUIRE( cache.cleanUp() == 1 );
+    REQUIRE( cache.size() == 1 );
+
+    // an expired element does not count as existing
+    cache.add("d", "delta", 1s);
+    now += 2s;
+    REQUIRE( cache.tryEmplace("d", "DELTA") );
+    REQUIRE( cache.get("d") == std::string("DELTA") );
+    REQUIRE( cache.tryEmplace("d", "ignored") == false );
+
+    // evicting an element with a timer cancels it
+    cache.add("e", "epsilon", 5s);
+    cache.add("f", "phi", 5s);
+    REQUIRE( cache.getMRUKeys(5) == KV{"f", "e", "d"} );
+    REQUIRE( cache.size() == 3 );
+    now += 11s;
+    REQUIRE( cache.cleanUp() == 3 );
+    REQUIRE( cache.size() == 0 );
+
+    // the reclamation by add() across the levels of the wheel
+    for (int i = 0; i < 3; ++i) {
+        cache.add(std::to_string(i), "v", std::chrono::seconds(100 * (i + 1) * (i + 1) * (i + 1)));
+    }
+    now += 150s;
+    cache.add("x", "v", T::kNoExpiry);
+    REQUIRE( cache.size() == 3 );
+    now += 2000s;
+    REQUIRE( cache.cleanUp() == 1 );
+    now += 100000s;
+    cache.add("y", "v", T::kNoExpiry);
+    REQUIRE( cache.getMRUKeys(5) == KV{"y", "x"} );
+    REQUIRE( cache.size() == 2 );
+}
+
+TEST_CASE( "lrucache::ExpiringLRUCache expiration", "[lru][expiring]" ) {
+    using namespace std::chrono_literals;
+    auto now = std::chrono::steady_clock::time_point{} + 1000h;
+    lrucache::ExpiringLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, ManualClock> cache1(3, 10s, ManualClock{&now});
+    testExpiringCache(cache1, now);
+    lrucache::ExpiringLRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>, ManualClock> cache2(3, 10s, ManualClock{&now});
+    testExpiringCache(cache2, now);
+    lrucache::ExpiringLRUCache<lrucache::BaseFlat<std::string, std::string>, ManualClock> cache3(3, 10s, ManualClock{&now}, 100ms);
+    testExpiringCache(cache3, now);
+}
+
+// Every timer fires exactly once, not before its deadline and at most one tick after it
+TEST_CASE( "lrucache::TimerWheel fires in time", "[expiring]" ) {
+    lrucache::TimerWheel<uint64_t> wheel;
+    std::mt19937_64 rng(11);
+    std::vector<uint64_t> deadlines;
+    std::vector<uint32_t> ids;
+    std::vector<bool> cancelled;
+    for (uint64_t i = 0; i < 5000; ++i) {
+        uint64_t range = uint64_t(1) << (rng() % 27);
+        deadlines.push_back(rng() % range);
+        ids.push_back(wheel.schedule(i, deadlines.back()));
+        cancelled.push_back(rng() % 10 == 0);
+        if (cancelled.back()) {
+            wheel.cancel(ids.back());
+        }
+    }
+    std::vector<uint64_t> fired(deadlines.size(), UINT64_MAX);
+    uint64_t now = 0;
+    bool ok = true;
+    while (now < (uint64_t(1) << 27) + 100) {
+        now += 1 + rng() % 3000;
+        wheel.advance(now, [&](uint64_t i) {
+            ok = ok && fired[i] == UINT64_MAX;
+            fired[i] = now;
+        });
+    }
+    size_t late = 0;
+    for (size_t i = 0; i < deadlines.size(); ++i) {
+        if (cancelled[i]) {
+            ok = ok && fired[i] == UINT64_MAX;
+        } else {
+            ok = ok && fired[i] >= deadlines[i] && fired[i] != UINT64_MAX;
+            late += fired[i] > std::max(deadlines[i], uint64_t(1)) + 3000;
+        }
+    }
+    REQUIRE( ok );
+    REQUIRE( late == 0 );
+}
+
+TEST_CASE( "lrucache::FrequencySketch estimates and ages", "[tinylfu]" ) {
+    lrucache::FrequencySketch<unsigned long> sketch(1000);
+    for (unsigned long key = 0; key < 100; ++key) {
+        for (unsigned long i = 0; i < key % 20; ++i) {
+            sketch.increment(key);
+        }
+    }
+    bool ok = true;
+    for (unsigned long key = 0; key < 100; ++key) {
+        ok = ok && sketch.frequency(key) >= std::min<unsigned long>(key % 20, 16);
+    }
+    REQUIRE( ok );
+    REQUIRE( sketch.frequency(12345) <= 1 );
+
+    // 10 * capacity additions halve the counters
+    for (unsigned long i = 0; i < 10000; ++i) {
+        sketch.increment(1000000 + i % 3000);
+    }
+    REQUIRE( sketch.frequency(19) <= 8 );
+}
+
+TEST_CASE( "lrucache::TinyLFUCache ops", "[lru][tinylfu]" ) {
+    lrucache::TinyLFUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache(100);
+    REQUIRE( !cache.add("one", "jeden") );
+    REQUIRE( !cache.add("two", "dwa") );
+    REQUIRE( cache.add("one", "JEDEN") );
+    REQUIRE( cache.get("one") == std::string("JEDEN") );
+    REQUIRE( !cache.get("three").has_value() );
+    REQUIRE( cache.contains("two") );
+    REQUIRE( cache.peek("two") == std::string("dwa") );
+    REQUIRE( cache.size() == 2 );
+    REQUIRE( cache.getMRUKeys(5) == std::vector<std::string>{"two", "one"} );
+    cache.clear();
+    REQUIRE( cache.size() == 0 );
+}
+
+// Hit ratios of a Zipf distributed workload interrupted by scans of keys used once
+template <class T>
+double scanPollutedZipfHitRatio(T& cache, unsigned long keys, unsigned long scan, double skew) {
+    ZipfGenerator zipf(keys, skew);
+    std::mt19937_64 rng(5);
+    unsigned long next_scan_key = keys;
+    size_t hits = 0;
+    size_t gets = 0;
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < 20000; ++i) {
+            unsigned long key = zipf(rng);
+            ++gets;
+            if (cache.get(key)) {
+                ++hits;
+            } else {
+                cache.add(key, key);
+            }
+        }
+        for (unsigned long i = 0; i < scan; ++i) {
+            unsigned long key = next_scan_key++;
+            if (!cache.get(key)) {
+                cache.add(key, key);
+            }
+        }
+    }
+    return static_cast<double>(hits) / gets;
+}
+
+TEST_CASE( "lrucache::TinyLFUCache hit ratio on scan polluted Zipf", "[lru][tinylfu]" ) {
+    const unsigned long Size = 1000;
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>> lru(Size);
+    lrucache::TinyLFUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>> tinylfu(Size);
+    lrucache::TinyLFUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, std::unordered_map>> tinylfu2(Size);
+    double lru_ratio = scanPollutedZipfHitRatio(lru, 100000, 5000, 0.9);
+    double tinylfu_ratio = scanPollutedZipfHitRatio(tinylfu, 100000, 5000, 0.9);
+    WARN( "scan polluted Zipf hit ratio: LRU " << lru_ratio << ", W-TinyLFU " << tinylfu_ratio );
+    REQUIRE( tinylfu_ratio > lru_ratio + 0.1 );
+    REQUIRE( scanPollutedZipfHitRatio(tinylfu2, 100000, 5000, 0.9) == tinylfu_ratio );
+    REQUIRE( tinylfu.size() == Size );
+}
+
+TEST_CASE( "lrucache::GhostList", "[ghost]" ) {
+    lrucache::GhostList<std::string> ghosts(3);
+    for (const char* key : {"a", "b", "c", "d", "e"}) {
+        ghosts.add(key);
+    }
+    REQUIRE( ghosts.size() == 3 );
+    REQUIRE( !ghosts.contains("b") );
+    REQUIRE( ghosts.contains("c") );
+    REQUIRE( ghosts.remove("d") );
+    REQUIRE( !ghosts.remove("d") );
+    ghosts.popLru();
+    REQUIRE( !ghosts.contains("c") );
+    REQUIRE( ghosts.contains("e") );
+    ghosts.clear();
+    REQUIRE( ghosts.empty() );
+}
+
+TEST_CASE( "lrucache::SLRUCache ops", "[slru]" ) {
+    lrucache::SLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache1(3);
+    testCacheOps(cache1);
+    lrucache::SLRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>> cache2(3);
+    testCacheOps(cache2);
+    lrucache::SLRUCache<lrucache::BaseFlat<std::string, std::string>> cache3(3);
+    testCacheOps(cache3);
+}
+
+TEST_CASE( "lrucache::SLRUCache protects the keys used again", "[slru]" ) {
+    lrucache::SLRUCache<lrucache::BaseVal<std::string, int, std::unordered_map>> cache(4, 2);
+    cache.add("a", 1);
+    cache.add("b", 2);
+    REQUIRE( cache.get("a") == 1 );
+    REQUIRE( cache.get("b") == 2 );
+    for (int i = 0; i < 10; ++i) {
+        cache.add(std::to_string(i), i);
+    }
+    REQUIRE( cache.getMRUKeys(4) == std::vector<std::string>{"b", "a", "9", "8"} );
+    REQUIRE( *cache.lruKey() == "8" );
+    // a third protected key demotes the least recently used one
+    REQUIRE( cache.get("9") == 9 );
+    REQUIRE( cache.getMRUKeys(4) == std::vector<std::string>{"9", "b", "a", "8"} );
+    REQUIRE( cache.popLru().first == "8" );
+    REQUIRE( cache.popLru().first == "a" );
+    REQUIRE( cache.size() == 2 );
+}
+
+TEST_CASE( "lrucache::TwoQCache ops", "[2q]" ) {
+    lrucache::TwoQCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache1(3);
+    testCacheOps(cache1);
+    lrucache::TwoQCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>> cache2(3);
+    testCacheOps(cache2);
+    lrucache::TwoQCache<lrucache::BaseFlat<std::string, std::string>> cache3(3);
+    testCacheOps(cache3);
+}
+
+TEST_CASE( "lrucache::TwoQCache remembers the evicted keys", "[2q]" ) {
+    lrucache::TwoQCache<lrucache::BaseVal<std::string, int, std::unordered_map>> cache(4);
+    for (const char* key : {"a", "b", "c", "d", "e"}) {
+        cache.add(key, 0);
+    }
+    REQUIRE( !cache.contains("a") );
+    // a is found in A1out and goes to Am
+    REQUIRE( !cache.add("a", 1) );
+    REQUIRE( !cache.contains("b") );
+    for (int i = 0; i < 10; ++i) {
+        cache.add(std::to_string(i), i);
+    }
+    REQUIRE( cache.get("a") == 1 );
+    REQUIRE( cache.getMRUKeys(2) == std::vector<std::string>{"a", "9"} );
+    REQUIRE( cache.size() == 4 );
+    cache.clear();
+    REQUIRE( !cache.add("a", 1) );
+    REQUIRE( cache.getMRUKeys(4) == std::vector<std::string>{"a"} );
+}
+
+TEST_CASE( "lrucache::ARCCache ops", "[arc]" ) {
+    lrucache::ARCCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache1(3);
+    testCacheOps(cache1);
+    lrucache::ARCCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>> cache2(3);
+    testCacheOps(cache2);
+    lrucache::ARCCache<lrucache::BaseFlat<std::string, std::string>> cache3(3);
+    testCacheOps(cache3);
+}
+
+TEST_CASE( "lrucache::ARCCache adapts to the ghost hits", "[arc]" ) {
+    lrucache::ARCCache<lrucache::BaseVal<std::string, int, std::unordered_map>> cache(4);
+    cache.add("a", 1);
+    cache.add("b", 2);
+    cache.get("a");
+    cache.get("b");
+    cache.add("c", 3);
+    cache.add("d", 4);
+    // T1 exceeds its target (0), c goes to B1
+    cache.add("e", 5);
+    REQUIRE( !cache.contains("c") );
+    REQUIRE( cache.recencyTarget() == 0 );
+    // a hit in B1 grows the target of T1
+    REQUIRE( !cache.add("c", 3) );
+    REQUIRE( cache.recencyTarget() == 1 );
+    REQUIRE( !cache.contains("d") );
+    REQUIRE( cache.getMRUKeys(4) == std::vector<std::string>{"c", "b", "a", "e"} );
+    // b is evicted from T2 into B2, a hit in B2 shrinks the target
+    cache.add("f", 6);
+    REQUIRE( !cache.contains("a") );
+    REQUIRE( !cache.add("a", 1) );
+    REQUIRE( cache.recencyTarget() == 0 );
+    REQUIRE( cache.size() == 4 );
+}
+
+template <class T>
+void testPromotionCopies(T& cache) {
+    cache.add("a", CopyCounted("x"));
+    CopyCounted::copies = 0;
+    // moved from the first segment into the second one, copied once into the result
+    REQUIRE( cache.get("a")->s == "x" );
+    REQUIRE( CopyCounted::copies == 1 );
+    REQUIRE( cache.get("a")->s == "x" );
+    REQUIRE( CopyCounted::copies == 2 );
+}
+
+TEST_CASE( "lrucache::SLRUCache and ARCCache move the promoted value", "[slru][arc]" ) {
+    lrucache::SLRUCache<lrucache::BaseVal<std::string, CopyCounted, std::unordered_map>> slru1(4);
+    testPromotionCopies(slru1);
+    lrucache::SLRUCache<lrucache::BaseFlat<std::string, CopyCounted>> slru2(4);
+    testPromotionCopies(slru2);
+    lrucache::ARCCache<lrucache::BaseVal<std::string, CopyCounted, std::unordered_map>> arc1(4);
+    testPromotionCopies(arc1);
+    lrucache::ARCCache<lrucache::BaseUniqPtr<std::string, CopyCounted, std::map>> arc2(4);
+    testPromotionCopies(arc2);
+}
+
+TEST_CASE( "lrucache scan resistant policies on scan polluted Zipf", "[slru][2q][arc]" ) {
+    const unsigned long Size = 1000;
+    using Base = lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>;
+    lrucache::LRUCache<Base> lru(Size);
+    lrucache::SLRUCache<Base> slru(Size);
+    lrucache::TwoQCache<Base> twoq(Size);
+    lrucache::ARCCache<Base> arc(Size);
+    double lru_ratio = scanPollutedZipfHitRatio(lru, 100000, 5000, 0.9);
+    double slru_ratio = scanPollutedZipfHitRatio(slru, 100000, 5000, 0.9);
+    double twoq_ratio = scanPollutedZipfHitRatio(twoq, 100000, 5000, 0.9);
+    double arc_ratio = scanPollutedZipfHitRatio(arc, 100000, 5000, 0.9);
+    WARN( "scan polluted Zipf hit ratio: LRU " << lru_ratio << ", SLRU " << slru_ratio
+          << ", 2Q " << twoq_ratio << ", ARC " << arc_ratio );
+    REQUIRE( slru_ratio > lru_ratio );
+    REQUIRE( twoq_ratio > lru_ratio );
+    REQUIRE( arc_ratio > lru_ratio );
+    REQUIRE( slru.size() == Size );
+    REQUIRE( twoq.size() == Size );
+    REQUIRE( arc.size() == Size );
+}
+
+TEST_CASE( "lrucache::ClockCache ops", "[clock]" ) {
+    lrucache::ClockCache<std::string, std::string, std::unordered_map> cache1(3);
+    testCacheOps(cache1);
+    lrucache::ClockCache<std::string, std::string, std::map> cache2(3);
+    testCacheOps(cache2);
+    lrucache::ClockCache<std::string, std::string, std::unordered_map> cache3(3);
+    testCacheLRUStringToString(cache3);
+    lrucache::ClockCache<std::string, std::string, std::map> cache4(3);
+    testCacheInPlaceAccess(cache4);
+    lrucache::ClockCache<unsigned long, std::unique_ptr<int>, std::unordered_map> cache5(3);
+    testCacheMoveOnly(cache5);
+}
+
+TEST_CASE( "lrucache::ClockCache gives a second chance", "[clock]" ) {
+    lrucache::ClockCache<int, int, std::unordered_map> cache(4);
+    for (int i = 0; i < 4; ++i) {
+        cache.add(i, i);
+    }
+    REQUIRE( cache.get(0) == 0 );
+    REQUIRE( cache.get(2) == 2 );
+    // the hand clears 0, evicts 1, then clears 2 and evicts 3
+    cache.add(4, 4);
+    cache.add(5, 5);
+    REQUIRE( cache.contains(0) );
+    REQUIRE( !cache.contains(1) );
+    REQUIRE( cache.contains(2) );
+    REQUIRE( !cache.contains(3) );
+    REQUIRE( cache.getMRUKeys(4) == std::vector<int>{5, 2, 4, 0} );
+    // 0 lost its reference and the hand is back on it
+    cache.add(6, 6);
+    REQUIRE( !cache.contains(0) );
+    REQUIRE( cache.contains(4) );
+    cache.clear();
+    REQUIRE( cache.size() == 0 );
+    REQUIRE( !cache.add(1, 1) );
+    REQUIRE( cache.getMRUKeys(4) == std::vector<int>{1} );
+}
+
+TEST_CASE( "lrucache::ClockCache hit ratio on Zipf", "[clock]" ) {
+    const unsigned long Size = 1000;
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>> lru(Size);
+    lrucache::ClockCache<unsigned long, unsigned long, std::unordered_map> clock(Size);
+    for (double skew : {0.7, 0.9, 1.1}) {
+        lru.clear();
+        clock.clear();
+        double lru_ratio = scanPollutedZipfHitRatio(lru, 100000, 0, skew);
+        double clock_ratio = scanPollutedZipfHitRatio(clock, 100000, 0, skew);
+        WARN( "Zipf " << skew << " hit ratio: LRU " << lru_ratio << ", CLOCK " << clock_ratio );
+        REQUIRE( clock_ratio > lru_ratio - 0.02 );
+    }
+}
+
+// getMany() and addMany() must return what get() and add() in a loop return and leave the same order
+template <class T>
+void testCacheBatch(T& batch, T& loop) {
+    std::mt19937_64 rng(3);
+    std::vector<unsigned long> keys(100);
+    std::vector<unsigned long> values(100);
+    std::vector<std::optional<unsigned long>> got(100);
+    bool ok = true;
+    for (int round = 0; round < 100; ++round) {
+        size_t count = rng() % 100;
+        for (size_t i = 0; i < count; ++i) {
+            keys[i] = rng() % 200;
+            values[i] = rng();
+        }
+        size_t expected = 0;
+        if (round % 2 == 0) {
+            for (size_t i = 0; i < count; ++i) {
+                expected += loop.add(keys[i], values[i]) ? 1 : 0;
+            }
+            ok = ok && batch.addMany(keys.data(), count, values.data()) == expected;
+        } else {
+            size_t hits = batch.getMany(keys.data(), count, got.data());
+            for (size_t i = 0; i < count; ++i) {
+                auto value = loop.get(keys[i]);
+                expected += value ? 1 : 0;
+                ok = ok && value == got[i];
+            }
+            ok = ok && hits == expected;
+        }
+    }
+    REQUIRE( ok );
+    REQUIRE( batch.size() == loop.size() );
+    REQUIRE( batch.getMRU(200) == loop.getMRU(200) );
+}
+
+TEST_CASE( "lrucache getMany and addMany", "[lru][batch]" ) {
+    using namespace lrucache;
+    LRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>> cache1(128), loop1(128);
+    testCacheBatch(cache1, loop1);
+    LRUCache<BaseUniqPtr<unsigned long, unsigned long, std::map>> cache2(128), loop2(128);
+    testCacheBatch(cache2, loop2);
+    LRUCache<BaseFlat<unsigned long, unsigned long>> cache3(128), loop3(128);
+    testCacheBatch(cache3, loop3);
+    LRUCache<BaseVal<unsigned long, unsigned long, SwissMap>> cache4(128), loop4(128);
+    testCacheBatch(cache4, loop4);
+    LRUCacheUniqPtr<unsigned long, unsigned long, std::unordered_map> cache5(128), loop5(128);
+    testCacheBatch(cache5, loop5);
+    LRUCacheVal<unsigned long, unsigned long, std::map> cache6(128), loop6(128);
+    testCacheBatch(cache6, loop6);
+}
+
+// Records the removals into a log shared by its copies
+template <class K, class V>
+struct RecordingListener {
+    using Entry = std::tuple<K, V, lrucache::RemovalCause>;
+
+    std::shared_ptr<std::vector<Entry>> log_ = std::make_shared<std::vector<Entry>>();
+
+    void operator()(K&& key, V&& value, lrucache::RemovalCause cause) {
+        log_->emplace_back(std::move(key), std::move(value), cause);
+    }
+};
+
+template <class T>
+void testRemovalListener(T& cache) {
+    using lrucache::RemovalCause;
+    using Log = std::vector<std::tuple<std::string, std::string, RemovalCause>>;
+    auto& log = *cache.removalListener().log_;
+
+    cache.add("one", "jeden");
+    cache.add("two", "dwa");
+    REQUIRE( log.empty() );
+    cache.add("one", "JEDEN");
+    REQUIRE( log == Log{{"one", "jeden", RemovalCause::Replaced}} );
+    cache.tryEmplace("one", "not used");
+    cache.add("three", "trzy");
+    REQUIRE( log.back() == std::make_tuple("two", "dwa", RemovalCause::Size) );
+    REQUIRE( cache.get("one") == std::string("JEDEN") );
+    log.clear();
+    cache.clear();
+    REQUIRE( log == Log{{"one", "JEDEN", RemovalCause::Explicit}, {"three", "trzy", RemovalCause::Explicit}} );
+}
+
+TEST_CASE( "lrucache removal listener", "[lru][listener]" ) {
+    using Listener = RecordingListener<std::string, std::string>;
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, Listener> cache1(2);
+    testRemovalListener(cache1);
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>, Listener> cache2(2);
+    testRemovalListener(cache2);
+    lrucache::LRUCache<lrucache::BaseFlat<std::string, std::string>, Listener> cache3(2);
+    testRemovalListener(cache3);
+    lrucache::WeightedLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, StringSizeWeigher, Listener> cache4(100, 2);
+    testRemovalListener(cache4);
+}
+
+TEST_CASE( "lrucache removal listener gets move only values", "[lru][listener]" ) {
+    using Ptr = std::unique_ptr<int>;
+    lrucache::LRUCache<lrucache::BaseVal<int, Ptr, std::unordered_map>, RecordingListener<int, Ptr>> cache(1);
+    cache.add(1, std::make_unique<int>(10));
+    cache.add(2, std::make_unique<int>(20));
+    auto& log = *cache.removalListener().log_;
+    REQUIRE( log.size() == 1 );
+    REQUIRE( std::get<0>(log[0]) == 1 );
+    REQUIRE( *std::get<1>(log[0]) == 10 );
+}
+
+TEST_CASE( "lrucache removal listener of WeightedLRUCache and ExpiringLRUCache", "[listener][weighted][expiring]" ) {
+    using namespace std::chrono_literals;
+    using lrucache::RemovalCause;
+    using Listener = RecordingListener<std::string, std::string>;
+    using Log = std::vector<std::tuple<std::string, std::string, RemovalCause>>;
+
+    lrucache::WeightedLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, StringSizeWeigher, Listener> weighted(10, 100);
+    weighted.add("a", "12345");
+    weighted.add("b", "1234");
+    weighted.add("c", "123");
+    weighted.add("d", "1234567890!");
+    REQUIRE( *weighted.removalListener().log_ == Log{{"a", "12345", RemovalCause::Size}} );
+
+    auto now = std::chrono::steady_clock::time_point{} + 1000h;
+    lrucache::ExpiringLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, ManualClock, Listener> expiring(2, 10s, ManualClock{&now});
+    auto& log = *expiring.removalListener().log_;
+    expiring.add("a", "alpha");
+    expiring.add("b", "beta", 100s);
+    expiring.add("b", "BETA", 100s);
+    now += 20s;
+    REQUIRE( expiring.cleanUp() == 1 );
+    expiring.add("c", "gamma");
+    expiring.add("d", "delta");
+    REQUIRE( log == Log{{"b", "beta", RemovalCause::Replaced}, {"a", "alpha", RemovalCause::Expired}, {"b", "BETA", RemovalCause::Size}} );
+}
+
+// Collects the batches, copies share the log
+struct BulkRecorder {
+    using Batch = std::vector<lrucache::Removal<std::string, std::string>>;
+
+    std::shared_ptr<std::vector<Batch>> batches_ = std::make_shared<std::vector<Batch>>();
+
+    void operator()(Batch&& batch) { batches_->push_back(std::move(batch)); }
+};
+
+TEST_CASE( "lrucache batched removal listener", "[lru][listener]" ) {
+    using Listener = lrucache::BatchedRemovalListener<std::string, std::string, BulkRecorder>;
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, Listener> cache(2);
+    for (const char* key : {"a", "b", "c", "d"}) {
+        cache.add(key, key);
+    }
+    auto& batches = *cache.removalListener().bulkListener().batches_;
+    REQUIRE( cache.removalListener().pending() == 2 );
+    REQUIRE( batches.empty() );
+    cache.removalListener().dispatch();
+    REQUIRE( batches.size() == 1 );
+    REQUIRE( batches[0].size() == 2 );
+    REQUIRE( batches[0][0].key_ == "a" );
+    REQUIRE( batches[0][1].value_ == "b" );
+    REQUIRE( batches[0][1].cause_ == lrucache::RemovalCause::Size );
+    cache.removalListener().dispatch();
+    REQUIRE( batches.size() == 1 );
+}
+
+// Calls the cache back, which would deadlock if it ran under the shard or the exclusive lock
+struct ReentrantBulkListener {
+    struct State {
+        std::function<bool(unsigned long)> cached_;
+        std::atomic<size_t> removed_{0};
+        std::atomic<size_t> still_cached_{0};
+    };
+
+    std::shared_ptr<State> state_ = std::make_shared<State>();
+
+    void operator()(std::vector<lrucache::Removal<unsigned long, unsigned long>>&& batch) {
+        for (auto& removal : batch) {
+            if (state_->cached_(removal.key_)) {
+                ++state_->still_cached_;
+            }
+        }
+        state_->removed_ += batch.size();
+    }
+};
+
+using ReentrantListener = lrucache::BatchedRemovalListener<unsigned long, unsigned long, ReentrantBulkListener>;
+
+template <class T>
+void testBatchedListenerConcurrent(T& cache, ReentrantBulkListener::State& state) {
+    state.cached_ = [&cache](unsigned long key) { return cache.peek(key).has_value(); };
+    const unsigned long Threads = 4;
+    const unsigned long PerThread = 5000;
+    std::vector<std::thread> threads;
+    for (unsigned long t = 0; t < Threads; ++t) {
+        threads.emplace_back([&cache, t]() {
+            for (unsigned long i = 0; i < PerThread; ++i) {
+                cache.add(t * PerThread + i, i);
+                cache.get(t * PerThread + i / 2);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // every thread adds its own keys once, a removed key can't be cached again
+    REQUIRE( state.still_cached_ == 0 );
+    REQUIRE( state.removed_ + cache.size() == Threads * PerThread );
+}
+
+TEST_CASE( "lrucache batched removal listener dispatches outside the lock", "[listener][sharded][buffered]" ) {
+    using Base = lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>;
+    ReentrantBulkListener bulk1;
+    lrucache::ShardedLRUCache<Base, 8, ReentrantListener> cache1(1000, ReentrantListener(bulk1));
+    testBatchedListenerConcurrent(cache1, *bulk1.state_);
+
+    ReentrantBulkListener bulk2;
+    lrucache::BufferedLRUCache<Base, 16, 64, ReentrantListener> cache2(1000);
+    cache2.removalListener() = ReentrantListener(bulk2);
+    testBatchedListenerConcurrent(cache2, *bulk2.state_);
+}
+
+template <class T>
+void testStats(T& cache) {
+    cache.add(1, 10);
+    cache.add(2, 20);
+    cache.add(1, 11);               // update, promotion
+    REQUIRE( cache.get(2) == 20 );  // hit, promotion
+    REQUIRE( !cache.get(3) );       // miss
+    cache.add(3, 30);               // eviction of 1
+    cache.tryEmplace(2, 21);        // promotion
+    REQUIRE( !cache.visit(1, [](unsigned long&) {}) );  // miss
+    REQUIRE( cache.get(2) == 20 );  // hit, already the first
+    REQUIRE( cache.peek(3) == 30 );
+
+    auto s = cache.stats();
+    REQUIRE( s.hits == 2 );
+    REQUIRE( s.misses == 2 );
+    REQUIRE( s.insertions == 3 );
+    REQUIRE( s.evictions == 1 );
+    REQUIRE( s.updates == 1 );
+    REQUIRE( s.promotions == 3 );
+    REQUIRE( s.hitRatio() == 0.5 );
+
+    cache.resetStats();
+    s = cache.stats();
+    REQUIRE( s.hits + s.misses + s.insertions + s.evictions + s.updates + s.promotions == 0 );
+}
+
+TEST_CASE( "lrucache statistics", "[lru][stats]" ) {
+    using namespace lrucache;
+    LRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>, NoRemovalListener, CacheStats> cache1(2);
+    testStats(cache1);
+    LRUCache<BaseUniqPtr<unsigned long, unsigned long, std::map>, NoRemovalListener, ConcurrentCacheStats<>> cache2(2);
+    testStats(cache2);
+    LRUCache<BaseFlat<unsigned long, unsigned long>, NoRemovalListener, TimedCacheStats<>> cache3(2);
+    testStats(cache3);
+    LRUCacheUniqPtr<unsigned long, unsigned long, std::unordered_map, CacheStats> cache4(2);
+    testStats(cache4);
+    LRUCacheVal<unsigned long, unsigned long, std::map, CacheStats> cache5(2);
+    testStats(cache5);
+    ShardedLRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>, 1, NoRemovalListener, CacheStats> cache6(2);
+    testStats(cache6);
+
+    LRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>, NoRemovalListener, CacheStats> cache7(4);
+    std::vector<unsigned long> keys{1, 2, 3, 4, 5, 6};
+    std::vector<std::optional<unsigned long>> values(keys.size());
+    cache7.addMany(keys.data(), 3, keys.data());
+    REQUIRE( cache7.getMany(keys.data(), keys.size(), values.data()) == 3 );
+    auto s = cache7.stats();
+    REQUIRE( s.hits == 3 );
+    REQUIRE( s.misses == 3 );
+    REQUIRE( s.promotions == 3 );
+}
+
+TEST_CASE( "lrucache::LatencyHistogram log buckets", "[stats]" ) {
+    using lrucache::LatencyHistogram;
+    for (uint64_t v : {0ULL, 1ULL, 7ULL, 8ULL, 9ULL, 15ULL, 16ULL, 17ULL, 100ULL, 1000ULL, 123456789ULL, ~0ULL}) {
+        size_t b = LatencyHistogram::bucketOf(v);
+        REQUIRE( b < LatencyHistogram::kBuckets );
+        REQUIRE( LatencyHistogram::lowerBound(b) <= v );
+        // 12.5% precision
+        REQUIRE( v - LatencyHistogram::lowerBound(b) <= LatencyHistogram::lowerBound(b) / 8 );
+        if (b + 1 < LatencyHistogram::kBuckets) {
+            REQUIRE( v < LatencyHistogram::lowerBound(b + 1) );
+        }
+    }
+
+    lrucache::LatencyRecorder recorder;
+    for (uint64_t v = 1; v <= 1000; ++v) {
+        recorder.record(v);
+    }
+    LatencyHistogram h = recorder.snapshot();
+    REQUIRE( h.count() == 1000 );
+    REQUIRE( h.percentile(0.5) >= 500 );
+    REQUIRE( h.percentile(0.5) <= 500 * 9 / 8 );
+    REQUIRE( h.percentile(0.99) >= 990 );
+    REQUIRE( h.percentile(1.0) >= 1000 );
+    REQUIRE( LatencyHistogram().percentile(0.5) == 0 );
+
+    h += recorder.snapshot();
+    REQUIRE( h.count() == 2000 );
+}
+
+TEST_CASE( "lrucache::TimedCacheStats samples get and add", "[lru][stats]" ) {
+    using namespace lrucache;
+    LRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>, NoRemovalListener, TimedCacheStats<CacheStats, 0>> every(100);
+    LRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>, NoRemovalListener, TimedCacheStats<CacheStats, 4>> sampled(100);
+    for (unsigned long i = 0; i < 256; ++i) {
+        every.add(i, i);
+        every.get(i);
+        sampled.add(i, i);
+        sampled.get(i);
+    }
+    REQUIRE( every.stats().add_latency.count() == 256 );
+    REQUIRE( every.stats().get_latency.count() == 256 );
+    REQUIRE( every.stats().get_latency.percentile(0.5) > 0 );
+    // the add() and get() calls of the thread share the sample counter
+    REQUIRE( sampled.stats().add_latency.count() + sampled.stats().get_latency.count() == 512 / 16 );
+    every.resetStats();
+    REQUIRE( every.stats().add_latency.count() == 0 );
+}
+
+TEST_CASE( "lrucache concurrent statistics", "[stats][sharded][buffered]" ) {
+    using Base = lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>;
+    using Stats = lrucache::TimedCacheStats<lrucache::ConcurrentCacheStats<>>;
+    lrucache::ShardedLRUCache<Base, 8, lrucache::NoRemovalListener, lrucache::CacheStats> cache1(500);
+    lrucache::BufferedLRUCache<Base, 4, 16, lrucache::NoRemovalListener, Stats> cache2(500);
+
+    std::vector<std::thread> threads;
+    for (unsigned long t = 0; t < 8; ++t) {
+        threads.emplace_back([&cache1, &cache2, t]() {
+            std::mt19937_64 rng(t);
+            ZipfGenerator zipf(2000, 0.9);
+            for (unsigned long i = 0; i < 10000; ++i) {
+                unsigned long key = zipf(rng);
+                if (!cache1.get(key)) {
+                    cache1.add(key, key);
+                }
+                if (!cache2.get(key)) {
+                    cache2.add(key, key);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+
+    for (auto s : {cache1.stats(), cache2.stats()}) {
+        REQUIRE( s.hits + s.misses == 80000 );
+        REQUIRE( s.insertions <= s.misses );
+        REQUIRE( s.insertions - s.evictions == 500 );
+        REQUIRE( s.hitRatio() > 0.2 );
+    }
+    REQUIRE( cache2.stats().get_latency.count() > 0 );
+}
+
+TEST_CASE( "lrucache::ShardsEstimator exact on a loop", "[stats][mrc]" ) {
+    // 500 keys in a cycle: every reuse distance is 499
+    lrucache::ShardsEstimator<unsigned long> estimator(1000);
+    for (unsigned long i = 0; i < 10000; ++i) {
+        estimator.access(i % 500);
+    }
+    REQUIRE( estimator.samplingRate() == 1.0 );
+    REQUIRE( estimator.hitRatio(400) == 0.0 );
+    REQUIRE( estimator.hitRatio(600) == Approx(0.95) );
+    REQUIRE( estimator.hitRatio(10000) == Approx(0.95) );
+}
+
+TEST_CASE( "lrucache miss ratio curve estimation", "[lru][stats][mrc]" ) {
+    using namespace lrucache;
+    using Base = BaseVal<unsigned long, unsigned long, std::unordered_map>;
+    LRUCache<Base, NoRemovalListener, MissRatioCurveStats<unsigned long>> cache(2000);
+    cache.statsPolicy() = MissRatioCurveStats<unsigned long>(2048);
+    std::vector<size_t> capacities{500, 2000, 8000, 32000};
+    std::vector<std::unique_ptr<LRUCache<Base>>> actual;
+    for (size_t capacity : capacities) {
+        actual.push_back(std::make_unique<LRUCache<Base>>(capacity));
+    }
+    std::vector<size_t> hits(capacities.size());
+
+    std::mt19937_64 rng(5);
+    ZipfGenerator zipf(200000, 0.8);
+    const size_t n = 400000;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned long key = zipf(rng) * 2654435761UL;
+        if (!cache.get(key)) {
+            cache.add(key, key);
+        }
+        for (size_t c = 0; c < capacities.size(); ++c) {
+            if (actual[c]->get(key)) {
+                ++hits[c];
+            } else {
+                actual[c]->add(key, key);
+            }
+        }
+    }
+
+    auto& estimator = cache.statsPolicy().estimator();
+    REQUIRE( estimator.trackedKeys() <= 2048 );
+    REQUIRE( estimator.samplingRate() < 0.1 );
+    REQUIRE( cache.stats().hits + cache.stats().misses == n );
+    // the estimate for the cache's own capacity and for the others
+    REQUIRE( cache.statsPolicy().hitRatioAt(2000) == Approx(cache.stats().hitRatio()).margin(0.03) );
+    for (size_t c = 0; c < capacities.size(); ++c) {
+        REQUIRE( cache.statsPolicy().hitRatioAt(capacities[c]) == Approx(double(hits[c]) / n).margin(0.03) );
+    }
+
+    cache.resetStats();
+    REQUIRE( cache.statsPolicy().hitRatioAt(2000) == 0.0 );
+    REQUIRE( cache.statsPolicy().estimator().samplingRate() == 1.0 );
+}
+
+template <typename Cache>
+void testSnapshot(Cache& cache, Cache& restored, const std::string& path) {
+    for (unsigned long i = 0; i < 100; ++i) {
+        cache.add(i, i * 10);
+    }
+    cache.get(7);
+    cache.get(3);
+    REQUIRE( cache.saveSnapshot(path) );
+    REQUIRE( restored.loadSnapshot(path) );
+    REQUIRE( restored.size() == cache.size() );
+    REQUIRE( restored.getMRU(100) == cache.getMRU(100) );
+
+    // the order is kept by the next operations
+    restored.add(1000, 1);
+    restored.get(0);
+    cache.add(1000, 1);
+    cache.get(0);
+    REQUIRE( restored.getMRU(100) == cache.getMRU(100) );
+}
+
+TEST_CASE( "lrucache snapshot save and load", "[lru][snapshot]" ) {
+    using namespace lrucache;
+    std::string path = (std::filesystem::temp_directory_path() / "lrucache_test.snap").string();
+
+    SECTION( "bases" ) {
+        LRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>> val(100), val_restored(100);
+        testSnapshot(val, val_restored, path);
+        LRUCache<BaseUniqPtr<unsigned long, unsigned long, std::map>> ptr(100), ptr_restored(100);
+        testSnapshot(ptr, ptr_restored, path);
+        LRUCache<BaseFlat<unsigned long, unsigned long>> flat(100), flat_restored(100);
+        testSnapshot(flat, flat_restored, path);
+    }
+
+    SECTION( "strings, the most recent entries fill a smaller cache" ) {
+        LRUCache<BaseVal<std::string, std::string, std::unordered_map>> cache(300);
+        for (int i = 0; i < 300; ++i) {
+            cache.add("key" + std::to_string(i), std::string(i, 'v'));
+        }
+        REQUIRE( cache.saveSnapshot(path) );
+        LRUCache<BaseVal<std::string, std::string, std::unordered_map>> small(10);
+        small.add("old", "old");
+        REQUIRE( small.loadSnapshot(path) );
+        REQUIRE( small.size() == 10 );
+        REQUIRE( small.getMRU(10) == cache.getMRU(10) );
+        REQUIRE( !small.contains("old") );
+        small.add("new", "new");
+        REQUIRE( small.size() == 10 );
+        REQUIRE( !small.contains("key290") );
+    }
+
+    SECTION( "a missing or corrupted file leaves the cache empty" ) {
+        LRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>> cache(100);
+        for (unsigned long i = 0; i < 100; ++i) {
+            cache.add(i, i);
+        }
+        REQUIRE( cache.saveSnapshot(path) );
+        LRUCache<BaseVal<unsigned long, unsigned long, std::unordered_map>> restored(100);
+        REQUIRE( !restored.loadSnapshot(path + ".missing") );
+
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(sizeof(SnapshotHeader) + 100);
+        file.put('x');
+        file.close();
+        restored.add(1, 1);
+        REQUIRE( !restored.loadSnapshot(path) );
+        REQUIRE( restored.size() == 0 );
+
+        std::filesystem::resize_file(path, sizeof(SnapshotHeader) - 1);
+        REQUIRE( !restored.loadSnapshot(path) );
+        REQUIRE( restored.size() == 0 );
+    }
+
+    SECTION( "the ifstream fallback of the platforms without mmap" ) {
+        using Cache = LRUCache<BaseVal<std::string, unsigned long, std::unordered_map>>;
+        Cache cache(100), restored(100);
+        for (unsigned long i = 0; i < 100; ++i) {
+            cache.add(std::to_string(i), i);
+        }
+        REQUIRE( cache.saveSnapshot(path) );
+        restored.add("old", 0);
+        REQUIRE( SnapshotIO<Cache>::loadFromStream(restored, path) );
+        REQUIRE( restored.getMRU(100) == cache.getMRU(100) );
+
+        REQUIRE( !SnapshotIO<Cache>::loadFromStream(restored, path + ".missing") );
+        REQUIRE( restored.size() == 0 );
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+        REQUIRE( !SnapshotIO<Cache>::loadFromStream(restored, path) );
+        REQUIRE( restored.size() == 0 );
+    }
+
+    std::filesystem::remove(path);
+}
+
+template <class T>
+void testSetMaxSize(T& cache) {
+    using lrucache::RemovalCause;
+    auto& log = *cache.removalListener().log_;
+    for (int i = 0; i < 10; ++i) {
+        cache.add(i, i * 10);
+    }
+
+    // shrinking evicts kTrimStep elements per operation, the least recently used first
+    cache.setMaxSize(4);
+    REQUIRE( cache.maxSize() == 4 );
+    REQUIRE( cache.size() == 10 );
+    REQUIRE( log.empty() );
+    REQUIRE( cache.get(9) == 90 );
+    REQUIRE( cache.size() == 10 - T::kTrimStep );
+    cache.add(100, 1000);
+    REQUIRE( cache.size() == 4 );
+    REQUIRE( log.size() == 7 );
+    for (int i = 0; i < 7; ++i) {
+        REQUIRE( log[i] == std::make_tuple(i, i * 10, RemovalCause::Size) );
+    }
+    REQUIRE( cache.getMRUKeys(4) == std::vector<int>{100, 9, 8, 7} );
+
+    // growing keeps the elements and their order
+    cache.setMaxSize(1000);
+    for (int i = 1000; i < 1996; ++i) {
+        cache.add(i, i);
+    }
+    REQUIRE( cache.size() == 1000 );
+    REQUIRE( log.size() == 7 );
+    REQUIRE( cache.getMRUKeys(1000).back() == 7 );
+    REQUIRE( cache.get(100) == 1000 );
+    REQUIRE( cache.get(7) == 70 );
+    cache.add(2000, 2000);
+    REQUIRE( std::get<0>(log.back()) == 8 );
+    auto mru = cache.getMRU(1000);
+    REQUIRE( mru.size() == 1000 );
+    REQUIRE( mru[0].first == 2000 );
+    REQUIRE( mru[2].first == 100 );
+
+    // trim() evicts the excess at once, the capacity is at least 1
+    cache.setMaxSize(0);
+    REQUIRE( cache.maxSize() == 1 );
+    REQUIRE( cache.trim() == 999 );
+    REQUIRE( cache.getMRUKeys(2) == std::vector<int>{2000} );
+    cache.add(1, 1);
+    REQUIRE( cache.getMRUKeys(2) == std::vector<int>{1} );
+}
+
+TEST_CASE( "lrucache setMaxSize", "[lru]" ) {
+    using Listener = RecordingListener<int, int>;
+    lrucache::LRUCache<lrucache::BaseVal<int, int, std::unordered_map>, Listener> cache1(10);
+    testSetMaxSize(cache1);
+    lrucache::LRUCache<lrucache::BaseUniqPtr<int, int, std::map>, Listener> cache2(10);
+    testSetMaxSize(cache2);
+    lrucache::LRUCache<lrucache::BaseFlat<int, int>, Listener> cache3(10);
+    testSetMaxSize(cache3);
+    lrucache::LRUCache<lrucache::BaseVal<int, int, lrucache::SwissMap>, Listener> cache4(10);
+    testSetMaxSize(cache4);
+}
+
+TEST_CASE( "lrucache::ShardedLRUCache and BufferedLRUCache setMaxSize", "[lru][sharded][buffered]" ) {
+    lrucache::ShardedLRUCache<lrucache::BaseVal<int, int, std::unordered_map>, 4> sharded(100);
+    lrucache::BufferedLRUCache<lrucache::BaseVal<int, int, std::unordered_map>> buffered(100);
+    for (int i = 0; i < 100; ++i) {
+        sharded.add(i, i);
+        buffered.add(i, i);
+    }
+    size_t before = sharded.size();
+    sharded.setMaxSize(20);
+    buffered.setMaxSize(20);
+    REQUIRE( sharded.maxSize() == 20 );
+    REQUIRE( buffered.maxSize() == 20 );
+    REQUIRE( sharded.size() == before );
+    REQUIRE( buffered.size() == 100 );
+    for (int i = 1000; i < 1100; ++i) {
+        sharded.add(i, i);
+        buffered.add(i, i);
+    }
+    REQUIRE( sharded.size() == 20 );
+    REQUIRE( buffered.size() == 20 );
+    REQUIRE( buffered.get(1099) == 1099 );
+
+    sharded.setMaxSize(1000);
+    for (int i = 0; i < 500; ++i) {
+        sharded.add(i, i);
+    }
+    REQUIRE( sharded.size() == 520 );
+}
+
+template <class T>
+void testInvalidation(T& cache) {
+    using lrucache::RemovalCause;
+    using Log = std::vector<std::tuple<std::string, std::string, RemovalCause>>;
+    auto& log = *cache.removalListener().log_;
+    for (std::string tenant : {"a", "b", "c"}) {
+        for (int i = 0; i < 3; ++i) {
+            cache.add(tenant + ":" + std::to_string(i), tenant);
+        }
+    }
+
+    REQUIRE( cache.erase(std::string("b:1")) );
+    REQUIRE( !cache.erase(std::string("b:1")) );
+    REQUIRE( log == Log{{"b:1", "b", RemovalCause::Explicit}} );
+    REQUIRE( !cache.contains(std::string("b:1")) );
+
+    REQUIRE( cache.invalidateIf([](const std::string&, const std::string& value) { return value == "a"; }) == 3 );
+    REQUIRE( cache.size() == 5 );
+    REQUIRE( cache.getMRUKeys(10) == std::vector<std::string>{"c:2", "c:1", "c:0", "b:2", "b:0"} );
+    REQUIRE( std::get<0>(log[1]) == "a:2" );
+    REQUIRE( std::get<2>(log[3]) == RemovalCause::Explicit );
+    REQUIRE( cache.invalidateIf([](const std::string&, const std::string&) { return false; }) == 0 );
+
+    // the list stays consistent
+    cache.add("d:0", "d");
+    REQUIRE( cache.get(std::string("b:0")) == std::string("b") );
+    REQUIRE( cache.getMRUKeys(10) == std::vector<std::string>{"b:0", "d:0", "c:2", "c:1", "c:0", "b:2"} );
+}
+
+TEST_CASE( "lrucache::ShardedLRUCache dispatches the removals of get() and visit() after setMaxSize", "[lru][sharded][listener]" ) {
+    using Listener = lrucache::BatchedRemovalListener<std::string, std::string, BulkRecorder>;
+    Listener listener;
+    auto& batches = *listener.bulkListener().batches_;
+    lrucache::ShardedLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, 1, Listener> cache(10, listener);
+    for (int i = 0; i < 10; ++i) {
+        cache.add(std::to_string(i), "v");
+    }
+    cache.setMaxSize(2);
+    REQUIRE( batches.empty() );
+    REQUIRE( cache.get("9") == std::string("v") );
+    REQUIRE( batches.size() == 1 );
+    REQUIRE( batches[0].size() == 4 );
+    REQUIRE( batches[0][0].key_ == "0" );
+    REQUIRE( batches[0][0].cause_ == lrucache::RemovalCause::Size );
+    REQUIRE( cache.visit("9", [](std::string&) {}) );
+    REQUIRE( batches.size() == 2 );
+    REQUIRE( batches[1].size() == 4 );
+    REQUIRE( cache.size() == 2 );
+}
 
-    testCacheOps(cache);
+TEST_CASE( "lrucache erase and invalidateIf", "[lru][invalidate]" ) {
+    using Listener = RecordingListener<std::string, std::string>;
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, Listener> cache1(20);
+    testInvalidation(cache1);
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>, Listener> cache2(20);
+    testInvalidation(cache2);
+    lrucache::LRUCache<lrucache::BaseFlat<std::string, std::string>, Listener> cache3(20);
+    testInvalidation(cache3);
+    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, lrucache::SwissMap>, Listener> cache4(20);
+    testInvalidation(cache4);
 }
 
-TEST_CASE( "lrucache::LRUCache Ptr M ops", "[lru]" ) {
-    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>> cache(3);
+template <class T>
+void testRangeInvalidation(T& cache) {
+    for (std::string tenant : {"a", "ab", "b", "c"}) {
+        for (int i = 0; i < 10; ++i) {
+            cache.add(tenant + ":" + std::to_string(i), i);
+        }
+    }
 
-    testCacheOps(cache);
+    // incrementally, a slice per call
+    REQUIRE( cache.erasePrefix("b:", 4) == 4 );
+    REQUIRE( cache.erasePrefix("b:", 4) == 4 );
+    REQUIRE( cache.erasePrefix("b:", 4) == 2 );
+    REQUIRE( cache.erasePrefix("b:", 4) == 0 );
+    REQUIRE( cache.size() == 30 );
+    REQUIRE( cache.contains("ab:3") );
+    REQUIRE( cache.contains("c:0") );
+
+    REQUIRE( cache.erasePrefix(std::string("a")) == 20 );
+    REQUIRE( cache.size() == 10 );
+    REQUIRE( cache.eraseRange("c:2", "c:5") == 3 );
+    REQUIRE( cache.eraseRange("c:5", "c:2") == 0 );
+    REQUIRE( cache.eraseRange("d", "e") == 0 );
+    REQUIRE( cache.eraseRange("z", "a") == 0 );
+    REQUIRE( cache.eraseRange("z", "c:3") == 0 );
+    REQUIRE( cache.eraseRange("c:3", "c:3") == 0 );
+    REQUIRE( cache.eraseRange("c:7", "c:1") == 0 );
+    REQUIRE( cache.getMRUKeys(10) == std::vector<std::string>{"c:9", "c:8", "c:7", "c:6", "c:5", "c:1", "c:0"} );
+    cache.add("z", 0);
+    REQUIRE( cache.eraseRange("c:0", "c:6", 1) == 1 );
+    REQUIRE( cache.eraseRange(std::string("c:0"), std::string("zz")) == 7 );
+    REQUIRE( cache.getMRUKeys(10) == std::vector<std::string>{} );
 }
 
-TEST_CASE( "lrucache::LRUCache Val U ops", "[lru]" ) {
-    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache(3);
+TEST_CASE( "lrucache eraseRange and erasePrefix of ordered maps", "[lru][invalidate]" ) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, int, std::map>> cache1(100);
+    testRangeInvalidation(cache1);
+    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, int, TransparentMap>> cache2(100);
+    testRangeInvalidation(cache2);
+    size_t before = g_allocations;
+    REQUIRE( cache2.erasePrefix(std::string_view("none")) == 0 );
+    REQUIRE( g_allocations == before );
+}
 
-    testCacheOps(cache);
+template <class T>
+void testGenerations(T& cache) {
+    using lrucache::RemovalCause;
+    auto& log = *cache.removalListener().log_;
+    for (int i = 0; i < 10; ++i) {
+        cache.add(i, i * 10);
+    }
+
+    cache.invalidateAll();
+    REQUIRE( log.empty() );
+    REQUIRE( cache.size() == 0 );
+    REQUIRE( cache.staleSize() == 10 );
+    REQUIRE( !cache.contains(9) );
+    REQUIRE( !cache.peek(9) );
+    REQUIRE( cache.getMRUKeys(10).empty() );
+
+    // a lookup reclaims the stale element it finds, an insertion kReclaimStep from the back of the list
+    REQUIRE( !cache.get(5) );
+    REQUIRE( log.back() == std::make_tuple(5, 50, RemovalCause::Explicit) );
+    REQUIRE( cache.staleSize() == 9 );
+    REQUIRE( !cache.add(7, 700) );
+    REQUIRE( cache.staleSize() == 9 - T::kReclaimStep - 1 );
+    REQUIRE( std::get<0>(log[1]) == 0 );
+    REQUIRE( cache.get(7) == 700 );
+    REQUIRE( cache.size() == 1 );
+    REQUIRE( !cache.erase(8) );
+    REQUIRE( cache.erase(7) );
+    REQUIRE( cache.staleSize() == 3 );
+    for (int i = 100; i < 110; ++i) {
+        cache.add(i, i);
+    }
+    REQUIRE( cache.staleSize() == 0 );
+    REQUIRE( cache.size() == 10 );
+    REQUIRE( log.size() == 11 );
+    for (auto& removal : log) {
+        REQUIRE( std::get<2>(removal) == RemovalCause::Explicit );
+    }
+
+    // the live elements are evicted as usual, invalidateIf() sees them only
+    cache.add(110, 110);
+    REQUIRE( log.back() == std::make_tuple(100, 100, RemovalCause::Size) );
+    cache.invalidateAll();
+    cache.add(1, 1);
+    cache.add(2, 2);
+    REQUIRE( cache.invalidateIf([](int key, int) { return key > 1; }) == 1 );
+    REQUIRE( cache.getMRU(10) == std::vector<std::pair<int, int>>{{1, 1}} );
+    REQUIRE( cache.reclaim() == 10 - T::kReclaimStep * 2 );
+    REQUIRE( cache.staleSize() == 0 );
+    REQUIRE( cache.getMRUKeys(10) == std::vector<int>{1} );
+    REQUIRE( cache.tryEmplace(1, 5) == false );
+    REQUIRE( cache.get(1) == 1 );
 }
 
-TEST_CASE( "lrucache::LRUCache Val M ops", "[lru]" ) {
-    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::map>> cache(3);
+TEST_CASE( "lrucache::GenerationLRUCache invalidateAll", "[generation][invalidate]" ) {
+    using Listener = RecordingListener<int, int>;
+    lrucache::GenerationLRUCache<lrucache::BaseVal<int, int, std::unordered_map>, Listener> cache1(10);
+    testGenerations(cache1);
+    lrucache::GenerationLRUCache<lrucache::BaseUniqPtr<int, int, std::map>, Listener> cache2(10);
+    testGenerations(cache2);
+    lrucache::GenerationLRUCache<lrucache::BaseFlat<int, int>, Listener> cache3(10);
+    testGenerations(cache3);
+}
 
-    testCacheOps(cache);
+TEST_CASE( "lrucache::ShardedLRUCache and BufferedLRUCache erase and invalidateIf", "[sharded][buffered][invalidate]" ) {
+    lrucache::ShardedLRUCache<lrucache::BaseVal<int, int, std::unordered_map>, 4> sharded(400);
+    lrucache::BufferedLRUCache<lrucache::BaseVal<int, int, std::unordered_map>> buffered(100);
+    for (int i = 0; i < 100; ++i) {
+        sharded.add(i, i);
+        buffered.add(i, i);
+        buffered.get(i);
+    }
+    REQUIRE( sharded.erase(5) );
+    REQUIRE( !sharded.erase(5) );
+    REQUIRE( buffered.erase(5) );
+    REQUIRE( !buffered.get(5) );
+    REQUIRE( sharded.invalidateIf([](int key, int) { return key % 2 == 0; }) == 50 );
+    REQUIRE( buffered.invalidateIf([](int key, int) { return key % 2 == 0; }) == 50 );
+    REQUIRE( sharded.size() == 49 );
+    REQUIRE( buffered.size() == 49 );
+    REQUIRE( buffered.get(7) == 7 );
+    REQUIRE( !sharded.get(8) );
 }
 
-TEST_CASE( "lrucache::LRUCacheUniqPtr U ops", "[lru]" ) {
-    lrucache::LRUCacheUniqPtr<std::string, std::string, std::unordered_map> cache(3);
+TEST_CASE( "lrucache::LoadingCache single flight", "[lru][loading]" ) {
+    using namespace std::chrono_literals;
+    lrucache::LoadingCache<lrucache::BaseVal<unsigned long, std::string, std::unordered_map>> cache(100);
+    std::atomic<int> loads{0};
+    auto slowLoader = [&loads](unsigned long key) {
+        ++loads;
+        std::this_thread::sleep_for(50ms);
+        return std::to_string(key);
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::string> results(16);
+    for (size_t t = 0; t < results.size(); ++t) {
+        threads.emplace_back([&, t]() { results[t] = cache.getOrLoad(7, slowLoader); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    REQUIRE( loads == 1 );
+    REQUIRE( std::all_of(results.begin(), results.end(), [](const std::string& r) { return r == "7"; }) );
+    REQUIRE( cache.get(7) == "7" );
+    REQUIRE( cache.getOrLoad(7, slowLoader) == "7" );
+    REQUIRE( loads == 1 );
+    REQUIRE( cache.loadsInFlight() == 0 );
+
+    // the exception reaches every waiter, nothing is cached
+    std::atomic<int> failures{0};
+    auto failingLoader = [&loads](unsigned long) -> std::string {
+        ++loads;
+        std::this_thread::sleep_for(50ms);
+        throw std::runtime_error("backend down");
+    };
+    threads.clear();
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&]() {
+            try {
+                cache.getOrLoad(8, failingLoader);
+            } catch (const std::runtime_error&) {
+                ++failures;
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    REQUIRE( failures == 8 );
+    REQUIRE( loads == 2 );
+    REQUIRE( !cache.get(8) );
+    REQUIRE( cache.getOrLoad(8, slowLoader) == "8" );
+}
 
-    testCacheOps(cache);
+TEST_CASE( "lrucache::LoadingCache batch load", "[lru][loading]" ) {
+    lrucache::LoadingCache<lrucache::BaseFlat<unsigned long, unsigned long>> cache(100);
+    cache.add(1, 10);
+    cache.add(3, 30);
+    std::vector<std::vector<unsigned long>> batches;
+    auto loader = [&batches](const std::vector<unsigned long>& keys) {
+        batches.push_back(keys);
+        std::vector<unsigned long> values;
+        for (auto key : keys) {
+            values.push_back(key * 10);
+        }
+        return values;
+    };
+    REQUIRE( cache.getAllOrLoad({1, 2, 3, 4, 2}, loader) == std::vector<unsigned long>{10, 20, 30, 40, 20} );
+    REQUIRE( batches == std::vector<std::vector<unsigned long>>{{2, 4}} );
+    REQUIRE( cache.getAllOrLoad({4, 1}, loader) == std::vector<unsigned long>{40, 10} );
+    REQUIRE( batches.size() == 1 );
+
+    auto shortLoader = [](const std::vector<unsigned long>&) { return std::vector<unsigned long>{}; };
+    REQUIRE_THROWS_AS( cache.getAllOrLoad({5}, shortLoader), std::length_error );
+    REQUIRE( cache.loadsInFlight() == 0 );
 }
 
-TEST_CASE( "lrucache::LRUCacheUniqPtr M ops", "[lru]" ) {
-    lrucache::LRUCacheUniqPtr<std::string, std::string, std::map> cache(3);
+TEST_CASE( "lrucache::LoadingCache expiration and refresh ahead", "[lru][loading]" ) {
+    using namespace std::chrono_literals;
+    std::chrono::steady_clock::time_point now;
+    lrucache::LoadingCache<lrucache::BaseVal<std::string, int, std::unordered_map>, 4, ManualClock> cache(10, 10s, 30s, ManualClock{&now});
+    std::atomic<int> loads{0};
+    auto loader = [&loads](const std::string&) { return ++loads; };
+
+    REQUIRE( cache.getOrLoad("a", loader) == 1 );
+    now += 5s;
+    REQUIRE( cache.getOrLoad("a", loader) == 1 );
+
+    // due for a refresh: the old value is returned and the new one loaded in the background
+    now += 6s;
+    REQUIRE( cache.getOrLoad("a", loader) == 1 );
+    for (int i = 0; i < 1000 && cache.loadsInFlight() > 0; ++i) {
+        std::this_thread::sleep_for(1ms);
+    }
+    REQUIRE( loads == 2 );
+    REQUIRE( cache.get("a") == 2 );
 
-    testCacheOps(cache);
+    // not read any more: expires and is loaded again synchronously
+    now += 31s;
+    REQUIRE( !cache.get("a") );
+    REQUIRE( cache.getOrLoad("a", loader) == 3 );
 }
 
-TEST_CASE( "lrucache::LRUCacheVal U ops", "[lru]" ) {
-    lrucache::LRUCacheVal<std::string, std::string, std::unordered_map> cache(3);
+#if defined(__linux__)
+TEST_CASE( "lrucache::SharedLRUCache single process", "[lru][shm]" ) {
+    using namespace lrucache;
+    std::string path = (std::filesystem::temp_directory_path() / "lrucache_test.shm").string();
+    std::filesystem::remove(path);
+    {
+        SharedLRUCache<uint64_t, uint64_t, 1> cache(path, 3);
+        REQUIRE( cache.isOpen() );
+        REQUIRE( !cache.add(1, 10) );
+        REQUIRE( !cache.add(2, 20) );
+        REQUIRE( !cache.add(3, 30) );
+        REQUIRE( cache.get(1) == 10 );
+        REQUIRE( !cache.add(4, 40) );
+        REQUIRE( !cache.contains(2) );
+        REQUIRE( cache.add(3, 31) );
+        REQUIRE( cache.getShardMRUKeys(1, 10) == std::vector<uint64_t>{3, 4, 1} );
+        REQUIRE( cache.peek(4) == 40 );
+        REQUIRE( cache.getShardMRUKeys(1, 10) == std::vector<uint64_t>{3, 4, 1} );
+        REQUIRE( cache.size() == 3 );
+
+        // a second mapping sees the same elements, another layout is refused
+        SharedLRUCache<uint64_t, uint64_t, 1> other(path, 3);
+        REQUIRE( other.isOpen() );
+        REQUIRE( other.get(3) == 31 );
+        REQUIRE( !(SharedLRUCache<uint64_t, uint64_t, 1>(path, 4).isOpen()) );
+        REQUIRE( !(SharedLRUCache<uint64_t, uint32_t, 1>(path, 3).isOpen()) );
+
+        other.clear();
+        REQUIRE( cache.size() == 0 );
+        REQUIRE( !cache.get(3) );
+    }
+    std::filesystem::remove(path);
 
-    testCacheOps(cache);
+    SharedLRUCache<uint64_t, uint64_t> cache(path, 1000);
+    REQUIRE( cache.isOpen() );
+    for (uint64_t i = 0; i < 5000; ++i) {
+        cache.add(i, i * 2);
+    }
+    REQUIRE( cache.maxSize() == 1008 );
+    REQUIRE( cache.size() <= cache.maxSize() );
+    REQUIRE( cache.size() > 900 );
+    for (uint64_t i = 0; i < 5000; ++i) {
+        auto value = cache.peek(i);
+        REQUIRE( (!value || *value == i * 2) );
+    }
+    REQUIRE( cache.get(4999) == 9998 );
+    std::filesystem::remove(path);
 }
 
-TEST_CASE( "lrucache::LRUCacheVal M ops", "[lru]" ) {
-    lrucache::LRUCacheVal<std::string, std::string, std::map> cache(3);
+TEST_CASE( "lrucache::SharedLRUCache across processes", "[lru][shm]" ) {
+    using namespace lrucache;
+    using Cache = SharedLRUCache<uint64_t, uint64_t, 4>;
+    std::string path = (std::filesystem::temp_directory_path() / "lrucache_test_procs.shm").string();
+    std::filesystem::remove(path);
+
+    Cache cache(path, 100000);
+    REQUIRE( cache.isOpen() );
+    std::vector<pid_t> children;
+    for (uint64_t p = 0; p < 4; ++p) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            Cache child(path, 100000);
+            bool ok = child.isOpen();
+            for (uint64_t i = 0; i < 10000; ++i) {
+                child.add(p * 10000 + i, i);
+                ok = ok && child.get(p * 10000 + i) == i;
+            }
+            _exit(ok ? 0 : 1);
+        }
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        REQUIRE( WIFEXITED(status) );
+        REQUIRE( WEXITSTATUS(status) == 0 );
+    }
+    REQUIRE( cache.size() == 40000 );
+    REQUIRE( cache.get(3 * 10000 + 17) == 17 );
+
+    // a process dying with a shard locked: the next locker clears the shard and goes on
+    pid_t pid = fork();
+    if (pid == 0) {
+        Cache child(path, 100000);
+        // exits inside the shard lock
+        child.visit(0, [](uint64_t&) { _exit(0); });
+        _exit(1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    REQUIRE( WEXITSTATUS(status) == 0 );
+    REQUIRE( cache.size() < 40000 );
+    cache.add(1, 1);
+    REQUIRE( cache.get(1) == 1 );
+    std::filesystem::remove(path);
+}
+#endif
 
+TEST_CASE( "lrucache::ShardedLRUCache single shard ops", "[lru][sharded]" ) {
+    lrucache::ShardedLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, 1> cache(3);
     testCacheOps(cache);
 }
 
-template <class T>
-void testCacheLRUStringToString(T& cache) {
-    using PV = std::vector<std::pair<std::string, std::string>>;  
+TEST_CASE( "lrucache::ShardedLRUCache single shard order getMRU", "[lru][sharded]" ) {
+    lrucache::ShardedLRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>, 1> cache(3);
+    testCacheLRUStringToString(cache);
+}
 
-    REQUIRE( cache.size() == 0 );
-    cache.add("one", "jeden");    
-    REQUIRE( cache.getMRU(5) == PV{{"one", "jeden"}} );
+TEST_CASE( "lrucache::ShardedLRUCache peek and visit", "[lru][sharded]" ) {
+    using PV = std::vector<std::pair<std::string, std::string>>;
+    lrucache::ShardedLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>, 1> cache(3);
+    cache.add("one", "jeden");
     cache.add("two", "dwa");
-    REQUIRE( cache.getMRU(5) == PV{{"two", "dwa"}, {"one", "jeden"}} );
-    cache.add("three", "trzy");
-    REQUIRE( cache.size() == 3 );
-    PV v{cache.getMRU(5)};
-    REQUIRE( v == PV{{"three", "trzy"}, {"two", "dwa"}, {"one", "jeden"}} );
-    auto x = cache.get("one");
-    v = cache.getMRU(3);
-    REQUIRE( v == PV{{"one", "jeden"}, {"three", "trzy"}, {"two", "dwa"}} );
-    v = cache.getMRU(2);
-    REQUIRE( v == PV{{"one", "jeden"}, {"three", "trzy"}} );    
-    x = cache.get("two");
-    v = cache.getMRU(4);
-    REQUIRE( v == PV{{"two", "dwa"}, {"one", "jeden"}, {"three", "trzy"}} );    
-    cache.add("four", "cztery");    
-    v = cache.getMRU(4);
-    REQUIRE( v == PV{{"four", "cztery"}, {"two", "dwa"}, {"one", "jeden"}} );    
+    REQUIRE( cache.peek("one") == std::string("jeden") );
+    REQUIRE( cache.getMRU(2) == PV{{"two", "dwa"}, {"one", "jeden"}} );
+    REQUIRE( cache.visit("one", [](std::string& v) { v = "JEDEN"; }) );
+    REQUIRE( !cache.visit("three", [](std::string&) {}) );
+    REQUIRE( cache.getMRU(2) == PV{{"one", "JEDEN"}, {"two", "dwa"}} );
 }
 
-TEST_CASE( "lrucache::LRUCache Ptr U order getMRU", "[lru]" ) {
-    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::unordered_map>> cache(3);
-    testCacheLRUStringToString(cache);
+TEST_CASE( "lrucache::ShardedLRUCache concurrent add/get", "[lru][sharded]" ) {
+    lrucache::ShardedLRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>, 8> cache(1000);
+    REQUIRE( cache.maxSize() == 1000 );
+
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong{0};
+    for (unsigned long t = 0; t < 8; ++t) {
+        threads.emplace_back([&cache, &wrong, t]() {
+            for (unsigned long i = 0; i < 20000; ++i) {
+                unsigned long key = (i * 7 + t) % 3000;
+                cache.add(key, key * 2);
+                auto opt = cache.get((i * 13 + t) % 3000);
+                if (opt.has_value() && opt.value() != ((i * 13 + t) % 3000) * 2) {
+                    ++wrong;
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+
+    REQUIRE( wrong == 0 );
+    REQUIRE( cache.size() == 1000 );
+    REQUIRE( cache.getMRU(2000).size() == 1000 );
+    REQUIRE( cache.getMRUKeys(10).size() == 10 );
+    cache.clear();
+    REQUIRE( cache.size() == 0 );
 }
 
-TEST_CASE( "lrucache::LRUCache Ptr M order getMRU", "[lru]" ) {
-    lrucache::LRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>> cache(3);
-    testCacheLRUStringToString(cache);
+TEST_CASE( "lrucache::BufferedLRUCache Val U ops", "[lru][buffered]" ) {
+    lrucache::BufferedLRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache(3);
+    testCacheOps(cache);
 }
 
-TEST_CASE( "lrucache::LRUCache Val U order getMRU", "[lru]" ) {
-    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::unordered_map>> cache(3);
+TEST_CASE( "lrucache::BufferedLRUCache Ptr M order getMRU", "[lru][buffered]" ) {
+    lrucache::BufferedLRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::map>> cache(3);
     testCacheLRUStringToString(cache);
 }
 
-TEST_CASE( "lrucache::LRUCache Val M order getMRU", "[lru]" ) {
-    lrucache::LRUCache<lrucache::BaseVal<std::string, std::string, std::map>> cache(3);
-    testCacheLRUStringToString(cache);
+TEST_CASE( "lrucache::BufferedLRUCache peek and visit", "[lru][buffered]" ) {
+    using PV = std::vector<std::pair<std::string, std::string>>;
+    lrucache::BufferedLRUCache<lrucache::BaseUniqPtr<std::string, std::string, std::unordered_map>> cache(3);
+    cache.add("one", "jeden");
+    cache.add("two", "dwa");
+    REQUIRE( cache.peek("one") == std::string("jeden") );
+    REQUIRE( cache.getMRU(2) == PV{{"two", "dwa"}, {"one", "jeden"}} );
+    REQUIRE( cache.visit("one", [](std::string& v) { v = "JEDEN"; }) );
+    REQUIRE( !cache.visit("three", [](std::string&) {}) );
+    REQUIRE( cache.getMRU(2) == PV{{"one", "JEDEN"}, {"two", "dwa"}} );
 }
 
-TEST_CASE( "lrucache::LRUCacheUniqPtr U order getMRU", "[lru]" ) {
-    lrucache::LRUCacheUniqPtr<std::string, std::string, std::unordered_map> cache(3);
-    testCacheLRUStringToString(cache);
+TEST_CASE( "lrucache::BufferedLRUCache promotions are replayed in batches", "[lru][buffered]" ) {
+    using PV = std::vector<std::pair<unsigned long, unsigned long>>;
+    lrucache::BufferedLRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>, 1, 4> cache(10);
+    for (unsigned long i = 0; i < 10; ++i) {
+        cache.add(i, i);
+    }
+    // 6 hits on a 4 slot buffer: the buffer is drained when it fills up, then the last 2 hits are buffered
+    for (unsigned long i = 0; i < 6; ++i) {
+        REQUIRE( cache.get(i) == i );
+    }
+    REQUIRE( cache.getMRU(7) == PV{{5, 5}, {4, 4}, {3, 3}, {2, 2}, {1, 1}, {0, 0}, {9, 9}} );
 }
 
-TEST_CASE( "lrucache::LRUCacheUniqPtr M order getMRU", "[lru]" ) {
-    lrucache::LRUCacheUniqPtr<std::string, std::string, std::map> cache(3);
-    testCacheLRUStringToString(cache);
+TEST_CASE( "lrucache::BufferedLRUCache concurrent add/get", "[lru][buffered]" ) {
+    lrucache::BufferedLRUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, std::unordered_map>, 4, 16> cache(500);
+
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong{0};
+    for (unsigned long t = 0; t < 8; ++t) {
+        threads.emplace_back([&cache, &wrong, t]() {
+            std::mt19937_64 rng(t);
+            ZipfGenerator zipf(2000, 0.9);
+            for (unsigned long i = 0; i < 20000; ++i) {
+                unsigned long key = zipf(rng);
+                auto opt = cache.get(key);
+                if (!opt.has_value()) {
+                    cache.add(key, key + 1);
+                } else if (opt.value() != key + 1) {
+                    ++wrong;
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+
+    REQUIRE( wrong == 0 );
+    REQUIRE( cache.size() == 500 );
+    REQUIRE( cache.getMRU(1000).size() == 500 );
 }
 
-TEST_CASE( "lrucache::LRUCacheVal U order getMRU", "[lru]" ) {
-    lrucache::LRUCacheVal<std::string, std::string, std::unordered_map> cache(3);
-    testCacheLRUStringToString(cache);
+TEST_CASE( "ZipfGenerator skew", "[zipf]" ) {
+    std::mt19937_64 rng(42);
+    ZipfGenerator zipf(1000, 1.0);
+    std::vector<unsigned long> counts(1000);
+    unsigned long max_key = 0;
+    for (int i = 0; i < 100000; ++i) {
+        auto k = zipf(rng);
+        max_key = std::max<unsigned long>(max_key, k);
+        ++counts[std::min<unsigned long>(k, 999)];
+    }
+    REQUIRE( max_key < 1000 );
+    // P(0) / P(1) == 2 for s == 1
+    REQUIRE( counts[0] > counts[1] );
+    REQUIRE( counts[1] > counts[9] );
+    REQUIRE( std::abs(double(counts[0]) / counts[1] - 2.0) < 0.2 );
 }
 
-TEST_CASE( "lrucache::LRUCacheVal M order getMRU", "[lru]" ) {
-    lrucache::LRUCacheVal<std::string, std::string, std::map> cache(3);
-    testCacheLRUStringToString(cache);
+TEST_CASE( "trace line formats", "[trace]" ) {
+    auto keysOf = [](std::string_view line, TraceFormat format) {
+        std::vector<uint64_t> keys;
+        parseTraceLine(line, format, [&keys](uint64_t key) { keys.push_back(key); });
+        return keys;
+    };
+    using V = std::vector<uint64_t>;
+    REQUIRE( keysOf("42\r", TraceFormat::Text) == V{42} );
+    REQUIRE( keysOf("user:42", TraceFormat::Text) == keysOf(" user:42 ", TraceFormat::Text) );
+    REQUIRE( keysOf("user:42", TraceFormat::Text).size() == 1 );
+    REQUIRE( keysOf("", TraceFormat::Text).empty() );
+    REQUIRE( keysOf("*", TraceFormat::Lirs).empty() );
+    REQUIRE( keysOf("7", TraceFormat::Lirs) == V{7} );
+    REQUIRE( keysOf("100  3 0 1", TraceFormat::Arc) == V{100, 101, 102} );
+
+    // 4 KB blocks 2 and 3 of the volume
+    auto msr = keysOf("128166372003061629,hm,1,Read,8192,4097,1331", TraceFormat::Msr);
+    REQUIRE( msr.size() == 2 );
+    REQUIRE( (msr[0] & 0xFFFF) == 2 );
+    REQUIRE( msr[1] == msr[0] + 1 );
+    REQUIRE( keysOf("128166372003061629,hm,2,Read,8192,4096,1331", TraceFormat::Msr) != V{msr[0]} );
+    REQUIRE( keysOf("128166372003061629,hm,1,Write,8192,1,1331", TraceFormat::Msr) == V{msr[0]} );
+
+    REQUIRE( traceFormatOf("arc") == TraceFormat::Arc );
+    REQUIRE( !traceFormatOf("csv") );
 }
 
 #define BENCHMARKS
@@ -254,6 +2283,26 @@ BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal M operations add/get existin
     benchAddGetExistingKeys(meter, cache);
 };
 
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseFlat operations add/get existing keys")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseFlat<unsigned long, unsigned long>> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseUniqPtr S operations add/get existing keys")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, lrucache::SwissMap>> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal S operations add/get existing keys")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, lrucache::SwissMap>> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::ClockCache U operations add/get existing keys")(Catch::Benchmark::Chronometer meter) {
+    lrucache::ClockCache<unsigned long, unsigned long, std::unordered_map> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -299,6 +2348,317 @@ BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal M operations add/get existin
     benchAddGetMixedKeys(meter, cache);
 };
 
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseFlat operations add/get existing keys")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseFlat<unsigned long, unsigned long>> cache(Size);
+    benchAddGetMixedKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseUniqPtr S operations add/get existing keys")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, lrucache::SwissMap>> cache(Size);
+    benchAddGetMixedKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal S operations add/get existing keys")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, lrucache::SwissMap>> cache(Size);
+    benchAddGetMixedKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::ClockCache U operations add/get existing keys")(Catch::Benchmark::Chronometer meter) {
+    lrucache::ClockCache<unsigned long, unsigned long, std::unordered_map> cache(Size);
+    benchAddGetMixedKeys(meter, cache);
+};
+
+
+}
+
+}
+
+// Lookups of 64 byte keys received as std::string_view, half of them are misses
+template <typename T, typename ToKey>
+void benchGetStringView(Catch::Benchmark::Chronometer meter, T& cache, ToKey toKey)
+{
+    auto Size = cache.maxSize();
+    std::vector<std::string> keys;
+    for (auto i = 0UL; i < 2 * Size; ++i) {
+        std::string key = std::to_string(i);
+        keys.push_back(std::string(64 - key.size(), 'k') + key);
+    }
+    for (auto i = 0UL; i < Size; ++i) {
+        cache.add(keys[i], i);
+    }
+    volatile unsigned long r{0};
+    meter.measure([&r, &cache, &keys, &toKey]() {
+        size_t allocations = g_allocations;
+        for (auto& key : keys) {
+            r = r + cache.get(toKey(std::string_view(key))).value_or(0);
+        }
+        return (g_allocations - allocations) / keys.size();
+    });
+}
+
+TEST_CASE( "Benchmarks string_view lookup", "[benchmarks]" ) {
+
+for (size_t Size = 100000UL; Size >= 1000; Size /= 10) {
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal U get(std::string(string_view))")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, unsigned long, std::unordered_map>> cache(Size);
+    benchGetStringView(meter, cache, [](std::string_view key) { return std::string(key); });
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal transparent S get(string_view)")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, unsigned long, TransparentSwissMap>> cache(Size);
+    benchGetStringView(meter, cache, [](std::string_view key) { return key; });
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal M get(std::string(string_view))")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, unsigned long, std::map>> cache(Size);
+    benchGetStringView(meter, cache, [](std::string_view key) { return std::string(key); });
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal transparent M get(string_view)")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<std::string, unsigned long, TransparentMap>> cache(Size);
+    benchGetStringView(meter, cache, [](std::string_view key) { return key; });
+};
+
+}
+
+}
+
+// Random lookups by batches of 256 keys, 1 in 9 misses: get() in a loop or getMany()
+template <typename T>
+void benchGetBatch(Catch::Benchmark::Chronometer meter, T& cache, bool batch)
+{
+    const size_t Batch = 256;
+    auto Size = cache.maxSize();
+    for (auto i = 0UL; i < Size; ++i) {
+        cache.add(i, i);
+    }
+    std::mt19937_64 rng(7);
+    std::vector<unsigned long> keys(Batch * 64);
+    for (auto& key : keys) {
+        key = rng() % (Size + Size / 8);
+    }
+    std::vector<std::optional<unsigned long>> values(Batch);
+    volatile size_t hits{0};
+    meter.measure([&hits, &cache, &keys, &values, batch]() {
+        for (size_t start = 0; start < keys.size(); start += Batch) {
+            if (batch) {
+                hits = hits + cache.getMany(&keys[start], Batch, values.data());
+                continue;
+            }
+            for (size_t i = 0; i < Batch; ++i) {
+                values[i] = cache.get(keys[start + i]);
+                hits = hits + (values[i] ? 1 : 0);
+            }
+        }
+        return hits;
+    });
+}
+
+// The caches are much larger than the last level cache, every lookup misses it
+TEST_CASE( "Benchmarks batch lookup", "[benchmarks]" ) {
+
+const size_t Size = 1UL << 22;
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal U get() loop")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>> cache(Size);
+    benchGetBatch(meter, cache, false);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal U getMany()")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>> cache(Size);
+    benchGetBatch(meter, cache, true);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseFlat get() loop")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseFlat<unsigned long, unsigned long>> cache(Size);
+    benchGetBatch(meter, cache, false);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseFlat getMany()")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseFlat<unsigned long, unsigned long>> cache(Size);
+    benchGetBatch(meter, cache, true);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal S get() loop")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, lrucache::SwissMap>> cache(Size);
+    benchGetBatch(meter, cache, false);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal S getMany()")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<lrucache::BaseVal<unsigned long, unsigned long, lrucache::SwissMap>> cache(Size);
+    benchGetBatch(meter, cache, true);
+};
+
+}
+
+// NoStats must cost nothing: the first two are the same operations on the same cache
+TEST_CASE( "Benchmarks stats overhead", "[benchmarks]" ) {
+
+using Base = lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>;
+const size_t Size = 10000;
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal U default")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<Base> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal U NoStats")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<Base, lrucache::NoRemovalListener, lrucache::NoStats> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal U CacheStats")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<Base, lrucache::NoRemovalListener, lrucache::CacheStats> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal U ConcurrentCacheStats")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<Base, lrucache::NoRemovalListener, lrucache::ConcurrentCacheStats<>> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
+BENCHMARK_ADVANCED_SIZE("lrucache::LRUCache BaseVal U TimedCacheStats")(Catch::Benchmark::Chronometer meter) {
+    lrucache::LRUCache<Base, lrucache::NoRemovalListener, lrucache::TimedCacheStats<>> cache(Size);
+    benchAddGetExistingKeys(meter, cache);
+};
+
+}
+
+// Every thread performs Ops / threads get calls (with 1 add per 8 gets) on its own key range
+template <typename T>
+void benchConcurrentAddGet(Catch::Benchmark::Chronometer meter, T& cache, unsigned long threads)
+{
+    auto Size = cache.maxSize();
+    for (auto i = 0UL; i < Size; ++i) {
+        cache.add(i, i);
+    }
+    const unsigned long Ops = 1UL << 20;
+    meter.measure([&cache, threads, Size, Ops]() {
+        std::vector<std::thread> workers;
+        std::atomic<unsigned long> sum{0};
+        for (auto t = 0UL; t < threads; ++t) {
+            workers.emplace_back([&cache, &sum, t, threads, Size, Ops]() {
+                unsigned long r{0};
+                for (auto i = 0UL; i < Ops / threads; ++i) {
+                    unsigned long key = (i * 2654435761UL + t) % (Size + Size / 8);
+                    if ((i & 7) == 0) {
+                        cache.add(key, i);
+                    } else {
+                        r += cache.get(key).value_or(0);
+                    }
+                }
+                sum += r;
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        return sum.load();
+    });
+}
+
+TEST_CASE( "Benchmarks concurrent", "[benchmarks]" ) {
+
+const size_t Size = 100000UL;
+
+for (unsigned long Threads = 1; Threads <= 64; Threads *= 2) {
+
+#define BENCHMARK_ADVANCED_THREADS(MY_S) BENCHMARK_ADVANCED(((MY_S) + (" threads " + std::to_string(Threads))).c_str())
+
+BENCHMARK_ADVANCED_THREADS("lrucache::ShardedLRUCache<BaseVal U, 1> (global mutex) concurrent add/get")(Catch::Benchmark::Chronometer meter) {
+    lrucache::ShardedLRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>, 1> cache(Size);
+    benchConcurrentAddGet(meter, cache, Threads);
+};
+
+BENCHMARK_ADVANCED_THREADS("lrucache::ShardedLRUCache<BaseVal U, 64> concurrent add/get")(Catch::Benchmark::Chronometer meter) {
+    lrucache::ShardedLRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>, 64> cache(Size);
+    benchConcurrentAddGet(meter, cache, Threads);
+};
+
+BENCHMARK_ADVANCED_THREADS("lrucache::ShardedLRUCache<BaseUniqPtr U, 64> concurrent add/get")(Catch::Benchmark::Chronometer meter) {
+    lrucache::ShardedLRUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, std::unordered_map>, 64> cache(Size);
+    benchConcurrentAddGet(meter, cache, Threads);
+};
+
+BENCHMARK_ADVANCED_THREADS("lrucache::BufferedLRUCache<BaseVal U> concurrent add/get")(Catch::Benchmark::Chronometer meter) {
+    lrucache::BufferedLRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>> cache(Size);
+    benchConcurrentAddGet(meter, cache, Threads);
+};
+
+}
+
+}
+
+// Read heavy Zipf distributed keys: every operation is a get, 1 in 32 misses is followed by an add
+template <typename T>
+void benchConcurrentZipf(Catch::Benchmark::Chronometer meter, T& cache, unsigned long threads, double skew)
+{
+    auto Size = cache.maxSize();
+    const unsigned long Ops = 1UL << 20;
+    std::vector<std::vector<unsigned long>> keys(threads);
+    for (auto t = 0UL; t < threads; ++t) {
+        std::mt19937_64 rng(t);
+        ZipfGenerator zipf(Size * 4, skew);
+        keys[t].reserve(Ops / threads);
+        for (auto i = 0UL; i < Ops / threads; ++i) {
+            keys[t].push_back(zipf(rng));
+        }
+    }
+    for (auto i = 0UL; i < Size; ++i) {
+        cache.add(i, i);
+    }
+    meter.measure([&cache, &keys, threads]() {
+        std::vector<std::thread> workers;
+        std::atomic<unsigned long> sum{0};
+        for (auto t = 0UL; t < threads; ++t) {
+            workers.emplace_back([&cache, &sum, &keys, t]() {
+                unsigned long r{0};
+                unsigned long i{0};
+                for (auto key : keys[t]) {
+                    auto opt = cache.get(key);
+                    if (opt.has_value()) {
+                        r += opt.value();
+                    } else if (i++ % 32 == 0) {
+                        cache.add(key, key);
+                    }
+                }
+                sum += r;
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        return sum.load();
+    });
+}
+
+TEST_CASE( "Benchmarks concurrent read heavy Zipf", "[benchmarks]" ) {
+
+const size_t Size = 100000UL;
+const double Skew = 0.99;
+
+for (unsigned long Threads = 1; Threads <= 64; Threads *= 4) {
+
+BENCHMARK_ADVANCED_THREADS("lrucache::ShardedLRUCache<BaseVal U, 1> (global mutex) read heavy Zipf")(Catch::Benchmark::Chronometer meter) {
+    lrucache::ShardedLRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>, 1> cache(Size);
+    benchConcurrentZipf(meter, cache, Threads, Skew);
+};
+
+BENCHMARK_ADVANCED_THREADS("lrucache::ShardedLRUCache<BaseVal U, 16> read heavy Zipf")(Catch::Benchmark::Chronometer meter) {
+    lrucache::ShardedLRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>, 16> cache(Size);
+    benchConcurrentZipf(meter, cache, Threads, Skew);
+};
+
+BENCHMARK_ADVANCED_THREADS("lrucache::BufferedLRUCache<BaseVal U> read heavy Zipf")(Catch::Benchmark::Chronometer meter) {
+    lrucache::BufferedLRUCache<lrucache::BaseVal<unsigned long, unsigned long, std::unordered_map>> cache(Size);
+    benchConcurrentZipf(meter, cache, Threads, Skew);
+};
+
+BENCHMARK_ADVANCED_THREADS("lrucache::BufferedLRUCache<BaseUniqPtr U> read heavy Zipf")(Catch::Benchmark::Chronometer meter) {
+    lrucache::BufferedLRUCache<lrucache::BaseUniqPtr<unsigned long, unsigned long, std::unordered_map>> cache(Size);
+    benchConcurrentZipf(meter, cache, Threads, Skew);
+};
 
 }
 
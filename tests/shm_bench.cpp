@@ -0,0 +1,178 @@
+// Multi-process benchmark: N forked processes run the same Zipf get()/add() workload against one SharedLRUCache
+// and against a private LRUCache each (capacity / N elements, the same total memory), see tests/README.md
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lrucache.h"
+#include "lrucache_flat.h"
+#include "lrucache_shm.h"
+#include "zipf.h"
+
+namespace {
+
+using Key = uint64_t;
+using Value = uint64_t;
+
+struct Options {
+    unsigned procs = 8;
+    size_t capacity = 1000000;
+    uint64_t keys = 10000000;
+    size_t ops = 2000000;
+    double skew = 0.9;
+    std::string path = "/dev/shm/lrucache_bench.shm";
+};
+
+// Filled by every process, in a shared anonymous mapping
+struct Result {
+    uint64_t hits;
+    uint64_t ops;
+    double seconds;
+};
+
+template <typename Cache>
+Result runWorkload(Cache& cache, const Options& options, unsigned proc) {
+    std::mt19937_64 rng(proc + 1);
+    ZipfGenerator zipf(options.keys, options.skew);
+    Result result{0, options.ops, 0.0};
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < options.ops; ++i) {
+        Key key = zipf(rng) * 0x9e3779b97f4a7c15ULL;
+        if (cache.get(key)) {
+            ++result.hits;
+        } else {
+            cache.add(key, key);
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Forks options.procs processes running fn(proc), returns their results
+template <typename F>
+std::vector<Result> runProcesses(const Options& options, F fn) {
+    size_t bytes = sizeof(Result) * options.procs;
+    void* shared = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        throw std::runtime_error("cannot map the results");
+    }
+    auto* results = static_cast<Result*>(shared);
+    std::vector<pid_t> children;
+    for (unsigned p = 0; p < options.procs; ++p) {
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            results[p] = fn(p);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    bool ok = true;
+    for (pid_t pid : children) {
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    std::vector<Result> collected(results, results + options.procs);
+    ::munmap(shared, bytes);
+    if (!ok) {
+        throw std::runtime_error("a process failed");
+    }
+    return collected;
+}
+
+void report(const std::string& name, const std::vector<Result>& results) {
+    uint64_t hits = 0;
+    uint64_t ops = 0;
+    double seconds = 0.0;
+    for (auto& r : results) {
+        hits += r.hits;
+        ops += r.ops;
+        seconds = std::max(seconds, r.seconds);
+    }
+    std::cout << name << ": " << static_cast<uint64_t>(ops / seconds) << " ops/s, hit ratio "
+              << static_cast<double>(hits) / ops << "\n";
+}
+
+void usage() {
+    std::cerr << "usage: LRUCacheShmBench [--procs N] [--capacity N] [--keys N] [--ops N per process] [--skew S]\n"
+                 "                        [--path segment file, default /dev/shm/lrucache_bench.shm]\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                usage();
+                return 1;
+            }
+            std::string value = argv[++i];
+            if (arg == "--procs") {
+                options.procs = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+            } else if (arg == "--capacity") {
+                options.capacity = std::stoull(value);
+            } else if (arg == "--keys") {
+                options.keys = std::stoull(value);
+            } else if (arg == "--ops") {
+                options.ops = std::stoull(value);
+            } else if (arg == "--skew") {
+                options.skew = std::stod(value);
+            } else if (arg == "--path") {
+                options.path = value;
+            } else {
+                usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        usage();
+        return 1;
+    }
+
+    std::cout << options.procs << " processes, capacity " << options.capacity << ", " << options.keys
+              << " keys, Zipf " << options.skew << ", " << options.ops << " ops per process\n";
+    try {
+        report("private LRUCache (capacity / procs each)", runProcesses(options, [&](unsigned p) {
+            lrucache::LRUCache<lrucache::BaseFlat<Key, Value>> cache(options.capacity / options.procs);
+            return runWorkload(cache, options, p);
+        }));
+
+        std::filesystem::remove(options.path);
+        {
+            // created before the fork, the children map the same segment
+            lrucache::SharedLRUCache<Key, Value, 64> cache(options.path, options.capacity);
+            if (!cache.isOpen()) {
+                std::cerr << "cannot create " << options.path << "\n";
+                return 1;
+            }
+            report("SharedLRUCache, 64 shards", runProcesses(options, [&](unsigned p) {
+                lrucache::SharedLRUCache<Key, Value, 64> shared(options.path, options.capacity);
+                if (!shared.isOpen()) {
+                    _exit(1);
+                }
+                return runWorkload(shared, options, p);
+            }));
+        }
+        std::filesystem::remove(options.path);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        std::filesystem::remove(options.path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Trace driven simulator: replays a key access trace through the cache policies at a range of capacities
+// and prints the hit ratios (the miss ratio curves) as CSV, see tests/README.md
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cmath>
+#include <cstdint>
+
+#include "lrucache.h"
+#include "lrucache_flat.h"
+#include "lrucache_sharded.h"
+#include "lrucache_clock.h"
+#include "lrucache_slru.h"
+#include "lrucache_2q.h"
+#include "lrucache_arc.h"
+#include "lrucache_tinylfu.h"
+#include "trace.h"
+
+namespace {
+
+using Key = uint64_t;
+
+class Simulation {
+public:
+    virtual ~Simulation() = default;
+
+    // get(), add() on a miss, returns true on a hit
+    virtual bool access(Key key) = 0;
+};
+
+template <typename T>
+class CacheSimulation : public Simulation {
+public:
+    explicit CacheSimulation(size_t capacity)
+        : cache_(capacity)
+    {
+
+    }
+
+    bool access(Key key) override {
+        if (cache_.get(key)) {
+            return true;
+        }
+        cache_.add(key, true);
+        return false;
+    }
+
+private:
+    T cache_;
+};
+
+struct Policy {
+    std::string name_;
+    std::function<std::unique_ptr<Simulation>(size_t)> create_;
+};
+
+template <typename T>
+Policy policy(const std::string& name) {
+    return {name, [](size_t capacity) { return std::make_unique<CacheSimulation<T>>(capacity); }};
+}
+
+std::vector<Policy> allPolicies() {
+    using namespace lrucache;
+    using Base = BaseFlat<Key, bool>;
+    return {
+        policy<LRUCache<Base>>("lru"),
+        policy<ShardedLRUCache<Base, 16>>("lru-sharded16"),
+        policy<ClockCache<Key, bool, std::unordered_map>>("clock"),
+        policy<SLRUCache<Base>>("slru"),
+        policy<TwoQCache<Base>>("2q"),
+        policy<ARCCache<Base>>("arc"),
+        policy<TinyLFUCache<Base>>("tinylfu"),
+    };
+}
+
+struct Task {
+    const Policy* policy_;
+    size_t capacity_;
+    uint64_t accesses_{0};
+    uint64_t hits_{0};
+};
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> items;
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, sep)) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+// min:max:points, geometrically spaced
+std::vector<size_t> capacityRange(const std::string& spec) {
+    auto parts = split(spec, ':');
+    if (parts.size() != 3) {
+        throw std::invalid_argument("bad range " + spec);
+    }
+    size_t min = std::stoull(parts[0]);
+    size_t max = std::stoull(parts[1]);
+    size_t points = std::stoull(parts[2]);
+    std::vector<size_t> capacities;
+    for (size_t i = 0; i < points; ++i) {
+        double ratio = points > 1 ? static_cast<double>(i) / (points - 1) : 0.0;
+        size_t capacity = static_cast<size_t>(std::llround(min * std::pow(double(max) / min, ratio)));
+        if (capacities.empty() || capacities.back() != capacity) {
+            capacities.push_back(std::max<size_t>(capacity, 1));
+        }
+    }
+    return capacities;
+}
+
+void usage() {
+    std::cerr << "usage: LRUCacheSim trace [--format text|lirs|arc|msr] [--policies lru,clock,slru,2q,arc,tinylfu,...]\n"
+                 "                   [--capacities 1000,2000,...|--range min:max:points] [--threads N]\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string path;
+    TraceFormat format = TraceFormat::Text;
+    std::vector<std::string> policy_names;
+    std::vector<size_t> capacities;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--format" && has_value) {
+                auto parsed = traceFormatOf(argv[++i]);
+                if (!parsed) {
+                    usage();
+                    return 1;
+                }
+                format = *parsed;
+            } else if (arg == "--policies" && has_value) {
+                policy_names = split(argv[++i], ',');
+            } else if (arg == "--capacities" && has_value) {
+                capacities.clear();
+                for (auto& item : split(argv[++i], ',')) {
+                    capacities.push_back(std::stoull(item));
+                }
+            } else if (arg == "--range" && has_value) {
+                capacities = capacityRange(argv[++i]);
+            } else if (arg == "--threads" && has_value) {
+                threads = std::max(1u, static_cast<unsigned>(std::stoul(argv[++i])));
+            } else if (path.empty() && arg.rfind("--", 0) != 0) {
+                path = arg;
+            } else {
+                usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        usage();
+        return 1;
+    }
+    if (path.empty()) {
+        usage();
+        return 1;
+    }
+    if (capacities.empty()) {
+        capacities = capacityRange("1000:1000000:16");
+    }
+
+    std::vector<Policy> policies;
+    for (auto& p : allPolicies()) {
+        if (policy_names.empty() || std::find(policy_names.begin(), policy_names.end(), p.name_) != policy_names.end()) {
+            policies.push_back(std::move(p));
+        }
+    }
+    if (policies.empty()) {
+        std::cerr << "no such policy\n";
+        return 1;
+    }
+
+    // every task replays the whole trace on its own cache, the mapped file is shared through the page cache
+    std::vector<Task> tasks;
+    for (auto& p : policies) {
+        for (size_t capacity : capacities) {
+            tasks.push_back({&p, capacity});
+        }
+    }
+    std::atomic<size_t> next{0};
+    std::mutex error_mutex;
+    std::string error;
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < std::min<size_t>(threads, tasks.size()); ++t) {
+        workers.emplace_back([&]() {
+            for (size_t i = next++; i < tasks.size(); i = next++) {
+                Task& task = tasks[i];
+                auto simulation = task.policy_->create_(task.capacity_);
+                try {
+                    forEachTraceKey(path, format, [&task, &simulation](Key key) {
+                        ++task.accesses_;
+                        task.hits_ += simulation->access(key) ? 1 : 0;
+                    });
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    error = e.what();
+                    return;
+                }
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    if (!error.empty()) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    std::cout << "policy,capacity,accesses,hits,hit_ratio\n";
+    for (auto& task : tasks) {
+        double ratio = task.accesses_ ? static_cast<double>(task.hits_) / task.accesses_ : 0.0;
+        std::cout << task.policy_->name_ << "," << task.capacity_ << "," << task.accesses_ << ","
+                  << task.hits_ << "," << ratio << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+#ifndef LRUCACHE_TESTS_TRACE_H
+#define LRUCACHE_TESTS_TRACE_H
+
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <charconv>
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LRUCACHE_TRACE_MMAP
+#endif
+
+// Key access traces:
+// - Text: one key per line, a decimal number is taken as is, any other key is hashed
+// - Lirs: one block number per line (the LIRS traces), the lines which are not a number are skipped
+// - Arc: "start_block block_count ignored request_number" per line (the ARC traces), block_count accesses
+// - Msr: "timestamp,hostname,disk,type,offset,size,response_time" (MSR Cambridge), one access per 4 KB block
+enum class TraceFormat { Text, Lirs, Arc, Msr };
+
+inline std::optional<TraceFormat> traceFormatOf(std::string_view name) {
+    if (name == "text") return TraceFormat::Text;
+    if (name == "lirs") return TraceFormat::Lirs;
+    if (name == "arc") return TraceFormat::Arc;
+    if (name == "msr") return TraceFormat::Msr;
+    return {};
+}
+
+namespace trace_detail {
+
+inline std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+inline std::optional<uint64_t> toNumber(std::string_view s) {
+    uint64_t value = 0;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (ec != std::errc() || end != s.data() + s.size() || s.empty()) {
+        return {};
+    }
+    return value;
+}
+
+// Splits s at the separator (any run of blanks if sep is ' '), the field is removed from s
+inline std::string_view nextField(std::string_view& s, char sep) {
+    if (sep == ' ') {
+        s = trim(s);
+    }
+    size_t end = sep == ' ' ? s.find_first_of(" \t") : s.find(sep);
+    std::string_view field = s.substr(0, end);
+    s = end == std::string_view::npos ? std::string_view() : s.substr(end + 1);
+    return trim(field);
+}
+
+} // namespace trace_detail
+
+// Calls fn(key) for every access of the line
+template <typename F>
+void parseTraceLine(std::string_view line, TraceFormat format, F&& fn) {
+    using namespace trace_detail;
+    line = trim(line);
+    if (line.empty()) {
+        return;
+    }
+    switch (format) {
+    case TraceFormat::Text:
+        if (auto key = toNumber(line)) {
+            fn(*key);
+        } else {
+            fn(static_cast<uint64_t>(std::hash<std::string_view>{}(line)));
+        }
+        break;
+    case TraceFormat::Lirs:
+        if (auto key = toNumber(line)) {
+            fn(*key);
+        }
+        break;
+    case TraceFormat::Arc: {
+        auto start = toNumber(nextField(line, ' '));
+        auto count = toNumber(nextField(line, ' '));
+        if (start && count) {
+            for (uint64_t block = 0; block < *count; ++block) {
+                fn(*start + block);
+            }
+        }
+        break;
+    }
+    case TraceFormat::Msr: {
+        const uint64_t block_size = 4096;
+        nextField(line, ',');   // timestamp
+        std::string_view host = nextField(line, ',');
+        auto disk = toNumber(nextField(line, ','));
+        nextField(line, ',');   // Read or Write
+        auto offset = toNumber(nextField(line, ','));
+        auto size = toNumber(nextField(line, ','));
+        if (!disk || !offset || !size) {
+            break;
+        }
+        // the volume in the top 16 bits, the block number below
+        uint64_t volume = (std::hash<std::string_view>{}(host) * 31 + *disk) << 48;
+        uint64_t last = (*offset + std::max<uint64_t>(*size, 1) - 1) / block_size;
+        for (uint64_t block = *offset / block_size; block <= last; ++block) {
+            fn(volume ^ block);
+        }
+        break;
+    }
+    }
+}
+
+// Calls fn(key) for every access of the trace file, mapping the file into memory where possible
+// (otherwise reading it line by line), so the trace never has to fit in memory. Throws std::runtime_error.
+template <typename F>
+void forEachTraceKey(const std::string& path, TraceFormat format, F&& fn) {
+#if defined(LRUCACHE_TRACE_MMAP)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path);
+    }
+    size_t length = static_cast<size_t>(st.st_size);
+    if (length == 0) {
+        ::close(fd);
+        return;
+    }
+    void* data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("cannot map " + path);
+    }
+    ::madvise(data, length, MADV_SEQUENTIAL);
+    std::string_view rest(static_cast<const char*>(data), length);
+    try {
+        while (!rest.empty()) {
+            size_t end = rest.find('\n');
+            parseTraceLine(rest.substr(0, end), format, fn);
+            rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+        }
+    } catch (...) {
+        ::munmap(data, length);
+        throw;
+    }
+    ::munmap(data, length);
+#else
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        parseTraceLine(line, format, fn);
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef LRUCACHE_TESTS_ZIPF_H
+#define LRUCACHE_TESTS_ZIPF_H
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+
+// Zipf distributed ranks 0..n-1 (rank 0 is the most popular, P(k) ~ 1 / (k + 1)^s) for any s > 0,
+// using rejection-inversion sampling (Hormann, Derflinger) in O(1) memory
+class ZipfGenerator {
+    uint64_t n_;
+    double s_;
+    double h_integral_x1_;
+    double h_integral_n_;
+    double threshold_;
+
+    // log1p(x) / x
+    static double helper1(double x) {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+
+    // expm1(x) / x
+    static double helper2(double x) {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+    }
+
+    double h(double x) const { return std::exp(-s_ * std::log(x)); }
+
+    double hIntegral(double x) const {
+        double log_x = std::log(x);
+        return helper2((1.0 - s_) * log_x) * log_x;
+    }
+
+    double hIntegralInverse(double x) const {
+        double t = x * (1.0 - s_);
+        if (t < -1.0) {
+            t = -1.0;
+        }
+        return std::exp(helper1(t) * x);
+    }
+
+public:
+    ZipfGenerator(uint64_t n, double s)
+        : n_(n)
+        , s_(s)
+        , h_integral_x1_(hIntegral(1.5) - 1.0)
+        , h_integral_n_(hIntegral(static_cast<double>(n) + 0.5))
+        , threshold_(2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0)))
+    {
+
+    }
+
+    template <typename Rng>
+    uint64_t operator()(Rng& rng) {
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        while (true) {
+            double u = h_integral_n_ + uniform(rng) * (h_integral_x1_ - h_integral_n_);
+            double x = hIntegralInverse(u);
+            double k = std::floor(x + 0.5);
+            k = std::clamp(k, 1.0, static_cast<double>(n_));
+            if (k - x <= threshold_ || u >= hIntegral(k + 0.5) - h(k)) {
+                return static_cast<uint64_t>(k) - 1;
+            }
+        }
+    }
+
+};
+
+#endif